@@ -88,6 +88,10 @@ typedef void CURL;
  * The magic number of an index block in a file.
  */
 #define IDX_MAGIC 0x2468ace0
+/*!
+ * The magic number of a prefix sum file (see `bwWritePrefixSums()`).
+ */
+#define PREFIXSUM_MAGIC 0x50524653
 /*!
  * The default number of children per block.
  */
@@ -110,7 +114,8 @@ enum bwStatsType {
     min = 3, /*!< The minimum value */
     cov = 4, /*!< The number of bases covered */
     coverage = 4, /*!<The number of bases covered */ 
-    sum = 5 /*!< The sum of per-base values */
+    sum = 5, /*!< The sum of per-base values */
+    median = 6 /*!< The median of per-base values. Zoom levels can't give this, see `bwQuantiles()` */
 };
 
 //Should hide this from end users
@@ -127,6 +132,34 @@ typedef struct {
     bwRTree_t **idx; /**<Index for each zoom level. Represented as a tree*/
 } bwZoomHdr_t;
 
+/// @cond SKIP
+/*!
+ * @brief Per-chromosome cumulative sums over every record in a bigWig file, used by `bwStats()` when present.
+ */
+typedef struct {
+    uint32_t nKeys; /**<The number of chromosomes.*/
+    uint64_t *offset; /**<The records for chromosome i are offset[i] through offset[i+1]-1 (there are nKeys+1 of these).*/
+    uint32_t *start; /**<The start position of each record.*/
+    uint32_t *end; /**<The end position of each record.*/
+    float *value; /**<The value of each record.*/
+    double *sum; /**<The sum of value*(end-start) over this and all preceding records on the same chromosome.*/
+    uint64_t *covered; /**<Likewise, the number of bases covered.*/
+} bwPrefixSums_t;
+/// @endcond
+
+/*!
+ * @brief Summary statistics for the values on a single chromosome, as returned by `bwChromSummaries()`.
+ *
+ * These correspond to the whole file summary in bigWigHdr_t.
+ */
+typedef struct {
+    uint64_t nBasesCovered; /**<The number of bases with a value.*/
+    double minVal; /**<The minimum value, or NaN if no bases have a value.*/
+    double maxVal; /**<The maximum value, or NaN if no bases have a value.*/
+    double sumData; /**<The sum of the per-base values.*/
+    double sumSquared; /**<The sum of the squared per-base values.*/
+} bwChromSummary_t;
+
 /*!
  * @brief The header section of a bigWig file.
  *
@@ -151,31 +184,56 @@ typedef struct {
     double maxVal; /**<The maximum value in the file.*/
     double sumData; /**<The sum of all values in the file.*/
     double sumSquared; /**<The sum of the squared values in the file.*/
+    bwPrefixSums_t *prefixSums; /**<If not NULL, prefix sums that `bwStats()` uses for means, coverage and sums. See `bwCreatePrefixSums()`.*/
 } bigWigHdr_t;
 
+/// @cond SKIP
+/*!
+ * @brief What's needed to look up chromosomes in the on-disk chromosome tree.
+ */
+typedef struct {
+    uint64_t rootOffset; /**<The offset of the root node.*/
+    uint32_t keySize; /**<The size of each key (chromosome name), which is not necessarily null terminated.*/
+    uint32_t itemsPerBlock; /**<The maximum number of items in a node.*/
+    uint32_t lastTid; /**<The last chromosome looked up by name, which is checked first.*/
+    int loaded; /**<Set once every chromosome has been read in, after which the tree is no longer used.*/
+    char lock; /**<Held while reading in every chromosome.*/
+} bwChromTree_t;
+/// @endcond
+
 //Should probably replace this with a hash
 /*!
  * @brief Holds the chromosomes and their lengths
+ *
+ * If a file is opened with lazy chromosome loading (see `bwOpen()`), then `chrom[i]` is NULL and `len[i]` 0 until chromosome `i` has been looked up. Use `bwGetChrom()` and `bwGetChromLen()` rather than accessing these directly in that case.
  */
 typedef struct {
     int64_t nKeys; /**<The number of chromosomes */
     char **chrom; /**<A list of null terminated chromosomes */
     uint32_t *len; /**<The lengths of each chromosome */
+    bwChromTree_t *tree; /**<For lazily loaded lists, how to find the remaining chromosomes. This is NULL for lists that were read in completely.*/
+    char *arena; /**<If not NULL, a single buffer holding the null terminated chromosome names that chrom[i] point into (chromosomes that were looked up lazily are allocated separately).*/
+    size_t arenaLen; /**<The size of arena in bytes.*/
 } chromList_t;
 
 //TODO remove from bigWig.h
 /// @cond SKIP
-typedef struct bwLL bwLL;
-struct bwLL {
-    bwRTreeNode_t *node;
-    struct bwLL *next;
-};
+typedef struct {
+    uint32_t tid0, start, tid1, end;
+    uint64_t offset, size;
+} bwBlockRecord_t;
 typedef struct bwZoomBuffer_t bwZoomBuffer_t;
 struct bwZoomBuffer_t { //each individual entry takes 32 bytes
-    void *p;
+    void *p; //NULL if the buffer was spilled to bwWriteBuffer_t.zoomSpill
     uint32_t l, m;
+    uint64_t offset; //Where the buffer was spilled to
     struct bwZoomBuffer_t *next;
 };
+typedef struct {
+    uint32_t tid, start, end;
+    float value;
+} bwZoomEntry_t;
+struct bwWritePool_t;
 /// @endcond
 
 /*!
@@ -195,15 +253,49 @@ typedef struct {
     uint8_t ltype; /**<The type of the last entry added*/
     uint32_t l; /**<The current size of p. This and the type determine the number of items held*/
     void *p; /**<A buffer of size hdr->bufSize*/
-    bwLL *firstIndexNode; /**<The first index node in the linked list*/
-    bwLL *currentIndexNode; /**<The last index node in a linked list*/
+    bwBlockRecord_t *blocks; /**<The position and location of each of the nBlocks blocks, for the index*/
+    uint64_t mBlocks; /**<The number of blocks that blocks can hold*/
     bwZoomBuffer_t **firstZoomBuffer; /**<The first node in a linked list of leaf nodes*/
     bwZoomBuffer_t **lastZoomBuffer; /**<The last node in a linked list of leaf nodes*/
     uint64_t *nNodes; /**<The number of leaf nodes per zoom level, useful for determining duplicate levels*/
     uLongf compressPsz; /**<The size of the compression buffer*/
     void *compressP; /**<A compressed buffer of size compressPsz*/
+    int compressLevel; /**<The zlib compression level used for blocks (see `bwSetCompressionLevel()`)*/
+    int adaptiveType; /**<If not 0, blocks of entries added with `bwAddIntervals()` are stored as the most compact type that can hold them (see `bwSetAdaptiveBlockType()`)*/
+    int merge; /**<If not 0, adjacent entries added with `bwAddIntervals()` with close enough values are merged (see `bwSetMergeIntervals()`)*/
+    float mergeTol; /**<The largest difference between the values of merged entries*/
+    float mergeQuantum; /**<If > 0, values are rounded to a multiple of this before being merged*/
+    int mergeRun; /**<If not 0, runTid, runStart, runEnd, runMin, runMax and runSum describe entries that have been merged but not yet added to the buffer*/
+    uint32_t runTid; /**<The TID of the merged entries*/
+    uint32_t runStart; /**<The start of the merged entries*/
+    uint32_t runEnd; /**<The end of the merged entries*/
+    float runMin; /**<The smallest value of the merged entries*/
+    float runMax; /**<The largest value of the merged entries*/
+    double runSum; /**<The sum of the values of the merged entries, each multiplied by its width*/
+    int zoomState; /**<How the zoom levels are being made: 0, entries are held in zoomSample until the zoom sizes can be chosen; 1, entries are added to the zoom levels as they're written; 2, the zoom levels are made by re-reading the file when it's finalized*/
+    uint32_t zoomTid; /**<The TID of the last entry added to the zoom levels*/
+    double *zoomSum; /**<The running sum of the last zoom record in each level*/
+    double *zoomSumsq; /**<The running sum of squares of the last zoom record in each level*/
+    bwZoomEntry_t *zoomSample; /**<The entries held while zoomState is 0*/
+    uint32_t nZoomSample; /**<The number of entries in zoomSample*/
+    uint32_t mZoomSample; /**<The number of entries zoomSample can hold*/
+    struct bwWritePool_t *pool; /**<If not NULL, the threads that compress and write blocks (see `bwSetCompressionThreads()`)*/
+    FILE *zoomSpill; /**<If not NULL, a temporary file that completed zoom buffers are moved to (see `bwSetZoomSpill()`)*/
+    uint64_t zoomSpillSz; /**<The number of bytes written to zoomSpill*/
+    FILE *sink; /**<If not NULL, where the file is copied to once it's finished, since it's written to a temporary file instead (see `bwSetStreamOutput()`)*/
 } bwWriteBuffer_t;
 
+/// @cond SKIP
+/*!
+ * @brief State shared between a bigWigFile_t and its clones.
+ */
+typedef struct {
+    int refCount; /**<The number of open handles sharing the header, chromosome list and index. This is modified atomically.*/
+    void (*ioClose)(void*); /**<For user-supplied I/O backends, the close callback, which is called when the last handle is closed.*/
+    void *ioCtx; /**<The context to give to ioClose.*/
+} bwShared_t;
+/// @endcond
+
 /*!
  * @brief A structure that holds everything needed to access a bigWig file.
  */
@@ -215,6 +307,7 @@ typedef struct {
     bwWriteBuffer_t *writeBuffer; /**<The buffer used for writing.*/
     int isWrite; /**<0: Opened for reading, 1: Opened for writing.*/
     int type; /**<0: bigWig, 1: bigBed.*/
+    bwShared_t *shared; /**<Set if hdr, cl and idx are shared with clones (see `bwClone()`), otherwise NULL.*/
 } bigWigFile_t;
 
 /*!
@@ -295,7 +388,7 @@ int bbIsBigBed(const char *fname, CURLcode (*callBack)(CURL*));
  * This will open a local or remote bigWig file. Writing of local bigWig files is also supported.
  * @param fname The file name or URL (http, https, and ftp are supported)
  * @param callBack An optional user-supplied function. This is applied to remote connections so users can specify things like proxy and password information. See `test/testRemote` for an example.
- * @param mode The mode, by default "r". Both local and remote files can be read, but only local files can be written. For files being written the callback function is ignored. If and only if the mode contains "w" will the file be opened for writing (in all other cases the file will be opened for reading.
+ * @param mode The mode, by default "r". Both local and remote files can be read, but only local files can be written. For files being written the callback function is ignored. If and only if the mode contains "w" will the file be opened for writing (in all other cases the file will be opened for reading. If a file being read is opened with a mode containing "l" (e.g., "rl"), then the chromosome list is loaded lazily: chromosomes are looked up in the file as they're needed rather than all being read when the file is opened. This is much faster for files with very many contigs. In that case, use `bwGetChrom()` and `bwGetChromLen()` rather than `fp->cl` directly.
  * @return A bigWigFile_t * on success and NULL on error.
  */
 bigWigFile_t *bwOpen(const char *fname, CURLcode (*callBack)(CURL*), const char* mode);
@@ -309,6 +402,72 @@ bigWigFile_t *bwOpen(const char *fname, CURLcode (*callBack)(CURL*), const char*
  */
 bigWigFile_t *bbOpen(const char *fname, CURLcode (*callBack)(CURL*));
 
+/*!
+ * @brief Opens a bigWig file that's already held in memory.
+ * This is equivalent to `bwOpen()`, except that the file contents are read from `buf` rather than a local or remote file. The buffer is NOT copied, so it must remain valid and unmodified until `bwClose()` is called (which will not free it).
+ * @param buf The buffer holding the complete bigWig file.
+ * @param len The length of buf in bytes.
+ * @return A bigWigFile_t * on success and NULL on error.
+ */
+bigWigFile_t *bwOpenBuffer(const void *buf, size_t len);
+
+/*!
+ * @brief Opens a bigBed file that's already held in memory.
+ * This is equivalent to `bbOpen()`, except that the file contents are read from `buf` rather than a local or remote file. The buffer is NOT copied, so it must remain valid and unmodified until `bwClose()` is called (which will not free it).
+ * @param buf The buffer holding the complete bigBed file.
+ * @param len The length of buf in bytes.
+ * @return A bigWigFile_t * on success and NULL on error.
+ */
+bigWigFile_t *bbOpenBuffer(const void *buf, size_t len);
+
+/*!
+ * @brief Opens a bigWig file through a user-supplied I/O backend.
+ * This is equivalent to `bwOpen()`, except that all reads go through the callbacks in `io`. This can be used to access files in object stores, add a caching layer, or simulate slow connections in tests. The file is read-only.
+ * @param io The I/O backend. Only the `read` callback is required. The structure is copied, but `io->ctx` must remain valid until `bwClose()` is called, which will call `io->close()` if it's defined. `io->close()` is also called if this function fails.
+ * @return A bigWigFile_t * on success and NULL on error.
+ */
+bigWigFile_t *bwOpenIO(const bwIO_t *io);
+
+/*!
+ * @brief Opens a bigBed file through a user-supplied I/O backend.
+ * This is equivalent to `bbOpen()`, except that all reads go through the callbacks in `io`.
+ * @param io The I/O backend. See `bwOpenIO()` for details.
+ * @return A bigWigFile_t * on success and NULL on error.
+ * @see bwOpenIO
+ */
+bigWigFile_t *bbOpenIO(const bwIO_t *io);
+
+/*!
+ * @brief Set up an io_uring based I/O backend for a local file (Linux only).
+ * Batched block reads (see `bwIO_t`) are all submitted at once, with up to `queueDepth` of them in flight and completing in any order. This is mostly useful for many small queries against files on fast local storage. Pass the result to `bwOpenIO()` or `bbOpenIO()`.
+ * @note The backend is thread-safe, so it may be shared by a handle and its clones (see `bwClone()`) that are used on different threads, as in `bwStatsParallel()`. Each batch of reads takes an idle ring, creating one if needed, so there's at most one ring per thread reading at the same time.
+ * @param io Where the backend will be stored.
+ * @param fname The local file to open.
+ * @param queueDepth The maximum number of reads in flight. 0 uses a default of 64.
+ * @return 0 on success. Anything else means that io_uring isn't available or that the file can't be opened, in which case you can simply use `bwOpen()` instead: 1 with `errno` set to `ENOSYS` if libBigWig was built without `WITH_IOURING`, 2 if the file can't be opened and 3 if the kernel doesn't support or allow io_uring. In the last two cases `errno` is left as set by the call that failed.
+ */
+int bwIOUringInit(bwIO_t *io, const char *fname, uint32_t queueDepth);
+
+/*!
+ * @brief Creates a new handle to an open bigWig or bigBed file.
+ * The clone has its own connection to the file (and so its own file position and buffers), but shares the header, chromosome list and indices with the original. This is much cheaper than opening the file again and is intended for giving each thread its own handle. The original and its clones can be closed in any order with `bwClose()`, the shared parts are freed along with the last of them.
+ * @param fp A bigWigFile_t * opened for reading.
+ * @return A new bigWigFile_t * or NULL on error (including if fp was opened for writing).
+ * @note Local and remote files are reopened using a copy of the file name given to `bwOpen()`/`bbOpen()`. Clones of in-memory files share the buffer and clones of files opened with `bwOpenIO()` share `io->ctx` (whose read callbacks must then be thread-safe if clones are used concurrently).
+ * @note `bwClone()` must not be called concurrently on the same handle.
+ * @note Index nodes, zoom level indices and lazily loaded chromosomes are read in the first time they're needed by any of the handles and then shared, so the original and its clones can be queried from different threads without any locking.
+ */
+bigWigFile_t *bwClone(bigWigFile_t *fp);
+
+/*!
+ * @brief Opens a bigWig file for writing into a growable memory buffer.
+ * This is equivalent to `bwOpen()` with mode "w", except that the output is written to memory rather than to a local file. When `bwClose()` is called, a pointer to the finished file is stored in `*buf` and its length in `*len`. You must then `free()` the buffer.
+ * @param buf Where to store the buffer holding the finished file.
+ * @param len Where to store the length of the finished file.
+ * @return A bigWigFile_t * on success and NULL on error.
+ */
+bigWigFile_t *bwOpenBufferWrite(void **buf, size_t *len);
+
 /*!
  * @brief Returns a string containing the SQL entry (or NULL).
  * The "auto SQL" field contains the names and value types of the entries in
@@ -341,6 +500,26 @@ void bwClose(bigWigFile_t *fp);
  */
 uint32_t bwGetTid(const bigWigFile_t *fp, const char *chrom);
 
+/*!
+ * @brief Converts a chromosome ID to its name
+ *
+ * Unlike accessing `fp->cl->chrom[tid]` directly, this also works for files whose chromosome lists are loaded lazily.
+ * @param fp A valid bigWigFile_t pointer
+ * @param tid A chromosome ID
+ * @return The chromosome name, or NULL on error. This must not be freed and remains valid until `bwClose()` is called.
+ */
+const char *bwGetChrom(bigWigFile_t *fp, uint32_t tid);
+
+/*!
+ * @brief Returns the length of a chromosome
+ *
+ * Unlike accessing `fp->cl->len[tid]` directly, this also works for files whose chromosome lists are loaded lazily.
+ * @param fp A valid bigWigFile_t pointer
+ * @param tid A chromosome ID
+ * @return The length, which is 0 on error.
+ */
+uint32_t bwGetChromLen(bigWigFile_t *fp, uint32_t tid);
+
 /*!
  * @brief Frees space allocated by `bwGetOverlappingIntervals`
  * @param o A valid `bwOverlappingIntervals_t` pointer.
@@ -447,6 +626,14 @@ void bwIteratorDestroy(bwOverlapIterator_t *iter);
  */
 bwOverlappingIntervals_t *bwGetValues(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, int includeNA);
 
+/*!
+ * @brief Load the full data index and all zoom level indices into compact in-memory arrays.
+ * By default, index nodes are read from the file as they're first needed and then searched as a tree. After this is called, the leaves of every index are instead held in per-chromosome sorted arrays (in Eytzinger order), which makes subsequent overlap searches (e.g., by `bwGetOverlappingIntervals()`, `bbGetOverlappingEntries()` and `bwStats()`) faster and more cache-friendly. This is worthwhile if you intend to make many queries against the same file. The memory is released by `bwClose()`.
+ * @param fp A valid bigWigFile_t pointer, opened for reading.
+ * @return 0 on success and another value on error.
+ */
+int bwFlattenIndex(bigWigFile_t *fp);
+
 /*!
  * @brief Determines per-interval bigWig statistics
  * Can determine mean/min/max/coverage/standard deviation of values in one or more intervals in a bigWig file. You can optionally give it an interval and ask for values from X number of sub-intervals.
@@ -475,11 +662,113 @@ double *bwStats(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t en
 */
 double *bwStatsFromFull(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, uint32_t nBins, enum bwStatsType type);
 
+/*!
+ * @brief Determines per-interval bigWig statistics from full resolution data, using zoom levels where that gives the same result
+ * This gives the same results as `bwStatsFromFull()`, but is typically nearly as fast as `bwStats()` for large bins. Zoom level records that lie entirely within a bin are used as is, while only the parts of the bin covered by records extending past its edges are read from the full resolution data.
+ * @param fp The file from which to extract statistics.
+ * @param chrom A valid chromosome name.
+ * @param start The start position of the interval. This is 0-based half open, so 0 is the first base.
+ * @param end The end position of the interval. Again, this is 0-based half open, so 100 will include the 100th base...which is at position 99.
+ * @param nBins The number of bins within the interval to calculate statistics for.
+ * @param type The type of statistic.
+ * @see bwStatsType
+ * @return A pointer to an array of double precission floating point values that must be free()d, or NULL on error.
+ * @note Zoom levels store sums and sums of squares in single precision, so means, sums and standard deviations may differ from those of `bwStatsFromFull()` by rounding. The other statistics are identical.
+ * @note Earlier versions of this library wrote zoom records without sums at the end of each zoom block. In files written by them, such records are read from the full resolution data instead.
+ */
+double *bwStatsExact(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, uint32_t nBins, enum bwStatsType type);
+
+/*!
+ * @brief Determines per-interval bigWig statistics using several threads
+ * This gives exactly the same results as `bwStats()`, but splits the bins into contiguous chunks that are processed at the same time, each with its own handle from `bwClone()`. This is mostly useful for requests with many bins (e.g., genome-wide profiles).
+ * @param fp The file from which to extract statistics. This isn't used by any other thread during the call, but clones of it may be.
+ * @param chrom A valid chromosome name.
+ * @param start The start position of the interval. This is 0-based half open, so 0 is the first base.
+ * @param end The end position of the interval. Again, this is 0-based half open, so 100 will include the 100th base...which is at position 99.
+ * @param nBins The number of bins within the interval to calculate statistics for.
+ * @param type The type of statistic.
+ * @param nThreads The number of threads to use, including the calling thread. If this is 0 or less, then one per online CPU is used. No more than one thread per bin is ever used.
+ * @see bwStatsType
+ * @return A pointer to an array of double precission floating point values that must be free()d, or NULL on error.
+ * @note If `fp` was opened with `bwOpenIO()` then its backend is shared by all of the threads, so its callbacks must be thread-safe. That's the case for backends from `bwIOUringInit()`.
+ */
+double *bwStatsParallel(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, uint32_t nBins, enum bwStatsType type, int nThreads);
+
+/*!
+ * @brief Determines quantiles of the per-base values in one or more intervals
+ * Each base covered by an entry counts once, so an entry spanning 100 bases has 100 times the weight of one spanning a single base. Quantiles are interpolated linearly between the two closest ranks (i.e., the 0.5 quantile of 1, 2, 3 and 4 is 2.5). Only the values from one bin are held in memory at a time.
+ * @param fp The file from which to extract quantiles.
+ * @param chrom A valid chromosome name.
+ * @param start The start position of the interval. This is 0-based half open, so 0 is the first base.
+ * @param end The end position of the interval. Again, this is 0-based half open, so 100 will include the 100th base...which is at position 99.
+ * @param nBins The number of bins within the interval to calculate quantiles for.
+ * @param quantiles The quantiles to compute, each of which must be between 0 and 1.
+ * @param nQuantiles The number of quantiles.
+ * @param approximate If 0, the exact quantiles are found by selection, which requires memory proportional to the number of entries in a bin. Otherwise, a fixed size sketch is used whose results are within roughly 1% (relative) of the exact values, which is faster for very large bins.
+ * @return An array of nBins*nQuantiles values that must be free()d, holding the quantiles of the first bin, then those of the second bin, and so on. Bins without any entries have NaN values. NULL is returned on error.
+ */
+double *bwQuantiles(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, uint32_t nBins, const double *quantiles, uint32_t nQuantiles, int approximate);
+
+/*!
+ * @brief Determines base-weighted histograms of the values in one or more intervals
+ * Each base covered by an entry adds 1 to the count of the bucket holding its value, so an entry spanning 100 bases adds 100. The entries are counted as their blocks are decompressed, so the memory needed only depends on the number of bins and buckets.
+ * @param fp The file from which to extract histograms.
+ * @param chrom A valid chromosome name.
+ * @param start The start position of the interval. This is 0-based half open, so 0 is the first base.
+ * @param end The end position of the interval. Again, this is 0-based half open, so 100 will include the 100th base...which is at position 99.
+ * @param nBins The number of bins within the interval to calculate histograms for.
+ * @param edges The nEdges edges of the nEdges-1 histogram buckets, in strictly increasing order. Bucket i holds values in [edges[i], edges[i+1]), except the last bucket, which also holds values equal to the last edge. Values outside of every bucket aren't counted. See `bwLogSpacedEdges()`.
+ * @param nEdges The number of edges, which must be at least 2.
+ * @return An array of nBins*(nEdges-1) counts that must be free()d, holding the histogram of the first bin, then that of the second bin, and so on. NULL is returned on error.
+ */
+double *bwHistogram(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, uint32_t nBins, const double *edges, uint32_t nEdges);
+
+/*!
+ * @brief Creates logarithmically spaced histogram bucket edges, for use with `bwHistogram()`
+ * @param lo The first edge, which must be positive.
+ * @param hi The last edge, which must be larger than lo.
+ * @param nEdges The number of edges, which must be at least 2.
+ * @return An array of nEdges edges that must be free()d, or NULL on error.
+ */
+double *bwLogSpacedEdges(double lo, double hi, uint32_t nEdges);
+
+/*!
+ * @brief Determines summary statistics for every chromosome at once
+ * This reads the coarsest zoom level once from start to end, rather than querying each chromosome separately. Zoom records hold exact per-base counts, minima and maxima, so the only difference from the full resolution data is that sums are stored in single precision. The full resolution data is only read for files without zoom levels and for the records without sums that earlier versions of this library wrote at the end of each zoom block. For a summary of the whole file, see the nBasesCovered, minVal, maxVal, sumData and sumSquared members of bigWigHdr_t.
+ * @param fp A bigWig file opened for reading.
+ * @return An array holding a summary for each chromosome, in the same order as `fp->cl`, that must be free()d. NULL is returned on error.
+ */
+bwChromSummary_t *bwChromSummaries(bigWigFile_t *fp);
+
+/*!
+ * @brief Computes per-chromosome prefix sums over every record in a bigWig file.
+ * After this, `bwStats()` answers `mean`, `coverage` and `sum` queries from these in constant time per bin, regardless of the interval size. The results are computed from the full resolution data (as with `bwStatsFromFull()`) rather than from zoom levels, so they're exact up to floating point rounding. Other statistics are unaffected. This requires reading the entire file once (a few blocks at a time, so nothing beyond the prefix sums is held in memory), so use `bwWritePrefixSums()` and `bwReadPrefixSums()` to avoid doing so repeatedly. The prefix sums are shared with clones (see `bwClone()`) and freed by `bwClose()`.
+ * @param fp A bigWig file opened for reading.
+ * @return 0 on success. On error (e.g., if fp is a bigBed file or has overlapping entries), the prefix sums aren't used and another value is returned.
+ */
+int bwCreatePrefixSums(bigWigFile_t *fp);
+
+/*!
+ * @brief Saves the prefix sums created by `bwCreatePrefixSums()` to a compressed file.
+ * @param fp A bigWig file with prefix sums.
+ * @param fname The output file name.
+ * @return 0 on success.
+ */
+int bwWritePrefixSums(bigWigFile_t *fp, const char *fname);
+
+/*!
+ * @brief Loads prefix sums previously saved by `bwWritePrefixSums()`, as an alternative to `bwCreatePrefixSums()`.
+ * @param fp The bigWig file from which the prefix sums were created, opened for reading.
+ * @param fname The file to read.
+ * @return 0 on success. An error is returned if the file wasn't created from a file with the same layout as fp.
+ */
+int bwReadPrefixSums(bigWigFile_t *fp, const char *fname);
+
 //Writer functions
 
 /*!
  * @brief Create a largely empty bigWig header
- * Every bigWig file has a header, this creates the template for one. It also takes care of space allocation in the output write buffer.
+ * Every bigWig file has a header, this creates the template for one. It also takes care of space allocation in the output write buffer. The block size, index node size and compression level can then be changed with `bwSetBufSize()`, `bwSetBlockSize()` and `bwSetCompressionLevel()`.
  * @param fp The bigWigFile_t* that you want to write to.
  * @param maxZooms The maximum number of zoom levels. If you specify 0 then there will be no zoom levels. A value <0 or > 65535 will result in a maximum of 10.
  * @return 0 on success.
@@ -505,6 +794,98 @@ chromList_t *bwCreateChromList(const char* const* chroms, const uint32_t *length
  */
 int bwWriteHdr(bigWigFile_t *bw);
 
+/*!
+ * @brief Set the size of the blocks that entries are written in.
+ * Each block of entries (and each block of zoom level records) is compressed and read as a unit. Smaller blocks mean fewer bytes need to be read and decompressed to answer a query over a small region, at the cost of a larger index and poorer compression. The default is 32768 bytes, which holds around 2700 entries added with `bwAddIntervals()` or 1024 zoom level records. This must be run after `bwCreateHdr()` but before `bwWriteHdr()`, `bwSetCompressionThreads()` and `bwSetZoomLevels()`, which all allocate buffers of this size.
+ * @param fp The output file pointer.
+ * @param bufSize The uncompressed size of a block in bytes. This must be between 64, enough for a zoom level record, and 262164, which holds 65535 entries added with `bwAddIntervalSpanSteps()`.
+ * @return 0 on success and another value on error.
+ * @see bwCreateHdr
+ */
+int bwSetBufSize(bigWigFile_t *fp, uint32_t bufSize);
+
+/*!
+ * @brief Set the maximum number of children of each node in the indices of a bigWig file.
+ * The default is 64. Larger values make for shallower trees, with larger nodes. This must be run after `bwCreateHdr()` but before `bwWriteHdr()`.
+ * @param fp The output file pointer.
+ * @param blockSize The maximum number of children per node, between 2 and 65535.
+ * @return 0 on success and another value on error.
+ * @see bwCreateHdr
+ */
+int bwSetBlockSize(bigWigFile_t *fp, uint32_t blockSize);
+
+/*!
+ * @brief Set the zlib compression level used when writing a bigWig file.
+ * Lower levels are faster to write and higher ones make smaller files. Reading is largely unaffected. The default is zlib's own (`Z_DEFAULT_COMPRESSION`, currently equivalent to 6). This must be run after `bwCreateHdr()` but before `bwWriteHdr()`.
+ * @param fp The output file pointer.
+ * @param level A level from 0 (stored without compression) to 9, or `Z_DEFAULT_COMPRESSION`.
+ * @return 0 on success and another value on error.
+ * @see bwCreateHdr
+ */
+int bwSetCompressionLevel(bigWigFile_t *fp, int level);
+
+/*!
+ * @brief Store bedGraph-style entries as fixed span or fixed step entries where possible when writing a bigWig file.
+ * Entries added with `bwAddIntervals()` and `bwAppendIntervals()` take 12 bytes each. With this set, each block of them is checked when it's written: if every entry has the same width it's stored as if added with `bwAddIntervalSpans()` (8 bytes each) and if the entries are also evenly spaced as if added with `bwAddIntervalSpanSteps()` (4 bytes each). The entries read back are the same either way. This is off by default and applies to blocks written after it's set.
+ * @param fp The output file pointer.
+ * @param adaptive 1 to choose the type of each block, 0 to store entries as they were added.
+ * @return 0 on success and another value on error.
+ * @see bwCreateHdr
+ */
+int bwSetAdaptiveBlockType(bigWigFile_t *fp, int adaptive);
+
+/*!
+ * @brief Merge adjacent entries with equal or similar values when writing a bigWig file.
+ * Coverage is often produced per base or per bin, with long runs of the same value. With this set, entries added with `bwAddIntervals()` and `bwAppendIntervals()` that start where the previous one ended, on the same chromosome, are merged into a single entry as long as the values in the run differ by no more than `tolerance`. A merged entry holds the mean of the values it replaces, weighted by their widths (or the value itself, if they're all the same), so every value in it is within `tolerance` of the value stored. Summary statistics and zoom levels are computed from the merged entries. This is off by default. Any run being merged when this is called is written out first.
+ * @param fp The output file pointer.
+ * @param tolerance The largest difference between the values in a run. 0 merges only equal values and a negative value turns merging off.
+ * @param quantum If greater than 0, each value is first rounded to the nearest multiple of this, so that, for example, 0.01 merges entries whose values agree to two decimal places. Stored values are then rounded too.
+ * @return 0 on success and another value on error.
+ * @see bwCreateHdr
+ */
+int bwSetMergeIntervals(bigWigFile_t *fp, float tolerance, float quantum);
+
+/*!
+ * @brief Specify the zoom level sizes to use when writing a bigWig file.
+ * Zoom levels are built up as entries are added. By default, their sizes are chosen from the mean width of the first entries (or of all of them, for smaller files), which requires holding those entries in memory. Setting them here avoids that. This must be run after `bwCreateHdr()`, `bwCreateChromList()` and any `bwSetBufSize()` call, but before any entries are added.
+ * @param fp The output file pointer.
+ * @param sizes The size of each zoom level in bases. These must be increasing.
+ * @param n The number of zoom levels, which can't be more than the maximum given to `bwCreateHdr()`. Levels that would be identical to the previous one are omitted from the file.
+ * @return 0 on success and another value on error.
+ * @see bwCreateHdr
+ */
+int bwSetZoomLevels(bigWigFile_t *fp, const uint32_t *sizes, uint16_t n);
+
+/*!
+ * @brief Keep zoom level data in a temporary file rather than in memory when writing a bigWig file.
+ * Zoom level records are otherwise held in memory until the file is closed, which for large files with fine zoom levels can take a lot of memory. With this set, each block of records is moved to a temporary file as soon as it's filled, so only the block being filled in each level is kept in memory. This must be run after `bwCreateHdr()` but before any entries are added.
+ * @param fp The output file pointer.
+ * @param dir The directory to create the temporary file in. If this is NULL, then `tmpfile()` is used. The file is deleted automatically.
+ * @return 0 on success and another value on error.
+ * @see bwCreateHdr
+ */
+int bwSetZoomSpill(bigWigFile_t *fp, const char *dir);
+
+/*!
+ * @brief Write a bigWig file strictly sequentially, so that it can be sent to a pipe or other output that can't be seeked.
+ * Writing a bigWig file normally involves going back to fill in the header, offsets and block counts once they're known. With this set, the file is instead written to a temporary file and then copied, from start to end, to the output opened by `bwOpen()` when it's finalized. Nothing is written to the output before then, and the output is never seeked or read. This must be run after `bwCreateHdr()` but before `bwWriteHdr()`.
+ * @param fp The output file pointer.
+ * @param dir The directory to create the temporary file in. If this is NULL, then `tmpfile()` is used. The file is deleted automatically and needs room for the entire bigWig file.
+ * @return 0 on success and another value on error.
+ * @see bwCreateHdr
+ */
+int bwSetStreamOutput(bigWigFile_t *fp, const char *dir);
+
+/*!
+ * @brief Compress blocks on several threads when writing a bigWig file.
+ * Filled data and zoom blocks are compressed by a pool of threads and written to the file, in order, by another thread, so adding entries can continue in the meantime. The output is identical to that produced without threads. This must be run after `bwCreateHdr()`.
+ * @param fp The output file pointer.
+ * @param nThreads The number of compression threads. A value of 1 compresses blocks on the calling thread, which is the default, while a value <= 0 uses one thread per online processor.
+ * @return 0 on success and another value on error.
+ * @see bwCreateHdr
+ */
+int bwSetCompressionThreads(bigWigFile_t *fp, int nThreads);
+
 /*!
  * @brief Write a new block of bedGraph-like intervals to a bigWig file
  * Adds entries of the form:
@@ -599,6 +980,33 @@ int bwAddIntervalSpanSteps(bigWigFile_t *fp, const char *chrom, uint32_t start,
  */
 int bwAppendIntervalSpanSteps(bigWigFile_t *fp, const float *values, uint32_t n);
 
+/*******************************************************************************
+*
+* The following are in bwText.c
+*
+*******************************************************************************/
+
+/*!
+ * @brief Add the entries in a bedGraph file.
+ * The input is read in large chunks and each line is added as with `bwAddIntervals()` and `bwAppendIntervals()`, so entries must be sorted and the chromosomes must already be in `fp->cl`. Empty lines, comments and track and browser lines are skipped. Chunks can be parsed on several threads, in which case they're still added in the order they were read.
+ * @param fp The output file pointer, after `bwWriteHdr()` has been called.
+ * @param in The input, which is read to its end.
+ * @param nThreads The number of threads to parse the input with. 1 parses it on the calling thread, while 0 or less uses one thread per processor.
+ * @return 0 on success and another value on error. The line that couldn't be parsed is printed to stderr.
+ * @see bwAddWiggle
+ */
+int bwAddBedGraph(bigWigFile_t *fp, FILE *in, int nThreads);
+
+/*!
+ * @brief Add the entries in a wiggle file.
+ * Each variableStep section is added with `bwAddIntervalSpans()` and `bwAppendIntervalSpans()` and each fixedStep section with `bwAddIntervalSpanSteps()` and `bwAppendIntervalSpanSteps()`. Positions in the input are 1-based, as in the wiggle format. Empty lines, comments and track and browser lines are skipped.
+ * @param fp The output file pointer, after `bwWriteHdr()` has been called.
+ * @param in The input, which is read to its end.
+ * @return 0 on success and another value on error. The line that couldn't be parsed is printed to stderr.
+ * @see bwAddBedGraph
+ */
+int bwAddWiggle(bigWigFile_t *fp, FILE *in);
+
 #ifdef __cplusplus
 }
 #endif
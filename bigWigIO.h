@@ -13,6 +13,7 @@ typedef void CURL;
 #define CURLE_OK 0
 #define CURLE_FAILED_INIT 1
 #endif
+#include <stdint.h>
 /*! \file bigWigIO.h
  * These are (typically internal) IO functions, so there's generally no need for you to directly use them!
  */
@@ -29,9 +30,41 @@ enum bigWigFile_type_enum {
     BWG_FILE = 0,
     BWG_HTTP = 1,
     BWG_HTTPS = 2,
-    BWG_FTP = 3
+    BWG_FTP = 3,
+    BWG_MEM = 4,
+    BWG_CUSTOM = 5
 };
 
+/*!
+ * @brief A user-supplied I/O backend (e.g., an object store client, a caching layer or a simulated slow connection).
+ *
+ * Only `read` is required, everything else may be NULL. The callbacks must not depend on any shared file position, since every read comes with an explicit offset. Files opened this way are read-only.
+ * @see bwOpenIO
+ * @see bbOpenIO
+ */
+typedef struct bwIO_t {
+    void *ctx; /**<An opaque pointer handed to each of the callbacks.*/
+    /*!
+     * @brief Read up to `len` bytes starting at `offset` into `buf`.
+     * @return The number of bytes read, which must be `len` unless the end of the file was reached or an error occurred.
+     */
+    size_t (*read)(void *ctx, void *buf, size_t len, uint64_t offset);
+    /*!
+     * @brief Return the total size of the file in bytes. This is called once, when the file is opened (and again for each clone). If NULL, seeks past the end of the file can't be detected early.
+     */
+    uint64_t (*size)(void *ctx);
+    /*!
+     * @brief Release ctx. This is called exactly once, by `bwClose()` (or by the open function on error).
+     */
+    void (*close)(void *ctx);
+    /*!
+     * @brief Optionally read `n` independent regions at once.
+     * Region `i` is `lens[i]` bytes at `offsets[i]`, to be stored in `bufs[i]`. The regions may be fetched concurrently and complete in any order, but this must not return until all of them are done. If NULL, the regions are read one after the other with `read`.
+     * @return 0 on success, anything else on error.
+     */
+    int (*readBatch)(void *ctx, size_t n, void **bufs, const size_t *lens, const uint64_t *offsets);
+} bwIO_t;
+
 /*!
  * @brief This structure holds the file pointers and buffers needed for raw access to local and remote files.
  */
@@ -46,10 +79,14 @@ typedef struct {
     size_t filePos; /**<Current position inside the file.*/
     size_t bufPos; /**<Curent position inside the buffer.*/
     size_t bufSize; /**<The size of the buffer.*/
-    size_t bufLen; /**<The actual size of the buffer used.*/
+    size_t bufLen; /**<The actual size of the buffer used. For user-supplied I/O backends, the size of the file (or (size_t) -1 if the backend can't tell).*/
     enum bigWigFile_type_enum type; /**<The connection type*/
     int isCompressed; /**<1 if the file is compressed, otherwise 0*/
-    const char *fname; /**<Only needed for remote connections. The original URL/filename requested, since we need to make multiple connections.*/
+    char *fname; /**<A copy of the URL/filename given to urlOpen(), since remote files need multiple connections and clones (see bwClone()) reopen the file. NULL for in-memory files and user-supplied I/O.*/
+    void **memOut; /**<Only for in-memory files opened for writing. Where the final buffer is stored by urlClose().*/
+    size_t *memOutLen; /**<Only for in-memory files opened for writing. Where the final buffer length is stored by urlClose().*/
+    bwIO_t io; /**<Only for user-supplied I/O backends, a copy of the callbacks.*/
+    CURLcode (*callBack)(CURL*); /**<The callback given to urlOpen(), kept so the file can be reopened.*/
 } URL_t;
 
 /*!
@@ -96,6 +133,69 @@ CURLcode urlSeek(URL_t *URL, size_t pos);
  */
 URL_t *urlOpen(const char *fname, CURLcode (*callBack)(CURL*), const char* mode);
 
+/*!
+ *  @brief Open an in-memory buffer for reading
+ *
+ *  The buffer is used as-is and is NOT copied, so it must remain valid (and unchanged) until urlClose() is called. urlClose() will not free it.
+ *
+ * @param buf The buffer holding the file contents.
+ * @param len The length of buf in bytes.
+ *
+ *  @return A URL_t * or NULL on error.
+ */
+URL_t *urlOpenBuffer(const void *buf, size_t len);
+
+/*!
+ *  @brief Open a growable in-memory buffer for writing (and reading back)
+ *
+ *  The buffer is allocated and resized internally. When urlClose() is called, a pointer to it is stored in `*buf` and its length in `*len`. The caller is then responsible for calling free() on it.
+ *
+ * @param buf Where the final buffer will be stored.
+ * @param len Where the final length of the buffer will be stored.
+ *
+ *  @return A URL_t * or NULL on error.
+ */
+URL_t *urlOpenBufferWrite(void **buf, size_t *len);
+
+/*!
+ *  @brief Open a file through a user-supplied I/O backend
+ *
+ *  The callbacks in io are copied, so io itself needn't outlive this call (io->ctx must, of course). Such files are read-only.
+ *
+ * @param io The I/O backend, which must at least define a read callback.
+ *
+ *  @return A URL_t * or NULL on error. On error io->close() is NOT called.
+ */
+URL_t *urlOpenIO(const bwIO_t *io);
+
+/*!
+ *  @brief Read a number of independent regions of a file.
+ *
+ *  Region i is lens[i] bytes starting at offsets[i] and is stored in bufs[i]. If the backend supports batched reads then all of the regions are requested at once. Otherwise, regions are read in order, with regions that are adjacent both in the file and in memory merged into a single read.
+ *
+ *  @param URL A URL_t * pointing to a valid opened file or remote URL.
+ *  @param n The number of regions.
+ *  @param bufs The destination of each region.
+ *  @param lens The length of each region.
+ *  @param offsets The file offset of each region.
+ *
+ *  @return 0 on success, anything else on error. The file position afterward is undefined.
+ */
+int urlReadBatch(URL_t *URL, size_t n, void **bufs, const size_t *lens, const uint64_t *offsets);
+
+/*!
+ *  @brief Writes data from the given buffer.
+ *
+ *  This is only supported for local files and in-memory buffers opened for writing.
+ *
+ *  @param URL A URL_t * pointing to a file opened for writing.
+ *  @param buf The data to write.
+ *  @param bufSize The number of bytes to write.
+ *
+ *  @return Returns the number of bytes written, which should be bufSize on success and something else on error.
+ */
+size_t urlWrite(URL_t *URL, const void *buf, size_t bufSize);
+
 /*!
  *  @brief Close a local/remote file
  *
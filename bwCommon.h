@@ -26,6 +26,18 @@ int bwSetPos(bigWigFile_t *fp, size_t pos);
  */
 size_t bwRead(void *data, size_t sz, size_t nmemb, bigWigFile_t *fp);
 
+/*!
+ * @brief A local/in-memory version of `fwrite`.
+ * Writes data to a local or in-memory bigWig file opened for writing.
+ * @param data The data to write.
+ * @param sz The size of each member that should be written.
+ * @param nmemb The number of members to write.
+ * @param fp The bigWigFile_t * to which the data should be written.
+ * @see bwRead
+ * @return The number of members fully written (this is equivalent to `fwrite`).
+ */
+size_t bwWrite(const void *data, size_t sz, size_t nmemb, bigWigFile_t *fp);
+
 /*!
  * @brief Determine what the file position indicator say.
  * This is equivalent to `ftell` for local or remote files.
@@ -56,11 +68,68 @@ void bwDestroyIndexNode(bwRTreeNode_t *node);
  */
 void bwDestroyIndex(bwRTree_t *idx);
 
+/*!
+ * @brief Returns the index for a zoom level, reading it in if that hasn't been done yet.
+ * This is safe to call from multiple threads sharing a file (or its clones).
+ * @param fp A valid bigWigFile_t pointer
+ * @param level The zoom level
+ * @return The index, which is freed when the file is closed, or NULL on error.
+ */
+bwRTree_t *bwGetZoomIndex(bigWigFile_t *fp, uint16_t level);
+
+/*!
+ * @brief Frees prefix sums created by `bwCreatePrefixSums()` or `bwReadPrefixSums()`.
+ * @param ps The prefix sums, which may be NULL.
+ */
+void bwDestroyPrefixSums(bwPrefixSums_t *ps);
+
+/*!
+ * @brief A function called on each entry decoded by `bwVisitOverlappingValues()`.
+ * @param start The start position of the entry (0-based).
+ * @param end The end position of the entry (1-based).
+ * @param value The value of the entry.
+ * @param data The pointer given to `bwVisitOverlappingValues()`.
+ * @return 0 to continue, anything else to stop with an error.
+ */
+typedef int (*bwValueVisitor_t)(uint32_t start, uint32_t end, float value, void *data);
+
+/*!
+ * @brief Calls a function on every entry in a bigWig file overlapping an interval, as the blocks holding them are decompressed.
+ * Unlike `bwGetOverlappingIntervals()`, the entries are never stored, so this takes the same memory regardless of the interval size. Entries are not clipped to the interval.
+ * @param fp A valid opened bigWigFile_t.
+ * @param chrom A valid chromosome name.
+ * @param start The start position of the interval (0-based).
+ * @param end The end position of the interval (1-based).
+ * @param visit The function to call on each entry.
+ * @param data Passed as the last argument to visit().
+ * @return 0 on success, or 1 on error (including visit() returning non-zero).
+ */
+int bwVisitOverlappingValues(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, bwValueVisitor_t visit, void *data);
+
 /// @cond SKIP
 bwOverlapBlock_t *walkRTreeNodes(bigWigFile_t *bw, bwRTreeNode_t *root, uint32_t tid, uint32_t start, uint32_t end);
+bwOverlapBlock_t *bwIndexOverlaps(bigWigFile_t *bw, bwRTree_t *idx, uint32_t tid, uint32_t start, uint32_t end);
+bwOverlapBlock_t *bwIndexAllBlocks(bigWigFile_t *fp, bwRTree_t *idx);
 void destroyBWOverlapBlock(bwOverlapBlock_t *b);
 /// @endcond
 
+/*!
+ * The most compressed data that bwReadBlocks() will fetch in a single batch (unless a single block is larger).
+ */
+#define BW_MAX_BATCH_BYTES (1<<22)
+
+/*!
+ * @brief Fetch a batch of consecutive data blocks with a single batched read.
+ * Blocks first, first+1, ... of o are stored back to back in `*buf`, up to BW_MAX_BATCH_BYTES in total (at least one block is always fetched). Block `first+i` is `o->size[first+i]` bytes long and starts where block `first+i-1` ends.
+ * @param fp A valid opened bigWigFile_t.
+ * @param o The blocks to fetch.
+ * @param first The first block to fetch.
+ * @param buf The buffer to store the blocks in, which is (re)allocated as needed.
+ * @param bufSz The current size of `*buf`, which is updated if it's reallocated.
+ * @return The number of blocks fetched, which is 0 on error.
+ */
+uint64_t bwReadBlocks(bigWigFile_t *fp, bwOverlapBlock_t *o, uint64_t first, void **buf, size_t *bufSz);
+
 /*!
  * @brief Finishes what's needed to write a bigWigFile
  * Flushes the buffer, converts the index linked list to a tree, writes that to disk, handles zoom level stuff, writes magic at the end
@@ -69,6 +138,22 @@ void destroyBWOverlapBlock(bwOverlapBlock_t *b);
  */
 int bwFinalize(bigWigFile_t *fp);
 
+/*!
+ * @brief Stop the threads used to compress and write blocks and free everything associated with them.
+ * Any blocks that haven't been written yet are written first.
+ * @param pool The pool to destroy (see `bwSetCompressionThreads()`), which may be NULL.
+ */
+void bwDestroyWritePool(struct bwWritePool_t *pool);
+
 /// @cond SKIP
 char *bwStrdup(const char *s);
 /// @endcond
+
+/*!
+ * @brief bwGetTid() for files whose chromosome lists are loaded lazily.
+ * The chromosome tree is searched on disk and the result cached. If the chromosome isn't found (e.g., because the tree isn't sorted), then the whole chromosome list is loaded.
+ * @param fp A valid bigWigFile_t pointer with fp->cl->tree set.
+ * @param chrom A chromosome name
+ * @return The ID or -1 if it's not found.
+ */
+uint32_t bwLazyGetTid(bigWigFile_t *fp, const char *chrom);
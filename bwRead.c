@@ -4,8 +4,18 @@
 #include <math.h>
 #include <string.h>
 #include <stdio.h>
+#include <sched.h>
 
-static uint64_t readChromBlock(bigWigFile_t *bw, chromList_t *cl, uint32_t keySize);
+//Used while reading in the chromosome list: names are stored back to back in buf and the offset (+1, so 0 means unset) of chromosome i is offset[i]
+//Lengths are held in len until everything has been read
+typedef struct {
+    char *buf;
+    size_t l, m;
+    uint64_t *offset;
+    uint32_t *len;
+} chromArena_t;
+
+static uint64_t readChromBlock(bigWigFile_t *bw, chromList_t *cl, chromArena_t *arena, uint32_t keySize);
 
 //Return the position in the file
 long bwTell(bigWigFile_t *fp) {
@@ -32,6 +42,12 @@ size_t bwRead(void *data, size_t sz, size_t nmemb, bigWigFile_t *fp) {
     return nmemb;
 }
 
+//returns the number of full members written (nmemb on success, something less on error)
+size_t bwWrite(const void *data, size_t sz, size_t nmemb, bigWigFile_t *fp) {
+    if(!sz) return nmemb;
+    return urlWrite(fp->URL, data, sz*nmemb)/sz;
+}
+
 //Initializes curl and sets global variables
 //Returns 0 on success and 1 on error
 //This should be called only once and bwCleanup() must be called when finished.
@@ -118,6 +134,7 @@ static void bwHdrDestroy(bigWigHdr_t *hdr) {
         free(hdr->zoomHdrs->idx);
         free(hdr->zoomHdrs);
     }
+    bwDestroyPrefixSums(hdr->prefixSums);
     free(hdr);
 }
 
@@ -168,22 +185,83 @@ error:
     bw->hdr = NULL;
 }
 
+static void destroyChromTree(bwChromTree_t *tree) {
+    if(!tree) return;
+    free(tree);
+}
+
 static void destroyChromList(chromList_t *cl) {
     uint32_t i;
     if(!cl) return;
     if(cl->nKeys && cl->chrom) {
         for(i=0; i<cl->nKeys; i++) {
-            if(cl->chrom[i]) free(cl->chrom[i]);
+            if(!cl->chrom[i]) continue;
+            if(cl->arena && cl->chrom[i] >= cl->arena && cl->chrom[i] < cl->arena + cl->arenaLen) continue;
+            free(cl->chrom[i]);
         }
     }
     if(cl->chrom) free(cl->chrom);
     if(cl->len) free(cl->len);
+    if(cl->arena) free(cl->arena);
+    destroyChromTree(cl->tree);
     free(cl);
 }
 
-static uint64_t readChromLeaf(bigWigFile_t *bw, chromList_t *cl, uint32_t valueSize) {
+//Lazily loaded lists can be shared between threads, so chromosomes are published with a compare-and-swap once their length has been set
+//If another thread got there first then chrom is left for the caller to free
+//Returns 1 if chrom was published
+static int publishChrom(chromList_t *cl, uint32_t idx, char *chrom, uint32_t len) {
+    char *expected = NULL;
+    __atomic_store_n(&(cl->len[idx]), len, __ATOMIC_RELAXED);
+    return __atomic_compare_exchange_n(&(cl->chrom[idx]), &expected, chrom, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+//Store a chromosome's name and length, unless it's already there
+//key needn't be null terminated
+//Returns 0 on success
+static int setChrom(chromList_t *cl, uint32_t idx, const char *key, uint32_t keySize, uint32_t len) {
+    size_t l;
+    char *chrom;
+    if(idx >= cl->nKeys) return 1;
+    if(__atomic_load_n(&(cl->chrom[idx]), __ATOMIC_ACQUIRE)) return 0;
+    l = strnlen(key, keySize);
+    chrom = malloc(l+1);
+    if(!chrom) return 2;
+    memcpy(chrom, key, l);
+    chrom[l] = '\0';
+    if(!publishChrom(cl, idx, chrom, len)) free(chrom);
+    return 0;
+}
+
+//Append a chromosome name to the arena, unless it's already there
+//key needn't be null terminated
+//Returns 0 on success
+static int arenaAddChrom(chromList_t *cl, chromArena_t *arena, uint32_t idx, const char *key, uint32_t keySize, uint32_t len) {
+    size_t l, m;
+    char *p;
+    if(idx >= cl->nKeys) return 1;
+    if(__atomic_load_n(&(cl->chrom[idx]), __ATOMIC_ACQUIRE) || arena->offset[idx]) return 0; //Either looked up lazily or a duplicate
+
+    l = strnlen(key, keySize);
+    if(arena->l + l + 1 > arena->m) {
+        m = arena->m ? arena->m : 4096;
+        while(m < arena->l + l + 1) m *= 2;
+        p = realloc(arena->buf, m);
+        if(!p) return 2;
+        arena->buf = p;
+        arena->m = m;
+    }
+    memcpy(arena->buf + arena->l, key, l);
+    arena->buf[arena->l + l] = '\0';
+    arena->offset[idx] = arena->l + 1;
+    arena->l += l + 1;
+    arena->len[idx] = len;
+    return 0;
+}
+
+static uint64_t readChromLeaf(bigWigFile_t *bw, chromList_t *cl, chromArena_t *arena, uint32_t valueSize) {
     uint16_t nVals, i;
-    uint32_t idx;
+    uint32_t idx, len;
     char *chrom = NULL;
 
     if(bwRead((void*) &nVals, sizeof(uint16_t), 1, bw) != 1) return -1;
@@ -193,9 +271,8 @@ static uint64_t readChromLeaf(bigWigFile_t *bw, chromList_t *cl, uint32_t valueS
     for(i=0; i<nVals; i++) {
         if(bwRead((void*) chrom, sizeof(char), valueSize, bw) != valueSize) goto error;
         if(bwRead((void*) &idx, sizeof(uint32_t), 1, bw) != 1) goto error;
-        if(bwRead((void*) &(cl->len[idx]), sizeof(uint32_t), 1, bw) != 1) goto error;
-        cl->chrom[idx] = bwStrdup(chrom);
-        if(!(cl->chrom[idx])) goto error;
+        if(bwRead((void*) &len, sizeof(uint32_t), 1, bw) != 1) goto error;
+        if(arenaAddChrom(cl, arena, idx, chrom, valueSize, len)) goto error;
     }
 
     free(chrom);
@@ -206,7 +283,7 @@ error:
     return -1;
 }
 
-static uint64_t readChromNonLeaf(bigWigFile_t *bw, chromList_t *cl, uint32_t keySize) {
+static uint64_t readChromNonLeaf(bigWigFile_t *bw, chromList_t *cl, chromArena_t *arena, uint32_t keySize) {
     uint64_t offset , rv = 0, previous;
     uint16_t nVals, i;
 
@@ -217,30 +294,312 @@ static uint64_t readChromNonLeaf(bigWigFile_t *bw, chromList_t *cl, uint32_t key
         if(bwSetPos(bw, previous)) return -1;
         if(bwRead((void*) &offset, sizeof(uint64_t), 1, bw) != 1) return -1;
         if(bwSetPos(bw, offset)) return -1;
-        rv += readChromBlock(bw, cl, keySize);
+        rv += readChromBlock(bw, cl, arena, keySize);
         previous += 8 + keySize;
     }
 
     return rv;
 }
 
-static uint64_t readChromBlock(bigWigFile_t *bw, chromList_t *cl, uint32_t keySize) {
+static uint64_t readChromBlock(bigWigFile_t *bw, chromList_t *cl, chromArena_t *arena, uint32_t keySize) {
     uint8_t isLeaf, padding;
 
     if(bwRead((void*) &isLeaf, sizeof(uint8_t), 1, bw) != 1) return -1;
     if(bwRead((void*) &padding, sizeof(uint8_t), 1, bw) != 1) return -1;
 
     if(isLeaf) {
-        return readChromLeaf(bw, cl, keySize);
+        return readChromLeaf(bw, cl, arena, keySize);
     } else { //I've never actually observed one of these, which is good since they're pointless
-        return readChromNonLeaf(bw, cl, keySize);
+        return readChromNonLeaf(bw, cl, arena, keySize);
+    }
+}
+
+//Read all chromosomes under the node at the current position into a single buffer
+//Chromosomes already in the list are skipped. Returns 0 on success
+static int readChromArena(bigWigFile_t *bw, chromList_t *cl, uint32_t keySize) {
+    chromArena_t arena = {NULL, 0, 0, NULL, NULL};
+    uint64_t rv, i;
+
+    arena.offset = calloc(cl->nKeys, sizeof(uint64_t));
+    arena.len = calloc(cl->nKeys, sizeof(uint32_t));
+    if(cl->nKeys && (!arena.offset || !arena.len)) goto error;
+
+    rv = readChromBlock(bw, cl, &arena, keySize);
+    if(rv == (uint64_t) -1) goto error;
+    if(rv != (uint64_t) cl->nKeys) goto error;
+
+    //Pointers into the buffer are only valid once it's done growing
+    cl->arena = arena.buf;
+    cl->arenaLen = arena.l;
+    for(i=0; i<(uint64_t) cl->nKeys; i++) {
+        //Anything looked up lazily in the meantime is kept, the copy in the arena is then simply unused
+        if(arena.offset[i]) publishChrom(cl, i, cl->arena + arena.offset[i] - 1, arena.len[i]);
+    }
+    free(arena.offset);
+    free(arena.len);
+    return 0;
+
+error:
+    free(arena.buf);
+    free(arena.offset);
+    free(arena.len);
+    return 2;
+}
+
+//The maximum depth of the chromosome tree that will be followed (guards against cycles in corrupt files)
+#define MAX_CHROM_TREE_DEPTH 64
+
+//Read the header of a node in the chromosome tree
+//Returns the number of items in the node, or -1 on error
+static int32_t readChromTreeNode(bigWigFile_t *bw, uint64_t offset, uint8_t *isLeaf) {
+    uint8_t padding;
+    uint16_t nVals;
+
+    if(bwSetPos(bw, offset)) return -1;
+    if(bwRead((void*) isLeaf, sizeof(uint8_t), 1, bw) != 1) return -1;
+    if(bwRead((void*) &padding, sizeof(uint8_t), 1, bw) != 1) return -1;
+    if(bwRead((void*) &nVals, sizeof(uint16_t), 1, bw) != 1) return -1;
+    return nVals;
+}
+
+//Read item i of the node at offset into item, which holds keySize+8 bytes (the size of both leaf and non-leaf items)
+//Nodes can hold tens of thousands of items, so only those actually needed are read
+//Returns 0 on success
+static int readChromTreeItem(bigWigFile_t *bw, bwChromTree_t *tree, uint64_t offset, int32_t i, char *item) {
+    size_t itemSize = tree->keySize + 8;
+    if(bwSetPos(bw, offset + 4 + i*itemSize)) return 1;
+    if(bwRead((void*) item, itemSize, 1, bw) != 1) return 2;
+    return 0;
+}
+
+//strcmp(), but against a key that's padded with nulls to keySize and possibly not null terminated
+static int chromKeyCmp(const char *chrom, const char *key, uint32_t keySize) {
+    int rv = strncmp(chrom, key, keySize);
+    if(rv == 0 && strnlen(chrom, keySize+1) > keySize) return 1;
+    return rv;
+}
+
+//The ID and length in a leaf item or the child offset in a non-leaf item, which needn't be aligned
+static uint32_t itemTid(bwChromTree_t *tree, const char *item) {
+    uint32_t v;
+    memcpy(&v, item + tree->keySize, sizeof(uint32_t));
+    return v;
+}
+
+static uint32_t itemLen(bwChromTree_t *tree, const char *item) {
+    uint32_t v;
+    memcpy(&v, item + tree->keySize + 4, sizeof(uint32_t));
+    return v;
+}
+
+static uint64_t itemOffset(bwChromTree_t *tree, const char *item) {
+    uint64_t v;
+    memcpy(&v, item + tree->keySize, sizeof(uint64_t));
+    return v;
+}
+
+//Search the on-disk tree for a chromosome, caching it if found
+//This relies on the keys being sorted, which is the case unless the file was written by an old version of this library from unsorted chromosomes
+//Returns the tid or -1 if not found (or on error)
+static int64_t chromTreeFindName(bigWigFile_t *bw, chromList_t *cl, const char *chrom) {
+    bwChromTree_t *tree = cl->tree;
+    uint64_t offset = tree->rootOffset, next = 0;
+    int64_t tid = -1;
+    int32_t n, lo, hi, mid, found;
+    uint32_t depth;
+    uint8_t isLeaf;
+    int rv;
+    char *item = malloc(tree->keySize + 8);
+    if(!item) return -1;
+
+    for(depth=0; depth<MAX_CHROM_TREE_DEPTH; depth++) {
+        n = readChromTreeNode(bw, offset, &isLeaf);
+        if(n <= 0) goto done;
+
+        //Binary search for the last key <= chrom
+        lo = 0;
+        hi = n-1;
+        found = 0;
+        while(lo <= hi) {
+            mid = lo + (hi-lo)/2;
+            if(readChromTreeItem(bw, tree, offset, mid, item)) goto done;
+            rv = chromKeyCmp(chrom, item, tree->keySize);
+            if(isLeaf && rv == 0) {
+                if(setChrom(cl, itemTid(tree, item), item, tree->keySize, itemLen(tree, item))) goto done;
+                tid = itemTid(tree, item);
+                goto done;
+            }
+            if(rv < 0) {
+                hi = mid-1;
+            } else {
+                next = itemOffset(tree, item);
+                found = 1;
+                lo = mid+1;
+            }
+        }
+        if(isLeaf || !found) goto done;
+        offset = next;
+    }
+
+done:
+    free(item);
+    return tid;
+}
+
+//The tid of the left-most item under a node
+//Returns -1 on error
+static int64_t chromTreeFirstTid(bigWigFile_t *bw, bwChromTree_t *tree, uint64_t offset, char *item) {
+    uint32_t depth;
+    uint8_t isLeaf;
+
+    for(depth=0; depth<MAX_CHROM_TREE_DEPTH; depth++) {
+        if(readChromTreeNode(bw, offset, &isLeaf) <= 0) return -1;
+        if(readChromTreeItem(bw, tree, offset, 0, item)) return -1;
+        if(isLeaf) return itemTid(tree, item);
+        offset = itemOffset(tree, item);
+    }
+    return -1;
+}
+
+//Search the on-disk tree for a chromosome by ID, caching it if found
+//This relies on the IDs increasing from left to right in the tree, which is the case for files written by both UCSC tools and this library
+//Returns 0 if found and something else otherwise
+static int chromTreeFindTid(bigWigFile_t *bw, chromList_t *cl, uint32_t tid) {
+    bwChromTree_t *tree = cl->tree;
+    uint64_t offset = tree->rootOffset, next = 0, child = 0;
+    int32_t n, lo, hi, mid, found;
+    int64_t first;
+    uint32_t depth;
+    uint8_t isLeaf;
+    int rv = 5;
+    char *item = malloc(tree->keySize + 8);
+    if(!item) return 1;
+
+    for(depth=0; depth<MAX_CHROM_TREE_DEPTH; depth++) {
+        n = readChromTreeNode(bw, offset, &isLeaf);
+        if(n <= 0) {
+            rv = 1;
+            goto done;
+        }
+
+        //Binary search for the last item (or child) whose first ID is <= tid
+        lo = 0;
+        hi = n-1;
+        found = 0;
+        while(lo <= hi) {
+            mid = lo + (hi-lo)/2;
+            if(readChromTreeItem(bw, tree, offset, mid, item)) {
+                rv = 2;
+                goto done;
+            }
+            if(isLeaf) {
+                first = itemTid(tree, item);
+                if(first == tid) {
+                    rv = setChrom(cl, tid, item, tree->keySize, itemLen(tree, item));
+                    goto done;
+                }
+            } else {
+                next = itemOffset(tree, item);
+                first = chromTreeFirstTid(bw, tree, next, item);
+                if(first < 0) {
+                    rv = 3;
+                    goto done;
+                }
+            }
+            if(first <= tid) {
+                child = next;
+                found = 1;
+                lo = mid+1;
+            } else {
+                hi = mid-1;
+            }
+        }
+        if(isLeaf || !found) {
+            rv = 4;
+            goto done;
+        }
+        offset = child;
     }
+
+done:
+    free(item);
+    return rv;
 }
 
-static chromList_t *bwReadChromList(bigWigFile_t *bw) {
+//Whether everything has been read in, after which the tree is no longer used
+static int chromTreeLoaded(bwChromTree_t *tree) {
+    return __atomic_load_n(&(tree->loaded), __ATOMIC_ACQUIRE);
+}
+
+//Read in everything that hasn't been looked up yet and stop being lazy
+//Only one thread does this, others wait until it's done
+//Returns 0 on success
+static int loadChromTree(bigWigFile_t *bw, chromList_t *cl) {
+    bwChromTree_t *tree = cl->tree;
+    int rv = 0;
+    if(!tree || chromTreeLoaded(tree)) return 0;
+
+    while(__atomic_test_and_set(&(tree->lock), __ATOMIC_ACQUIRE)) sched_yield();
+    if(!chromTreeLoaded(tree)) {
+        if(bwSetPos(bw, tree->rootOffset)) rv = 1;
+        else if(readChromArena(bw, cl, tree->keySize)) rv = 2;
+        else __atomic_store_n(&(tree->loaded), 1, __ATOMIC_RELEASE);
+    }
+    __atomic_clear(&(tree->lock), __ATOMIC_RELEASE);
+    return rv;
+}
+
+uint32_t bwLazyGetTid(bigWigFile_t *fp, const char *chrom) {
+    chromList_t *cl = fp->cl;
+    uint32_t i;
+    const char *c;
+    int64_t tid;
+
+    if(!chromTreeLoaded(cl->tree)) {
+        //Queries tend to be for the same chromosome over and over
+        i = __atomic_load_n(&(cl->tree->lastTid), __ATOMIC_RELAXED);
+        if(i < cl->nKeys) {
+            c = __atomic_load_n(&(cl->chrom[i]), __ATOMIC_ACQUIRE);
+            if(c && strcmp(chrom, c) == 0) return i;
+        }
+
+        tid = chromTreeFindName(fp, cl, chrom);
+        if(tid >= 0) {
+            __atomic_store_n(&(cl->tree->lastTid), tid, __ATOMIC_RELAXED);
+            return tid;
+        }
+
+        //The keys may not be sorted, so fall back to reading everything
+        if(loadChromTree(fp, cl)) return -1;
+    }
+
+    for(i=0; i<cl->nKeys; i++) {
+        if(strcmp(chrom, cl->chrom[i]) == 0) return i;
+    }
+    return -1;
+}
+
+const char *bwGetChrom(bigWigFile_t *fp, uint32_t tid) {
+    const char *chrom;
+    if(!fp->cl || tid >= fp->cl->nKeys) return NULL;
+    chrom = __atomic_load_n(&(fp->cl->chrom[tid]), __ATOMIC_ACQUIRE);
+    if(chrom) return chrom;
+    if(!fp->cl->tree) return NULL;
+    if(chromTreeFindTid(fp, fp->cl, tid)) {
+        if(loadChromTree(fp, fp->cl)) return NULL;
+    }
+    return __atomic_load_n(&(fp->cl->chrom[tid]), __ATOMIC_ACQUIRE);
+}
+
+uint32_t bwGetChromLen(bigWigFile_t *fp, uint32_t tid) {
+    if(!bwGetChrom(fp, tid)) return 0;
+    return __atomic_load_n(&(fp->cl->len[tid]), __ATOMIC_RELAXED);
+}
+
+static chromList_t *bwReadChromList(bigWigFile_t *bw, int lazy) {
     chromList_t *cl = NULL;
     uint32_t magic, keySize, valueSize, itemsPerBlock;
-    uint64_t rv, itemCount;
+    uint64_t itemCount;
     if(bw->isWrite) return NULL;
     if(bwSetPos(bw, bw->hdr->ctOffset)) return NULL;
 
@@ -264,10 +623,19 @@ static chromList_t *bwReadChromList(bigWigFile_t *bw) {
     if(bwRead((void*) &magic, sizeof(uint32_t), 1, bw) != 1) goto error;
     if(bwRead((void*) &magic, sizeof(uint32_t), 1, bw) != 1) goto error;
 
+    //Defer reading the blocks until they're needed
+    if(lazy) {
+        cl->tree = calloc(1, sizeof(bwChromTree_t));
+        if(!cl->tree) goto error;
+        cl->tree->rootOffset = bwTell(bw);
+        cl->tree->keySize = keySize;
+        cl->tree->itemsPerBlock = itemsPerBlock;
+        cl->tree->lastTid = -1;
+        return cl;
+    }
+
     //Read in the blocks
-    rv = readChromBlock(bw, cl, keySize);
-    if(rv == (uint64_t) -1) goto error;
-    if(rv != itemCount) goto error;
+    if(readChromArena(bw, cl, keySize)) goto error;
 
     return cl;
 
@@ -278,11 +646,18 @@ error:
 
 //This is here mostly for convenience
 static void bwDestroyWriteBuffer(bwWriteBuffer_t *wb) {
+    bwDestroyWritePool(wb->pool);
     if(wb->p) free(wb->p);
     if(wb->compressP) free(wb->compressP);
     if(wb->firstZoomBuffer) free(wb->firstZoomBuffer);
     if(wb->lastZoomBuffer) free(wb->lastZoomBuffer);
     if(wb->nNodes) free(wb->nNodes);
+    if(wb->zoomSum) free(wb->zoomSum);
+    if(wb->zoomSumsq) free(wb->zoomSumsq);
+    if(wb->zoomSample) free(wb->zoomSample);
+    if(wb->zoomSpill) fclose(wb->zoomSpill);
+    if(wb->sink) fclose(wb->sink);
+    if(wb->blocks) free(wb->blocks);
     free(wb);
 }
 
@@ -292,6 +667,15 @@ void bwClose(bigWigFile_t *fp) {
         fprintf(stderr, "[bwClose] There was an error while finishing writing a bigWig file! The output is likely truncated.\n");
     }
     if(fp->URL) urlClose(fp->URL);
+    //Shared metadata is only freed along with the last handle using it
+    if(fp->shared) {
+        if(__atomic_sub_fetch(&(fp->shared->refCount), 1, __ATOMIC_ACQ_REL) > 0) {
+            free(fp);
+            return;
+        }
+        if(fp->shared->ioClose) fp->shared->ioClose(fp->shared->ioCtx);
+        free(fp->shared);
+    }
     if(fp->hdr) bwHdrDestroy(fp->hdr);
     if(fp->cl) destroyChromList(fp->cl);
     if(fp->idx) bwDestroyIndex(fp->idx);
@@ -299,6 +683,55 @@ void bwClose(bigWigFile_t *fp) {
     free(fp);
 }
 
+bigWigFile_t *bwClone(bigWigFile_t *fp) {
+    bigWigFile_t *c = NULL;
+    bwIO_t io;
+    if(!fp || fp->isWrite || !fp->URL) return NULL;
+
+    c = calloc(1, sizeof(bigWigFile_t));
+    if(!c) return NULL;
+
+    if(!fp->shared) {
+        fp->shared = calloc(1, sizeof(bwShared_t));
+        if(!fp->shared) goto error;
+        fp->shared->refCount = 1;
+        //User-supplied I/O is shared, so only the last handle may close it
+        if(fp->URL->type == BWG_CUSTOM) {
+            fp->shared->ioClose = fp->URL->io.close;
+            fp->shared->ioCtx = fp->URL->io.ctx;
+            fp->URL->io.close = NULL;
+        }
+    }
+
+    switch(fp->URL->type) {
+    case BWG_MEM:
+        c->URL = urlOpenBuffer(fp->URL->memBuf, fp->URL->bufLen);
+        break;
+    case BWG_CUSTOM:
+        io = fp->URL->io;
+        c->URL = urlOpenIO(&io);
+        break;
+    default:
+        c->URL = urlOpen(fp->URL->fname, fp->URL->callBack, NULL);
+        break;
+    }
+    if(!c->URL) goto error;
+    c->URL->isCompressed = fp->URL->isCompressed;
+
+    c->hdr = fp->hdr;
+    c->cl = fp->cl;
+    c->idx = fp->idx;
+    c->type = fp->type;
+    c->shared = fp->shared;
+    __atomic_add_fetch(&(fp->shared->refCount), 1, __ATOMIC_RELAXED);
+
+    return c;
+
+error:
+    free(c);
+    return NULL;
+}
+
 int bwIsBigWig(const char *fname, CURLcode (*callBack) (CURL*)) {
     uint32_t magic = 0;
     URL_t *URL = NULL;
@@ -342,6 +775,46 @@ int bbIsBigBed(const char *fname, CURLcode (*callBack) (CURL*)) {
     return 0;
 }
 
+//Read the header, chromosome list and index of a file whose URL has already been opened for reading
+//The index is optional for bigWig files but not bigBed files
+//If lazy is set, chromosomes are only read as they're needed
+//Returns 0 on success
+static int bwReadMetadata(bigWigFile_t *bwg, const char *fname, int lazy) {
+    //Attempt to read in the fixed header
+    bwHdrRead(bwg);
+    if(!bwg->hdr) {
+        fprintf(stderr, "[bwReadMetadata] bwg->hdr is NULL!\n");
+        return 1;
+    }
+
+    //Read in the chromosome list
+    bwg->cl = bwReadChromList(bwg, lazy);
+    if(!bwg->cl) {
+        fprintf(stderr, "[bwReadMetadata] bwg->cl is NULL (%s)!\n", fname);
+        return 2;
+    }
+
+    //Read in the index
+    if(bwg->hdr->indexOffset || bwg->type == 1) {
+        bwg->idx = bwReadIndex(bwg, 0);
+        if(!bwg->idx) {
+            fprintf(stderr, "[bwReadMetadata] bwg->idx is NULL bwg->hdr->dataOffset 0x%"PRIx64"!\n", bwg->hdr->dataOffset);
+            return 3;
+        }
+    }
+
+    return 0;
+}
+
+//Set up the buffers needed for writing, returns 0 on success
+static int bwInitWrite(bigWigFile_t *bwg) {
+    bwg->isWrite = 1;
+    bwg->writeBuffer = calloc(1,sizeof(bwWriteBuffer_t));
+    if(!bwg->writeBuffer) return 1;
+    bwg->writeBuffer->l = 24;
+    return 0;
+}
+
 bigWigFile_t *bwOpen(const char *fname, CURLcode (*callBack) (CURL*), const char *mode) {
     bigWigFile_t *bwg = calloc(1, sizeof(bigWigFile_t));
     if(!bwg) {
@@ -356,35 +829,11 @@ bigWigFile_t *bwOpen(const char *fname, CURLcode (*callBack) (CURL*), const char
             goto error;
         }
 
-        //Attempt to read in the fixed header
-        bwHdrRead(bwg);
-        if(!bwg->hdr) {
-            fprintf(stderr, "[bwOpen] bwg->hdr is NULL!\n");
-            goto error;
-        }
-
-        //Read in the chromosome list
-        bwg->cl = bwReadChromList(bwg);
-        if(!bwg->cl) {
-            fprintf(stderr, "[bwOpen] bwg->cl is NULL (%s)!\n", fname);
-            goto error;
-        }
-
-        //Read in the index
-        if(bwg->hdr->indexOffset) {
-            bwg->idx = bwReadIndex(bwg, 0);
-            if(!bwg->idx) {
-                fprintf(stderr, "[bwOpen] bwg->idx is NULL bwg->hdr->dataOffset 0x%"PRIx64"!\n", bwg->hdr->dataOffset);
-                goto error;
-            }
-        }
+        if(bwReadMetadata(bwg, fname, mode && strchr(mode, 'l') != NULL)) goto error;
     } else {
-        bwg->isWrite = 1;
         bwg->URL = urlOpen(fname, NULL, "w+");
         if(!bwg->URL) goto error;
-        bwg->writeBuffer = calloc(1,sizeof(bwWriteBuffer_t));
-        if(!bwg->writeBuffer) goto error;
-        bwg->writeBuffer->l = 24;
+        if(bwInitWrite(bwg)) goto error;
     }
 
     return bwg;
@@ -407,17 +856,7 @@ bigWigFile_t *bbOpen(const char *fname, CURLcode (*callBack) (CURL*)) {
     bb->URL = urlOpen(fname, *callBack, NULL);
     if(!bb->URL) goto error;
 
-    //Attempt to read in the fixed header
-    bwHdrRead(bb);
-    if(!bb->hdr) goto error;
-
-    //Read in the chromosome list
-    bb->cl = bwReadChromList(bb);
-    if(!bb->cl) goto error;
-
-    //Read in the index
-    bb->idx = bwReadIndex(bb, 0);
-    if(!bb->idx) goto error;
+    if(bwReadMetadata(bb, fname, 0)) goto error;
 
     return bb;
 
@@ -426,6 +865,76 @@ error:
     return NULL;
 }
 
+//Like bwOpen/bbOpen, but with an already opened URL. type is 0 for bigWig and 1 for bigBed
+//URL is closed on error
+static bigWigFile_t *openURL(URL_t *URL, int type) {
+    bigWigFile_t *bwg = calloc(1, sizeof(bigWigFile_t));
+    if(!bwg) {
+        fprintf(stderr, "[openURL] Couldn't allocate space to create the output object!\n");
+        urlClose(URL);
+        return NULL;
+    }
+
+    bwg->type = type;
+    bwg->URL = URL;
+
+    if(bwReadMetadata(bwg, URL->fname ? URL->fname : "user-supplied I/O", 0)) goto error;
+
+    return bwg;
+
+error:
+    bwClose(bwg);
+    return NULL;
+}
+
+bigWigFile_t *bwOpenBuffer(const void *buf, size_t len) {
+    URL_t *URL = urlOpenBuffer(buf, len);
+    if(!URL) return NULL;
+    return openURL(URL, 0);
+}
+
+bigWigFile_t *bbOpenBuffer(const void *buf, size_t len) {
+    URL_t *URL = urlOpenBuffer(buf, len);
+    if(!URL) return NULL;
+    return openURL(URL, 1);
+}
+
+//type is 0 for bigWig and 1 for bigBed
+static bigWigFile_t *openIO(const bwIO_t *io, int type) {
+    URL_t *URL = urlOpenIO(io);
+    if(!URL) {
+        if(io && io->close) io->close(io->ctx);
+        return NULL;
+    }
+    return openURL(URL, type);
+}
+
+bigWigFile_t *bwOpenIO(const bwIO_t *io) {
+    return openIO(io, 0);
+}
+
+bigWigFile_t *bbOpenIO(const bwIO_t *io) {
+    return openIO(io, 1);
+}
+
+bigWigFile_t *bwOpenBufferWrite(void **buf, size_t *len) {
+    bigWigFile_t *bwg = calloc(1, sizeof(bigWigFile_t));
+    if(!bwg) {
+        fprintf(stderr, "[bwOpenBufferWrite] Couldn't allocate space to create the output object!\n");
+        return NULL;
+    }
+
+    bwg->URL = urlOpenBufferWrite(buf, len);
+    if(!bwg->URL) goto error;
+    if(bwInitWrite(bwg)) goto error;
+
+    return bwg;
+
+error:
+    bwClose(bwg);
+    return NULL;
+}
+
 
 //Implementation taken from musl:
 //https://git.musl-libc.org/cgit/musl/tree/src/string/strdup.c
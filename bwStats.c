@@ -5,6 +5,16 @@
 #include <zlib.h>
 #include <math.h>
 #include <string.h>
+#include <float.h>
+#include <pthread.h>
+#include <unistd.h>
+
+//The relative accuracy of approximate quantiles
+#define QUANTILE_SKETCH_ACCURACY 0.01
+//The number of blocks decompressed at a time by bwQuantiles()
+#define QUANTILE_BLOCKS_PER_ITERATION 16
+//The number of blocks decompressed at a time by bwCreatePrefixSums()
+#define PREFIXSUM_BLOCKS_PER_ITERATION 16
 
 //Returns -1 if there are no applicable levels, otherwise an integer indicating the most appropriate level.
 //Like Kent's library, this divides the desired bin size by 2 to minimize the effect of blocks overlapping multiple bins
@@ -25,25 +35,36 @@ static int32_t determineZoomLevel(const bigWigFile_t *fp, int basesPerBin) {
     return out;
 }
 
+//The start of bin i when [start, end) is split into nBins bins, which is also the end of bin i-1
+//Every function that splits an interval into bins must agree on this, so results don't depend on how the bins are processed
+static uint32_t binStart(uint32_t start, uint32_t end, uint32_t nBins, uint32_t i) {
+    return start + ((double)(end-start)*i)/((int) nBins);
+}
+
 /// @cond SKIP
 struct val_t {
+    uint32_t start, end;
     uint32_t nBases;
     float min, max, sum, sumsq;
     double scalar;
 };
 
+//Zoom records decoded from a block by getVals(). Everything here is reused from one block to the next
 struct vals_t {
-    uint32_t n;
-    struct val_t **vals;
+    uint32_t n, m;
+    struct val_t *vals;
+    void *buf, *compBuf;
+    size_t compSz;
 };
 /// @endcond
 
+//Frees everything held by v, but not v itself
 void destroyVals_t(struct vals_t *v) {
-    uint32_t i;
     if(!v) return;
-    for(i=0; i<v->n; i++) free(v->vals[i]);
-    if(v->vals) free(v->vals);
-    free(v);
+    free(v->vals);
+    free(v->buf);
+    free(v->compBuf);
+    memset(v, 0, sizeof(struct vals_t));
 }
 
 //Determine the base-pair overlap between an interval and a block
@@ -59,99 +80,82 @@ double getScalar(uint32_t i_start, uint32_t i_end, uint32_t b_start, uint32_t b_
     return rv;
 }
 
-//Returns NULL on error
-static struct vals_t *getVals(bigWigFile_t *fp, bwOverlapBlock_t *o, int i, uint32_t tid, uint32_t start, uint32_t end) {
-    void *buf = NULL, *compBuf = NULL;
-    uLongf sz = fp->hdr->bufSize;
-    int compressed = 0, rv;
-    uint32_t *p, vtid, vstart, vend;
-    struct vals_t *vals = NULL;
-    struct val_t *v = NULL;
-
-    if(sz) {
-        compressed = 1;
-        buf = malloc(sz);
+//Replaces the contents of vals with the records in block i overlapping [start, end) on tid
+//These are decoded straight from the decompressed block, so nothing is allocated once vals has grown large enough
+//Returns 0 on success
+static int getVals(bigWigFile_t *fp, bwOverlapBlock_t *o, int i, uint32_t tid, uint32_t start, uint32_t end, struct vals_t *vals) {
+    uLongf sz;
+    uint32_t *p, *pEnd, vstart, vend;
+    struct val_t *v;
+    void *buf;
+
+    vals->n = 0;
+    if(fp->hdr->bufSize && !vals->buf) {
+        vals->buf = malloc(fp->hdr->bufSize);
+        if(!vals->buf) return 1;
+    }
+    if(vals->compSz < o->size[i]) {
+        buf = realloc(vals->compBuf, o->size[i]);
+        if(!buf) return 1;
+        vals->compBuf = buf;
+        vals->compSz = o->size[i];
     }
-    sz = 0; //This is now the size of the compressed buffer
-
-    if(bwSetPos(fp, o->offset[i])) goto error;
-
-    vals = calloc(1,sizeof(struct vals_t));
-    if(!vals) goto error;
-
-    v = malloc(sizeof(struct val_t));
-    if(!v) goto error;
-
-    if(sz < o->size[i]) compBuf = malloc(o->size[i]);
-    if(!compBuf) goto error;
 
-    if(bwRead(compBuf, o->size[i], 1, fp) != 1) goto error;
-    if(compressed) {
+    if(bwSetPos(fp, o->offset[i])) return 1;
+    if(bwRead(vals->compBuf, o->size[i], 1, fp) != 1) return 1;
+    if(fp->hdr->bufSize) {
         sz = fp->hdr->bufSize;
-        rv = uncompress(buf, &sz, compBuf, o->size[i]);
-        if(rv != Z_OK) goto error;
+        if(uncompress(vals->buf, &sz, vals->compBuf, o->size[i]) != Z_OK) return 1;
+        buf = vals->buf;
     } else {
-        buf = compBuf;
         sz = o->size[i];
+        buf = vals->compBuf;
     }
 
-    p = buf;
-    while(((uLongf) ((char*)p - (char*)buf)) < sz) {
-        vtid = p[0];
+    //Records are sorted, so stop after passing the interval
+    pEnd = (uint32_t*) buf + 8 * (sz / 32);
+    for(p = buf; p < pEnd; p += 8) {
+        if(p[0] < tid) continue;
+        if(p[0] > tid) break;
         vstart = p[1];
         vend = p[2];
+        if(vstart > end) break;
+        if(!((start <= vstart && end > vstart) || (start < vend && start >= vstart))) continue;
+
+        if(vals->n == vals->m) {
+            vals->m = vals->m ? 2 * vals->m : 64;
+            v = realloc(vals->vals, sizeof(struct val_t) * vals->m);
+            if(!v) return 1;
+            vals->vals = v;
+        }
+        v = vals->vals + vals->n++;
+        v->start = vstart;
+        v->end = vend;
         v->nBases = p[3];
         v->min = ((float*) p)[4];
         v->max = ((float*) p)[5];
         v->sum = ((float*) p)[6];
         v->sumsq = ((float*) p)[7];
         v->scalar = getScalar(start, end, vstart, vend);
-
-        if(tid == vtid) {
-            if((start <= vstart && end > vstart) || (start < vend && start >= vstart)) {
-                vals->vals = realloc(vals->vals, sizeof(struct val_t*)*(vals->n+1));
-                if(!vals->vals) goto error;
-                vals->vals[vals->n++] = v;
-                v = malloc(sizeof(struct val_t));
-                if(!v) goto error;
-            }
-            if(vstart > end) break;
-        } else if(vtid > tid) {
-            break;
-        }
-        p+=8;
     }
 
-    free(v);
-    free(buf);
-    if(compressed) free(compBuf);
-    return vals;
-
-error:
-    if(buf) free(buf);
-    if(compBuf && compressed) free(compBuf);
-    if(v) free(v);
-    destroyVals_t(vals);
-    return NULL;
+    return 0;
 }
 
 //On error, errno is set to ENOMEM and NaN is returned (though NaN can be returned normally)
-static double blockMean(bigWigFile_t *fp, bwOverlapBlock_t *blocks, uint32_t tid, uint32_t start, uint32_t end) {
+static double blockMean(bigWigFile_t *fp, bwOverlapBlock_t *blocks, uint32_t tid, uint32_t start, uint32_t end, struct vals_t *v) {
     uint32_t i, j;
     double output = 0.0, coverage = 0.0;
-    struct vals_t *v = NULL;
 
     if(!blocks->n) return strtod("NaN", NULL);
 
     //Iterate over the blocks
     for(i=0; i<blocks->n; i++) {
-        v = getVals(fp, blocks, i, tid, start, end);
-        if(!v) goto error;
+        if(getVals(fp, blocks, i, tid, start, end, v)) goto error;
         for(j=0; j<v->n; j++) {
-            output += v->vals[j]->sum * v->vals[j]->scalar;
-            coverage += v->vals[j]->nBases * v->vals[j]->scalar;
+            output += v->vals[j].sum * v->vals[j].scalar;
+            coverage += v->vals[j].nBases * v->vals[j].scalar;
         }
-        destroyVals_t(v);
     }
 
 
@@ -160,7 +164,6 @@ static double blockMean(bigWigFile_t *fp, bwOverlapBlock_t *blocks, uint32_t tid
     return output/coverage;
 
 error:
-    if(v) free(v);
     errno = ENOMEM;
     return strtod("NaN", NULL);
 }
@@ -184,24 +187,20 @@ static double intMean(bwOverlappingIntervals_t* ints, uint32_t start, uint32_t e
 }
 
 //Does UCSC compensate for partial block/range overlap?
-static double blockDev(bigWigFile_t *fp, bwOverlapBlock_t *blocks, uint32_t tid, uint32_t start, uint32_t end) {
+static double blockDev(bigWigFile_t *fp, bwOverlapBlock_t *blocks, uint32_t tid, uint32_t start, uint32_t end, struct vals_t *v) {
     uint32_t i, j;
     double mean = 0.0, ssq = 0.0, coverage = 0.0, diff;
-    struct vals_t *v = NULL;
 
     if(!blocks->n) return strtod("NaN", NULL);
 
     //Iterate over the blocks
     for(i=0; i<blocks->n; i++) {
-        v = getVals(fp, blocks, i, tid, start, end);
-        if(!v) goto error;
+        if(getVals(fp, blocks, i, tid, start, end, v)) goto error;
         for(j=0; j<v->n; j++) {
-            coverage += v->vals[j]->nBases * v->vals[j]->scalar;
-            mean += v->vals[j]->sum * v->vals[j]->scalar;
-            ssq += v->vals[j]->sumsq * v->vals[j]->scalar;
+            coverage += v->vals[j].nBases * v->vals[j].scalar;
+            mean += v->vals[j].sum * v->vals[j].scalar;
+            ssq += v->vals[j].sumsq * v->vals[j].scalar;
         }
-        destroyVals_t(v);
-        v = NULL;
     }
 
     if(coverage<=1.0) return strtod("NaN", NULL);
@@ -214,7 +213,6 @@ static double blockDev(bigWigFile_t *fp, bwOverlapBlock_t *blocks, uint32_t tid,
     }
 
 error:
-    if(v) destroyVals_t(v);
     errno = ENOMEM;
     return strtod("NaN", NULL);
 }
@@ -243,32 +241,28 @@ static double intDev(bwOverlappingIntervals_t* ints, uint32_t start, uint32_t en
     return rv;
 }
 
-static double blockMax(bigWigFile_t *fp, bwOverlapBlock_t *blocks, uint32_t tid, uint32_t start, uint32_t end) {
+static double blockMax(bigWigFile_t *fp, bwOverlapBlock_t *blocks, uint32_t tid, uint32_t start, uint32_t end, struct vals_t *v) {
     uint32_t i, j, isNA = 1;
     double o = strtod("NaN", NULL);
-    struct vals_t *v = NULL;
 
     if(!blocks->n) return o;
 
     //Iterate the blocks
     for(i=0; i<blocks->n; i++) {
-        v = getVals(fp, blocks, i, tid, start, end);
-        if(!v) goto error;
+        if(getVals(fp, blocks, i, tid, start, end, v)) goto error;
         for(j=0; j<v->n; j++) {
             if(isNA) {
-                o = v->vals[j]->max;
+                o = v->vals[j].max;
                 isNA = 0;
-            } else if(v->vals[j]->max > o) {
-                o = v->vals[j]->max;
+            } else if(v->vals[j].max > o) {
+                o = v->vals[j].max;
             }
         }
-        destroyVals_t(v);
     }
 
     return o;
 
 error:
-    destroyVals_t(v);
     errno = ENOMEM;
     return strtod("NaN", NULL);
 }
@@ -287,30 +281,26 @@ static double intMax(bwOverlappingIntervals_t* ints) {
     return o;
 }
 
-static double blockMin(bigWigFile_t *fp, bwOverlapBlock_t *blocks, uint32_t tid, uint32_t start, uint32_t end) {
+static double blockMin(bigWigFile_t *fp, bwOverlapBlock_t *blocks, uint32_t tid, uint32_t start, uint32_t end, struct vals_t *v) {
     uint32_t i, j, isNA = 1;
     double o = strtod("NaN", NULL);
-    struct vals_t *v = NULL;
 
     if(!blocks->n) return o;
 
     //Iterate the blocks
     for(i=0; i<blocks->n; i++) {
-        v = getVals(fp, blocks, i, tid, start, end);
-        if(!v) goto error;
+        if(getVals(fp, blocks, i, tid, start, end, v)) goto error;
         for(j=0; j<v->n; j++) {
             if(isNA) {
-                o = v->vals[j]->min;
+                o = v->vals[j].min;
                 isNA = 0;
-            } else if(v->vals[j]->min < o) o = v->vals[j]->min;
+            } else if(v->vals[j].min < o) o = v->vals[j].min;
         }
-        destroyVals_t(v);
     }
 
     return o;
 
 error:
-    destroyVals_t(v);
     errno = ENOMEM;
     return strtod("NaN", NULL);
 }
@@ -330,28 +320,24 @@ static double intMin(bwOverlappingIntervals_t* ints) {
 }
 
 //Does UCSC compensate for only partial block/interval overlap?
-static double blockCoverage(bigWigFile_t *fp, bwOverlapBlock_t *blocks, uint32_t tid, uint32_t start, uint32_t end) {
+static double blockCoverage(bigWigFile_t *fp, bwOverlapBlock_t *blocks, uint32_t tid, uint32_t start, uint32_t end, struct vals_t *v) {
     uint32_t i, j;
     double o = 0.0;
-    struct vals_t *v = NULL;
 
     if(!blocks->n) return strtod("NaN", NULL);
 
     //Iterate over the blocks
     for(i=0; i<blocks->n; i++) {
-        v = getVals(fp, blocks, i, tid, start, end);
-        if(!v) goto error;
+        if(getVals(fp, blocks, i, tid, start, end, v)) goto error;
         for(j=0; j<v->n; j++) {
-            o+= v->vals[j]->nBases * v->vals[j]->scalar;
+            o+= v->vals[j].nBases * v->vals[j].scalar;
         }
-        destroyVals_t(v);
     }
 
     if(o == 0.0) return strtod("NaN", NULL);
     return o;
 
 error:
-    destroyVals_t(v);
     errno = ENOMEM;
     return strtod("NaN", NULL);
 }
@@ -373,31 +359,27 @@ static double intCoverage(bwOverlappingIntervals_t* ints, uint32_t start, uint32
     return o/(end-start);
 }
 
-static double blockSum(bigWigFile_t *fp, bwOverlapBlock_t *blocks, uint32_t tid, uint32_t start, uint32_t end) {
+static double blockSum(bigWigFile_t *fp, bwOverlapBlock_t *blocks, uint32_t tid, uint32_t start, uint32_t end, struct vals_t *v) {
     uint32_t i, j, sizeUse;
     double o = 0.0;
-    struct vals_t *v = NULL;
 
     if(!blocks->n) return strtod("NaN", NULL);
 
     //Iterate over the blocks
     for(i=0; i<blocks->n; i++) {
-        v = getVals(fp, blocks, i, tid, start, end);
-        if(!v) goto error;
+        if(getVals(fp, blocks, i, tid, start, end, v)) goto error;
         for(j=0; j<v->n; j++) {
             //Multiply the block average by min(bases covered, block overlap with interval)
-            sizeUse = v->vals[j]->scalar;
-            if(sizeUse > v->vals[j]->nBases) sizeUse = v->vals[j]->nBases;
-            o+= (v->vals[j]->sum * sizeUse) / v->vals[j]->nBases;
+            sizeUse = v->vals[j].scalar;
+            if(sizeUse > v->vals[j].nBases) sizeUse = v->vals[j].nBases;
+            o+= (v->vals[j].sum * sizeUse) / v->vals[j].nBases;
         }
-        destroyVals_t(v);
     }
 
     if(o == 0.0) return strtod("NaN", NULL);
     return o;
 
 error:
-    destroyVals_t(v);
     errno = ENOMEM;
     return strtod("NaN", NULL);
 }
@@ -420,49 +402,47 @@ static double intSum(bwOverlappingIntervals_t* ints, uint32_t start, uint32_t en
 }
 
 //Returns NULL on error, otherwise a double* that needs to be free()d
-static double *bwStatsFromZoom(bigWigFile_t *fp, int32_t level, uint32_t tid, uint32_t start, uint32_t end, uint32_t nBins, enum bwStatsType type) {
+//Computes bins first through last-1 of the nBins in [start, end) from a zoom level and stores them in output
+//Returns 0 on success
+static int statsFromZoom(bigWigFile_t *fp, int32_t level, uint32_t tid, uint32_t start, uint32_t end, uint32_t nBins, uint32_t first, uint32_t last, enum bwStatsType type, double *output) {
     bwOverlapBlock_t *blocks = NULL;
-    double *output = NULL;
-    uint32_t pos = start, i, end2;
+    struct vals_t vals;
+    uint32_t pos = binStart(start, end, nBins, first), i, end2 = pos;
+    bwRTree_t *idx = bwGetZoomIndex(fp, level);
 
-    if(!fp->hdr->zoomHdrs->idx[level]) {
-        fp->hdr->zoomHdrs->idx[level] = bwReadIndex(fp, fp->hdr->zoomHdrs->indexOffset[level]);
-        if(!fp->hdr->zoomHdrs->idx[level]) return NULL;
-    }
+    if(!idx) return 1;
     errno = 0; //Sometimes libCurls sets and then doesn't unset errno on errors
+    memset(&vals, 0, sizeof(struct vals_t));
 
-    output = malloc(sizeof(double)*nBins);
-    if(!output) return NULL;
-
-    for(i=0, pos=start; i<nBins; i++) {
-        end2 = start + ((double)(end-start)*(i+1))/((int) nBins);
-        blocks = walkRTreeNodes(fp, fp->hdr->zoomHdrs->idx[level]->root, tid, pos, end2);
+    for(i=first; i<last; i++) {
+        end2 = binStart(start, end, nBins, i+1);
+        blocks = bwIndexOverlaps(fp, idx, tid, pos, end2);
         if(!blocks) goto error;
 
         switch(type) {
         case 0:
             //mean
-            output[i] = blockMean(fp, blocks, tid, pos, end2);
+            output[i] = blockMean(fp, blocks, tid, pos, end2, &vals);
             break;
         case 1:
             //stdev
-            output[i] = blockDev(fp, blocks, tid, pos, end2);
+            output[i] = blockDev(fp, blocks, tid, pos, end2, &vals);
             break;
         case 2:
             //max
-            output[i] = blockMax(fp, blocks, tid, pos, end2);
+            output[i] = blockMax(fp, blocks, tid, pos, end2, &vals);
             break;
         case 3:
             //min
-            output[i] = blockMin(fp, blocks, tid, pos, end2);
+            output[i] = blockMin(fp, blocks, tid, pos, end2, &vals);
             break;
         case 4:
             //cov
-            output[i] = blockCoverage(fp, blocks, tid, pos, end2)/(end2-pos);
+            output[i] = blockCoverage(fp, blocks, tid, pos, end2, &vals)/(end2-pos);
             break;
         case 5:
             //sum
-            output[i] = blockSum(fp, blocks, tid, pos, end2);
+            output[i] = blockSum(fp, blocks, tid, pos, end2, &vals);
             break;
         default:
             goto error;
@@ -473,23 +453,33 @@ static double *bwStatsFromZoom(bigWigFile_t *fp, int32_t level, uint32_t tid, ui
         pos = end2;
     }
 
-    return output;
+    destroyVals_t(&vals);
+    return 0;
 
 error:
     fprintf(stderr, "got an error in bwStatsFromZoom in the range %"PRIu32"-%"PRIu32": %s\n", pos, end2, strerror(errno));
     if(blocks) destroyBWOverlapBlock(blocks);
-    if(output) free(output);
-    return NULL;
+    destroyVals_t(&vals);
+    return 1;
 }
 
-double *bwStatsFromFull(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, uint32_t nBins, enum bwStatsType type) {
-    bwOverlappingIntervals_t *ints = NULL;
+static double *bwStatsFromZoom(bigWigFile_t *fp, int32_t level, uint32_t tid, uint32_t start, uint32_t end, uint32_t nBins, enum bwStatsType type) {
     double *output = malloc(sizeof(double)*nBins);
-    uint32_t i, pos = start, end2;
     if(!output) return NULL;
+    if(statsFromZoom(fp, level, tid, start, end, nBins, 0, nBins, type, output)) {
+        free(output);
+        return NULL;
+    }
+    return output;
+}
 
-    for(i=0; i<nBins; i++) {
-        end2 = start + ((double)(end-start)*(i+1))/((int) nBins);
+//Computes bins first through last-1 of the nBins in [start, end) from the full resolution data and stores them in output
+static void statsFromFull(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, uint32_t nBins, uint32_t first, uint32_t last, enum bwStatsType type, double *output) {
+    bwOverlappingIntervals_t *ints = NULL;
+    uint32_t i, pos = binStart(start, end, nBins, first), end2;
+
+    for(i=first; i<last; i++) {
+        end2 = binStart(start, end, nBins, i+1);
         ints = bwGetOverlappingIntervals(fp, chrom, pos, end2);
 
         if(!ints) {
@@ -521,6 +511,915 @@ double *bwStatsFromFull(bigWigFile_t *fp, const char *chrom, uint32_t start, uin
         bwDestroyOverlappingIntervals(ints);
         pos = end2;
     }
+}
+
+double *bwStatsFromFull(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, uint32_t nBins, enum bwStatsType type) {
+    const double half = 0.5;
+    double *output;
+
+    if(type == median) return bwQuantiles(fp, chrom, start, end, nBins, &half, 1, 0);
+    output = malloc(sizeof(double)*nBins);
+    if(!output) return NULL;
+    statsFromFull(fp, chrom, start, end, nBins, 0, nBins, type, output);
+    return output;
+}
+
+/// @cond SKIP
+//Running totals for bwStatsExact()
+struct exactAcc_t {
+    uint64_t nBases;
+    double sum, sumsq, min, max;
+};
+/// @endcond
+
+static void exactAddZoom(struct exactAcc_t *acc, struct val_t *v) {
+    if(!v->nBases) return;
+    if(!acc->nBases || v->min < acc->min) acc->min = v->min;
+    if(!acc->nBases || v->max > acc->max) acc->max = v->max;
+    acc->nBases += v->nBases;
+    acc->sum += v->sum;
+    acc->sumsq += v->sumsq;
+}
+
+static void exactAddValue(struct exactAcc_t *acc, uint32_t nBases, double val) {
+    if(!nBases) return;
+    if(!acc->nBases || val < acc->min) acc->min = val;
+    if(!acc->nBases || val > acc->max) acc->max = val;
+    acc->nBases += nBases;
+    acc->sum += nBases * val;
+    acc->sumsq += nBases * val * val;
+}
+
+//Add the full resolution values in [start, split) to left and those in [split, end) to right
+//Returns 0 on success
+static int exactAddFull(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, uint32_t split, struct exactAcc_t *left, struct exactAcc_t *right) {
+    bwOverlappingIntervals_t *ints;
+    uint32_t i, start_use, end_use;
+    if(start >= end) return 0;
+    ints = bwGetOverlappingIntervals(fp, chrom, start, end);
+    if(!ints) return 1;
+
+    for(i=0; i<ints->l; i++) {
+        start_use = (ints->start[i] < start) ? start : ints->start[i];
+        end_use = (ints->end[i] > end) ? end : ints->end[i];
+        if(start_use < split) exactAddValue(left, ((end_use < split) ? end_use : split) - start_use, ints->value[i]);
+        if(end_use > split) exactAddValue(right, end_use - ((start_use > split) ? start_use : split), ints->value[i]);
+    }
+    bwDestroyOverlappingIntervals(ints);
+    return 0;
+}
+
+//Add a zoom record to acc. Earlier versions of this library didn't store the sums of the last record in each zoom buffer and level,
+//so a record whose sum of squares is 0 despite non-zero values is read from the full resolution data instead. This is the only place
+//such records are handled; files written by newer versions never contain them
+//Returns 0 on success
+static int exactAddRecord(bigWigFile_t *fp, const char *chrom, struct val_t *v, struct exactAcc_t *acc) {
+    if(v->sumsq == 0.0 && (v->min != 0.0 || v->max != 0.0)) return exactAddFull(fp, chrom, v->start, v->end, v->end, acc, NULL);
+    exactAddZoom(acc, v);
+    return 0;
+}
+
+//Add the zoom records lying entirely within [start, end). Since a zoom record holds everything between its start and end and nothing else,
+//only the parts of the bin covered by records that extend past either side, [start, *leftEnd) and [*rightStart, end), then need to be read from the full resolution data
+//Returns 0 on success
+static int exactZoom(bigWigFile_t *fp, bwRTree_t *idx, const char *chrom, uint32_t tid, uint32_t start, uint32_t end, struct vals_t *v, struct exactAcc_t *acc, uint32_t *leftEnd, uint32_t *rightStart) {
+    bwOverlapBlock_t *blocks = bwIndexOverlaps(fp, idx, tid, start, end);
+    uint32_t i, j;
+    struct val_t *r;
+
+    memset(acc, 0, sizeof(struct exactAcc_t));
+    *leftEnd = start;
+    *rightStart = end;
+    if(!blocks) return 1;
+
+    for(i=0; i<blocks->n; i++) {
+        if(getVals(fp, blocks, i, tid, start, end, v)) goto error;
+        for(j=0; j<v->n; j++) {
+            r = v->vals + j;
+            if(r->start >= start && r->end <= end) {
+                if(exactAddRecord(fp, chrom, r, acc)) goto error;
+                continue;
+            }
+            if(r->start < start && r->end > *leftEnd) *leftEnd = (r->end < end) ? r->end : end;
+            if(r->end > end && r->start < *rightStart) *rightStart = (r->start > start) ? r->start : start;
+        }
+    }
+
+    //A single record spans the bin, so there can't be any in its interior
+    if(*leftEnd >= *rightStart) {
+        *leftEnd = end;
+        *rightStart = end;
+    }
+
+    destroyBWOverlapBlock(blocks);
+    return 0;
+
+error:
+    destroyBWOverlapBlock(blocks);
+    return 2;
+}
+
+//These match the int*() functions used by bwStatsFromFull()
+static double exactStat(struct exactAcc_t *acc, uint32_t start, uint32_t end, enum bwStatsType type) {
+    double var;
+    if(!acc->nBases) return strtod("NaN", NULL);
+
+    switch(type) {
+    case 1:
+        //stdev
+        if(acc->nBases == 1) return 0.0;
+        var = (acc->sumsq - acc->sum * acc->sum / acc->nBases) / (acc->nBases - 1);
+        return (var > 0.0) ? sqrt(var) : 0.0;
+    case 2:
+        return acc->max;
+    case 3:
+        return acc->min;
+    case 4:
+        return ((double) acc->nBases)/(end-start);
+    case 5:
+        return acc->sum;
+    default:
+        return acc->sum/acc->nBases;
+    }
+}
+
+double *bwStatsExact(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, uint32_t nBins, enum bwStatsType type) {
+    //Prefer levels with a few records per bin, so the edges (at most two records each) are small compared to the bin
+    int32_t level = determineZoomLevel(fp, ((double)(end-start))/((int) nBins)/2);
+    uint32_t tid = bwGetTid(fp, chrom), i, pos = start, prevPos = start, end2 = start, leftEnd, rightStart, prevRightStart = start;
+    struct exactAcc_t acc[2];
+    struct vals_t vals;
+    double *output = NULL;
+    bwRTree_t *idx;
+
+    if(tid == (uint32_t) -1 || !nBins) return NULL;
+    if(level == -1 || type == median) return bwStatsFromFull(fp, chrom, start, end, nBins, type);
+    idx = bwGetZoomIndex(fp, level);
+    if(!idx) return NULL;
+
+    output = malloc(sizeof(double)*nBins);
+    if(!output) return NULL;
+    memset(acc, 0, sizeof(acc));
+    memset(&vals, 0, sizeof(struct vals_t));
+    for(i=0; i<nBins; i++) {
+        end2 = start + ((double)(end-start)*(i+1))/((int) nBins);
+        if(exactZoom(fp, idx, chrom, tid, pos, end2, &vals, acc + (i%2), &leftEnd, &rightStart)) goto error;
+        //The right edge of the previous bin and the left edge of this one are usually parts of the same zoom record, so they're read together
+        if(exactAddFull(fp, chrom, prevRightStart, leftEnd, pos, acc + ((i+1)%2), acc + (i%2))) goto error;
+        if(i) output[i-1] = exactStat(acc + ((i+1)%2), prevPos, pos, type);
+        prevRightStart = rightStart;
+        prevPos = pos;
+        pos = end2;
+    }
+    if(exactAddFull(fp, chrom, prevRightStart, end2, end2, acc + ((nBins+1)%2), NULL)) goto error;
+    output[nBins-1] = exactStat(acc + ((nBins+1)%2), prevPos, end2, type);
+
+    destroyVals_t(&vals);
+    return output;
+
+error:
+    fprintf(stderr, "got an error in bwStatsExact in the range %"PRIu32"-%"PRIu32"\n", pos, end2);
+    destroyVals_t(&vals);
+    free(output);
+    return NULL;
+}
+
+/// @cond SKIP
+//A value covering n bases
+struct wval_t {
+    float value;
+    uint32_t n;
+};
+
+//The per-base values seen so far in a bin, for bwQuantiles()
+//Either every value is kept (exact) or they're summarised in a DDSketch (approximate), which has a bounded relative error and a fixed size
+struct quantileAcc_t {
+    int approximate;
+    uint64_t nBases;
+    //Exact
+    struct wval_t *vals;
+    uint64_t l, m;
+    //Approximate: the number of bases in each logarithmic bucket of positive and negative values (by magnitude), indexed by key - minKey
+    double logGamma;
+    int32_t minKey, maxKey; //The range of keys any float can have
+    int32_t lo, hi; //The range of keys in use, lo > hi if there are none
+    uint64_t *pos, *neg, zero;
+};
+/// @endcond
+
+static int32_t sketchKey(const struct quantileAcc_t *acc, double val) {
+    return (int32_t) ceil(log(val)/acc->logGamma);
+}
+
+//The bucket with key k holds values in (gamma^(k-1), gamma^k], this is the value within it with the lowest relative error to both ends
+static double sketchValue(const struct quantileAcc_t *acc, int32_t key) {
+    return 2.0 * exp(key * acc->logGamma) / (exp(acc->logGamma) + 1.0);
+}
+
+static int quantileAccInit(struct quantileAcc_t *acc, int approximate) {
+    memset(acc, 0, sizeof(struct quantileAcc_t));
+    acc->approximate = approximate;
+    if(!approximate) return 0;
+
+    acc->logGamma = log((1.0 + QUANTILE_SKETCH_ACCURACY) / (1.0 - QUANTILE_SKETCH_ACCURACY));
+    acc->minKey = sketchKey(acc, FLT_TRUE_MIN);
+    acc->maxKey = sketchKey(acc, FLT_MAX);
+    acc->lo = acc->maxKey;
+    acc->hi = acc->minKey;
+    acc->pos = calloc(acc->maxKey - acc->minKey + 1, sizeof(uint64_t));
+    acc->neg = calloc(acc->maxKey - acc->minKey + 1, sizeof(uint64_t));
+    if(!acc->pos || !acc->neg) return 1;
+    return 0;
+}
+
+static void quantileAccReset(struct quantileAcc_t *acc) {
+    acc->nBases = 0;
+    acc->l = 0;
+    acc->zero = 0;
+    if(!acc->approximate || acc->lo > acc->hi) return;
+    //Only the buckets that were used need clearing
+    memset(acc->pos + (acc->lo - acc->minKey), 0, sizeof(uint64_t) * (acc->hi - acc->lo + 1));
+    memset(acc->neg + (acc->lo - acc->minKey), 0, sizeof(uint64_t) * (acc->hi - acc->lo + 1));
+    acc->lo = acc->maxKey;
+    acc->hi = acc->minKey;
+}
+
+static void quantileAccDestroy(struct quantileAcc_t *acc) {
+    free(acc->vals);
+    free(acc->pos);
+    free(acc->neg);
+}
+
+static int quantileAccAdd(struct quantileAcc_t *acc, float value, uint32_t n) {
+    struct wval_t *ptr;
+    int32_t key;
+
+    if(!n || isnan(value)) return 0;
+    acc->nBases += n;
+    if(!acc->approximate) {
+        if(acc->l == acc->m) {
+            acc->m = acc->m ? 2 * acc->m : 1024;
+            ptr = realloc(acc->vals, sizeof(struct wval_t) * acc->m);
+            if(!ptr) return 1;
+            acc->vals = ptr;
+        }
+        acc->vals[acc->l].value = value;
+        acc->vals[acc->l++].n = n;
+        return 0;
+    }
+
+    if(value == 0) {
+        acc->zero += n;
+        return 0;
+    }
+    key = sketchKey(acc, fabs(value));
+    if(key < acc->lo) acc->lo = key;
+    if(key > acc->hi) acc->hi = key;
+    if(value > 0) acc->pos[key - acc->minKey] += n;
+    else acc->neg[key - acc->minKey] += n;
+    return 0;
+}
+
+//Returns the k-th smallest per-base value (0-based), partially reordering v
+//This is quickselect with a three way partition, where each element is worth n of its value
+static float weightedSelect(struct wval_t *v, uint64_t l, uint64_t k) {
+    uint64_t lt, gt, i, nLess, nEqual;
+    struct wval_t tmp;
+    float pivot;
+
+    while(1) {
+        pivot = v[l/2].value;
+        lt = 0, gt = l, i = 0;
+        nLess = 0, nEqual = 0;
+        //v[0, lt) < pivot, v[lt, i) == pivot, v[gt, l) > pivot
+        while(i < gt) {
+            if(v[i].value < pivot) {
+                nLess += v[i].n;
+                tmp = v[lt]; v[lt++] = v[i]; v[i++] = tmp;
+            } else if(v[i].value > pivot) {
+                tmp = v[--gt]; v[gt] = v[i]; v[i] = tmp;
+            } else {
+                nEqual += v[i++].n;
+            }
+        }
+        if(k < nLess) {
+            l = lt;
+        } else if(k < nLess + nEqual) {
+            return pivot;
+        } else {
+            k -= nLess + nEqual;
+            v += gt;
+            l -= gt;
+        }
+    }
+}
+
+//Returns the approximate k-th smallest per-base value (0-based) from the sketch
+static double sketchSelect(const struct quantileAcc_t *acc, uint64_t k) {
+    uint64_t seen = 0;
+    int32_t key;
+
+    for(key=acc->hi; key>=acc->lo; key--) {
+        seen += acc->neg[key - acc->minKey];
+        if(k < seen) return -sketchValue(acc, key);
+    }
+    seen += acc->zero;
+    if(k < seen) return 0.0;
+    for(key=acc->lo; key<acc->hi; key++) {
+        seen += acc->pos[key - acc->minKey];
+        if(k < seen) return sketchValue(acc, key);
+    }
+    return sketchValue(acc, acc->hi);
+}
+
+//The q-th quantile of the per-base values, interpolating linearly between the two closest ranks, or NaN if there are none
+static double quantileAccGet(struct quantileAcc_t *acc, double q) {
+    double h, frac, lower, upper;
+    uint64_t k;
+
+    if(!acc->nBases) return strtod("NaN", NULL);
+    h = q * (acc->nBases - 1);
+    k = (uint64_t) h;
+    frac = h - k;
+    if(acc->approximate) {
+        lower = sketchSelect(acc, k);
+        upper = (frac > 0) ? sketchSelect(acc, k + 1) : lower;
+    } else {
+        lower = weightedSelect(acc->vals, acc->l, k);
+        upper = (frac > 0) ? weightedSelect(acc->vals, acc->l, k + 1) : lower;
+    }
+    return lower + frac * (upper - lower);
+}
+
+//Computes the quantiles of bins first through last-1 of the nBins in [start, end) and stores them in output
+//Returns 0 on success
+static int quantilesInRange(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, uint32_t nBins, uint32_t first, uint32_t last, const double *quantiles, uint32_t nQuantiles, int approximate, double *output) {
+    bwOverlapIterator_t *iter = NULL;
+    struct quantileAcc_t acc;
+    uint32_t i, j, pos = binStart(start, end, nBins, first), end2 = pos, s, e;
+
+    if(quantileAccInit(&acc, approximate)) goto error;
+
+    //Each bin is streamed through separately, so only the values from one bin are held at a time
+    for(i=first; i<last; i++) {
+        end2 = binStart(start, end, nBins, i+1);
+        quantileAccReset(&acc);
+        if(pos < end2) {
+            iter = bwOverlappingIntervalsIterator(fp, chrom, pos, end2, QUANTILE_BLOCKS_PER_ITERATION);
+            if(!iter) goto error;
+            while(iter->data) {
+                for(j=0; j<iter->intervals->l; j++) {
+                    s = (iter->intervals->start[j] < pos) ? pos : iter->intervals->start[j];
+                    e = (iter->intervals->end[j] > end2) ? end2 : iter->intervals->end[j];
+                    if(s >= e) continue;
+                    if(quantileAccAdd(&acc, iter->intervals->value[j], e - s)) goto error;
+                }
+                iter = bwIteratorNext(iter);
+            }
+            bwIteratorDestroy(iter);
+            iter = NULL;
+        }
+        for(j=0; j<nQuantiles; j++) output[i * nQuantiles + j] = quantileAccGet(&acc, quantiles[j]);
+        pos = end2;
+    }
+
+    quantileAccDestroy(&acc);
+    return 0;
+
+error:
+    fprintf(stderr, "got an error in bwQuantiles in the range %"PRIu32"-%"PRIu32"\n", pos, end2);
+    if(iter) bwIteratorDestroy(iter);
+    quantileAccDestroy(&acc);
+    return 1;
+}
+
+//Returns 0 if the quantiles are usable
+static int checkQuantiles(const double *quantiles, uint32_t nQuantiles) {
+    uint32_t i;
+    if(!nQuantiles) return 1;
+    for(i=0; i<nQuantiles; i++) {
+        if(!(quantiles[i] >= 0 && quantiles[i] <= 1)) return 1;
+    }
+    return 0;
+}
+
+double *bwQuantiles(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, uint32_t nBins, const double *quantiles, uint32_t nQuantiles, int approximate) {
+    double *output;
+
+    if(!fp || fp->type != 0 || !nBins || start >= end || checkQuantiles(quantiles, nQuantiles)) return NULL;
+    if(bwGetTid(fp, chrom) == (uint32_t) -1) return NULL;
+
+    output = malloc(sizeof(double) * nBins * nQuantiles);
+    if(!output) return NULL;
+    if(quantilesInRange(fp, chrom, start, end, nBins, 0, nBins, quantiles, nQuantiles, approximate, output)) {
+        free(output);
+        return NULL;
+    }
+    return output;
+}
+
+/// @cond SKIP
+//The histograms filled in by histogramVisitor()
+struct histogram_t {
+    uint32_t start, end, nBins;
+    const double *edges;
+    uint32_t nEdges;
+    double *counts;
+};
+/// @endcond
+
+//The end of the i-th output bin
+static uint32_t histogramBinEnd(const struct histogram_t *h, uint32_t i) {
+    return binStart(h->start, h->end, h->nBins, i+1);
+}
+
+//Returns the histogram bucket holding value, or -1 if it's not in any of them
+//Buckets are half-open, except the last which also holds values equal to its upper edge
+static int64_t histogramBucket(const double *edges, uint32_t nEdges, float value) {
+    uint32_t lo = 0, hi = nEdges - 1, mid;
+    if(!(value >= edges[0] && value <= edges[nEdges-1])) return -1;
+    //edges[lo] <= value < edges[hi], or value is the last edge
+    while(hi - lo > 1) {
+        mid = lo + (hi - lo) / 2;
+        if(value < edges[mid]) hi = mid;
+        else lo = mid;
+    }
+    return lo;
+}
+
+//Adds each base of an entry to the histogram of the output bin it's in
+static int histogramVisitor(uint32_t start, uint32_t end, float value, void *data) {
+    struct histogram_t *h = (struct histogram_t*) data;
+    int64_t bucket = histogramBucket(h->edges, h->nEdges, value);
+    uint32_t bin, end2;
+
+    if(start < h->start) start = h->start;
+    if(end > h->end) end = h->end;
+    if(bucket < 0 || start >= end) return 0;
+
+    //Rounding can put the estimate one bin off
+    bin = ((double)(start - h->start)) * h->nBins / (h->end - h->start);
+    if(bin >= h->nBins) bin = h->nBins - 1;
+    while(bin && histogramBinEnd(h, bin-1) > start) bin--;
+    while(histogramBinEnd(h, bin) <= start) bin++;
+
+    for(; start < end; bin++) {
+        end2 = histogramBinEnd(h, bin);
+        if(end2 > end) end2 = end;
+        h->counts[(uint64_t) bin * (h->nEdges - 1) + bucket] += end2 - start;
+        start = end2;
+    }
+    return 0;
+}
+
+double *bwHistogram(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, uint32_t nBins, const double *edges, uint32_t nEdges) {
+    struct histogram_t h;
+    uint32_t i;
+
+    if(!fp || fp->type != 0 || !nBins || start >= end || nEdges < 2) return NULL;
+    for(i=1; i<nEdges; i++) {
+        if(!(edges[i-1] < edges[i])) return NULL;
+    }
+
+    h.start = start;
+    h.end = end;
+    h.nBins = nBins;
+    h.edges = edges;
+    h.nEdges = nEdges;
+    h.counts = calloc((uint64_t) nBins * (nEdges - 1), sizeof(double));
+    if(!h.counts) return NULL;
+
+    //A single pass over the blocks, so nothing is stored besides the counts
+    if(bwVisitOverlappingValues(fp, chrom, start, end, histogramVisitor, &h)) {
+        fprintf(stderr, "got an error in bwHistogram in the range %"PRIu32"-%"PRIu32"\n", start, end);
+        free(h.counts);
+        return NULL;
+    }
+    return h.counts;
+}
+
+double *bwLogSpacedEdges(double lo, double hi, uint32_t nEdges) {
+    double *edges, step;
+    uint32_t i;
+
+    if(!(lo > 0 && lo < hi) || isinf(hi) || nEdges < 2) return NULL;
+    edges = malloc(sizeof(double) * nEdges);
+    if(!edges) return NULL;
+
+    step = (log(hi) - log(lo)) / (nEdges - 1);
+    for(i=0; i<nEdges; i++) edges[i] = exp(log(lo) + i * step);
+    //Avoid rounding at the ends, which could exclude lo or hi themselves
+    edges[0] = lo;
+    edges[nEdges-1] = hi;
+    return edges;
+}
+
+//Adds every record in the blocks of a zoom level to the totals of its chromosome
+//Returns 0 on success
+static int summaryAddZoom(bigWigFile_t *fp, bwOverlapBlock_t *o, struct exactAcc_t *acc, uint32_t nKeys) {
+    uint64_t i, nBlocks, batchEnd = 0;
+    void *buf = NULL, *compBuf = NULL, *block = NULL;
+    size_t compSz = 0;
+    int compressed = 0;
+    uLongf sz;
+    uint32_t *p, *pEnd;
+    struct val_t v;
+
+    if(fp->hdr->bufSize) {
+        compressed = 1;
+        buf = malloc(fp->hdr->bufSize);
+        if(!buf) goto error;
+    }
+
+    for(i=0; i<o->n; i++) {
+        //Blocks are fetched in batches, then decompressed one at a time
+        if(i == batchEnd) {
+            nBlocks = bwReadBlocks(fp, o, i, &compBuf, &compSz);
+            if(!nBlocks) goto error;
+            batchEnd = i + nBlocks;
+            block = compBuf;
+        } else {
+            block = (char*)block + o->size[i-1];
+        }
+
+        if(compressed) {
+            sz = fp->hdr->bufSize;
+            if(uncompress(buf, &sz, block, o->size[i]) != Z_OK) goto error;
+            p = buf;
+        } else {
+            sz = o->size[i];
+            p = block;
+        }
+
+        pEnd = p + 8 * (sz / 32);
+        for(; p < pEnd; p += 8) {
+            if(p[0] >= nKeys) goto error;
+            v.start = p[1];
+            v.end = p[2];
+            v.nBases = p[3];
+            v.min = ((float*) p)[4];
+            v.max = ((float*) p)[5];
+            v.sum = ((float*) p)[6];
+            v.sumsq = ((float*) p)[7];
+            if(exactAddRecord(fp, bwGetChrom(fp, p[0]), &v, acc + p[0])) goto error;
+        }
+    }
+
+    free(buf);
+    free(compBuf);
+    return 0;
+
+error:
+    free(buf);
+    free(compBuf);
+    return 1;
+}
+
+static int summaryVisitor(uint32_t start, uint32_t end, float value, void *data) {
+    exactAddValue((struct exactAcc_t*) data, end - start, value);
+    return 0;
+}
+
+bwChromSummary_t *bwChromSummaries(bigWigFile_t *fp) {
+    bwChromSummary_t *output = NULL;
+    struct exactAcc_t *acc = NULL;
+    bwOverlapBlock_t *blocks = NULL;
+    bwRTree_t *idx;
+    const char *chrom;
+    int32_t level = -1;
+    uint32_t tid, nKeys;
+    uint16_t i;
+
+    if(!fp || fp->type != 0 || fp->isWrite || !fp->cl) return NULL;
+    nKeys = fp->cl->nKeys;
+    acc = calloc(nKeys + 1, sizeof(struct exactAcc_t));
+    output = malloc(sizeof(bwChromSummary_t) * (nKeys + 1));
+    if(!acc || !output) goto error;
+
+    //The coarsest level has the fewest records to read
+    for(i=0; i<fp->hdr->nLevels; i++) {
+        if(level == -1 || fp->hdr->zoomHdrs->level[i] > fp->hdr->zoomHdrs->level[level]) level = i;
+    }
+
+    if(level != -1) {
+        idx = bwGetZoomIndex(fp, level);
+        if(!idx) goto error;
+        blocks = bwIndexAllBlocks(fp, idx);
+        if(!blocks) goto error;
+        if(summaryAddZoom(fp, blocks, acc, nKeys)) goto error;
+        destroyBWOverlapBlock(blocks);
+        blocks = NULL;
+    } else {
+        for(tid=0; tid<nKeys; tid++) {
+            chrom = bwGetChrom(fp, tid);
+            if(!chrom) goto error;
+            if(bwVisitOverlappingValues(fp, chrom, 0, bwGetChromLen(fp, tid), summaryVisitor, acc + tid)) goto error;
+        }
+    }
+
+    for(tid=0; tid<nKeys; tid++) {
+        output[tid].nBasesCovered = acc[tid].nBases;
+        output[tid].minVal = acc[tid].nBases ? acc[tid].min : strtod("NaN", NULL);
+        output[tid].maxVal = acc[tid].nBases ? acc[tid].max : strtod("NaN", NULL);
+        output[tid].sumData = acc[tid].sum;
+        output[tid].sumSquared = acc[tid].sumsq;
+    }
+    free(acc);
+    return output;
+
+error:
+    fprintf(stderr, "got an error in bwChromSummaries\n");
+    destroyBWOverlapBlock(blocks);
+    free(acc);
+    free(output);
+    return NULL;
+}
+
+void bwDestroyPrefixSums(bwPrefixSums_t *ps) {
+    if(!ps) return;
+    free(ps->offset);
+    free(ps->start);
+    free(ps->end);
+    free(ps->value);
+    free(ps->sum);
+    free(ps->covered);
+    free(ps);
+}
+
+//Returns NULL on error
+static bwPrefixSums_t *prefixSumsInit(uint32_t nKeys) {
+    bwPrefixSums_t *ps = calloc(1, sizeof(bwPrefixSums_t));
+    if(!ps) return NULL;
+    ps->nKeys = nKeys;
+    ps->offset = calloc(nKeys + 1, sizeof(uint64_t));
+    if(!ps->offset) {
+        free(ps);
+        return NULL;
+    }
+    return ps;
+}
+
+//Make room for m records. Returns 0 on success
+static int prefixSumsResize(bwPrefixSums_t *ps, uint64_t m) {
+    void *p;
+    p = realloc(ps->start, m * sizeof(uint32_t));
+    if(!p) return 1;
+    ps->start = p;
+    p = realloc(ps->end, m * sizeof(uint32_t));
+    if(!p) return 1;
+    ps->end = p;
+    p = realloc(ps->value, m * sizeof(float));
+    if(!p) return 1;
+    ps->value = p;
+    p = realloc(ps->sum, m * sizeof(double));
+    if(!p) return 1;
+    ps->sum = p;
+    p = realloc(ps->covered, m * sizeof(uint64_t));
+    if(!p) return 1;
+    ps->covered = p;
+    return 0;
+}
+
+//Fill in the cumulative sums once all records are present
+//Records on a chromosome must be sorted and not overlap, otherwise the sums can't be used. Returns 0 on success
+static int prefixSumsFinish(bwPrefixSums_t *ps) {
+    uint64_t i;
+    uint32_t tid;
+    double total;
+    uint64_t covered;
+
+    for(tid=0; tid<ps->nKeys; tid++) {
+        total = 0.0;
+        covered = 0;
+        for(i=ps->offset[tid]; i<ps->offset[tid+1]; i++) {
+            if(ps->end[i] <= ps->start[i]) return 1;
+            if(i > ps->offset[tid] && ps->start[i] < ps->end[i-1]) return 2;
+            total += ((double) ps->value[i]) * (ps->end[i] - ps->start[i]);
+            covered += ps->end[i] - ps->start[i];
+            ps->sum[i] = total;
+            ps->covered[i] = covered;
+        }
+    }
+    return 0;
+}
+
+//Attach prefix sums to a file, unless some are already attached
+static int prefixSumsPublish(bigWigFile_t *fp, bwPrefixSums_t *ps) {
+    bwPrefixSums_t *expected = NULL;
+    if(!__atomic_compare_exchange_n(&(fp->hdr->prefixSums), &expected, ps, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) bwDestroyPrefixSums(ps);
+    return 0;
+}
+
+//Each chromosome is streamed a few blocks at a time, so only the prefix sum arrays themselves are held in memory
+int bwCreatePrefixSums(bigWigFile_t *fp) {
+    bwPrefixSums_t *ps = NULL;
+    bwOverlapIterator_t *iter = NULL;
+    bwOverlappingIntervals_t *o;
+    uint64_t n = 0, m = 0;
+    uint32_t tid;
+    const char *chrom;
+
+    if(!fp || fp->isWrite || fp->type != 0) return 1;
+    ps = prefixSumsInit(fp->cl->nKeys);
+    if(!ps) return 2;
+
+    for(tid=0; tid<ps->nKeys; tid++) {
+        chrom = bwGetChrom(fp, tid);
+        if(!chrom) goto error;
+        iter = bwOverlappingIntervalsIterator(fp, chrom, 0, bwGetChromLen(fp, tid), PREFIXSUM_BLOCKS_PER_ITERATION);
+        if(!iter) goto error;
+        while(iter->data) {
+            o = iter->intervals;
+            if(o->l) {
+                if(n + o->l > m) {
+                    m = n + o->l;
+                    if(m < 2*n) m = 2*n;
+                    if(prefixSumsResize(ps, m)) goto error;
+                }
+                memcpy(ps->start + n, o->start, o->l * sizeof(uint32_t));
+                memcpy(ps->end + n, o->end, o->l * sizeof(uint32_t));
+                memcpy(ps->value + n, o->value, o->l * sizeof(float));
+                n += o->l;
+            }
+            iter = bwIteratorNext(iter);
+            if(!iter) goto error;
+        }
+        bwIteratorDestroy(iter);
+        iter = NULL;
+        ps->offset[tid+1] = n;
+    }
+    if(prefixSumsFinish(ps)) goto error;
+
+    return prefixSumsPublish(fp, ps);
+
+error:
+    if(iter) bwIteratorDestroy(iter);
+    bwDestroyPrefixSums(ps);
+    return 3;
+}
+
+//gzread() and gzwrite() take unsigned lengths, so large arrays are handled in pieces
+//Returns 0 on success
+static int gzWriteAll(gzFile f, const void *buf, uint64_t len) {
+    unsigned int l;
+    while(len) {
+        l = (len > (1<<30)) ? (1<<30) : len;
+        if(gzwrite(f, buf, l) != (int) l) return 1;
+        buf = (const char*) buf + l;
+        len -= l;
+    }
+    return 0;
+}
+
+static int gzReadAll(gzFile f, void *buf, uint64_t len) {
+    unsigned int l;
+    while(len) {
+        l = (len > (1<<30)) ? (1<<30) : len;
+        if(gzread(f, buf, l) != (int) l) return 1;
+        buf = (char*) buf + l;
+        len -= l;
+    }
+    return 0;
+}
+
+//The layout is the magic number, the data and index offsets and number of chromosomes (to check that it matches the file it's used with)
+//and then for each chromosome its length, the number of records and their starts, ends and values. The cumulative sums are recomputed when the file is read.
+int bwWritePrefixSums(bigWigFile_t *fp, const char *fname) {
+    bwPrefixSums_t *ps;
+    uint32_t magic = PREFIXSUM_MAGIC, tid, len;
+    uint64_t n;
+    gzFile f;
+
+    if(!fp || fp->isWrite) return 1;
+    ps = __atomic_load_n(&(fp->hdr->prefixSums), __ATOMIC_ACQUIRE);
+    if(!ps) return 1;
+    f = gzopen(fname, "wb");
+    if(!f) return 2;
+
+    if(gzWriteAll(f, &magic, sizeof(uint32_t))) goto error;
+    if(gzWriteAll(f, &(fp->hdr->dataOffset), sizeof(uint64_t))) goto error;
+    if(gzWriteAll(f, &(fp->hdr->indexOffset), sizeof(uint64_t))) goto error;
+    if(gzWriteAll(f, &(ps->nKeys), sizeof(uint32_t))) goto error;
+    for(tid=0; tid<ps->nKeys; tid++) {
+        len = bwGetChromLen(fp, tid);
+        n = ps->offset[tid+1] - ps->offset[tid];
+        if(gzWriteAll(f, &len, sizeof(uint32_t))) goto error;
+        if(gzWriteAll(f, &n, sizeof(uint64_t))) goto error;
+        if(gzWriteAll(f, ps->start + ps->offset[tid], n * sizeof(uint32_t))) goto error;
+        if(gzWriteAll(f, ps->end + ps->offset[tid], n * sizeof(uint32_t))) goto error;
+        if(gzWriteAll(f, ps->value + ps->offset[tid], n * sizeof(float))) goto error;
+    }
+
+    if(gzclose(f) != Z_OK) return 4;
+    return 0;
+
+error:
+    gzclose(f);
+    return 3;
+}
+
+int bwReadPrefixSums(bigWigFile_t *fp, const char *fname) {
+    bwPrefixSums_t *ps = NULL;
+    uint32_t magic, nKeys, tid, len;
+    uint64_t dataOffset, indexOffset, n, total = 0, m = 0;
+    gzFile f;
+
+    if(!fp || fp->isWrite || fp->type != 0) return 1;
+    f = gzopen(fname, "rb");
+    if(!f) return 2;
+
+    if(gzReadAll(f, &magic, sizeof(uint32_t)) || magic != PREFIXSUM_MAGIC) goto error;
+    if(gzReadAll(f, &dataOffset, sizeof(uint64_t)) || dataOffset != fp->hdr->dataOffset) goto error;
+    if(gzReadAll(f, &indexOffset, sizeof(uint64_t)) || indexOffset != fp->hdr->indexOffset) goto error;
+    if(gzReadAll(f, &nKeys, sizeof(uint32_t)) || nKeys != fp->cl->nKeys) goto error;
+
+    ps = prefixSumsInit(nKeys);
+    if(!ps) goto error;
+    for(tid=0; tid<nKeys; tid++) {
+        if(gzReadAll(f, &len, sizeof(uint32_t)) || len != bwGetChromLen(fp, tid)) goto error;
+        if(gzReadAll(f, &n, sizeof(uint64_t))) goto error;
+        if(total + n > m) {
+            m = total + n;
+            if(m < 2*total) m = 2*total;
+            if(prefixSumsResize(ps, m)) goto error;
+        }
+        if(gzReadAll(f, ps->start + total, n * sizeof(uint32_t))) goto error;
+        if(gzReadAll(f, ps->end + total, n * sizeof(uint32_t))) goto error;
+        if(gzReadAll(f, ps->value + total, n * sizeof(float))) goto error;
+        total += n;
+        ps->offset[tid+1] = total;
+    }
+    gzclose(f);
+    f = NULL;
+    if(prefixSumsFinish(ps)) goto error;
+
+    return prefixSumsPublish(fp, ps);
+
+error:
+    if(f) gzclose(f);
+    bwDestroyPrefixSums(ps);
+    return 3;
+}
+
+//The first record in [lo, hi) whose end (or start, if useStart is set) is greater than (or at least, if useStart is set) pos
+static uint64_t prefixSumsSearch(const uint32_t *v, uint64_t lo, uint64_t hi, uint32_t pos, int useStart) {
+    uint64_t mid;
+    while(lo < hi) {
+        mid = lo + (hi-lo)/2;
+        if(useStart ? (v[mid] < pos) : (v[mid] <= pos)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+//The sum of values and number of bases covered in [start, end), clipping the records at either end
+static void prefixSumsQuery(const bwPrefixSums_t *ps, uint32_t tid, uint32_t start, uint32_t end, double *total, uint64_t *covered) {
+    uint64_t first = ps->offset[tid], lo, hi;
+
+    lo = prefixSumsSearch(ps->end, first, ps->offset[tid+1], start, 0);
+    hi = prefixSumsSearch(ps->start, lo, ps->offset[tid+1], end, 1);
+    *total = 0.0;
+    *covered = 0;
+    if(lo >= hi) return;
+
+    *total = ps->sum[hi-1];
+    *covered = ps->covered[hi-1];
+    if(lo > first) {
+        *total -= ps->sum[lo-1];
+        *covered -= ps->covered[lo-1];
+    }
+    if(ps->start[lo] < start) {
+        *total -= ((double) ps->value[lo]) * (start - ps->start[lo]);
+        *covered -= start - ps->start[lo];
+    }
+    if(ps->end[hi-1] > end) {
+        *total -= ((double) ps->value[hi-1]) * (ps->end[hi-1] - end);
+        *covered -= ps->end[hi-1] - end;
+    }
+}
+
+//Returns NULL on error, otherwise a double* that needs to be free()d
+//Bins without any covered bases are NaN, as in bwStatsFromFull()
+static double *bwStatsFromPrefixSums(const bwPrefixSums_t *ps, uint32_t tid, uint32_t start, uint32_t end, uint32_t nBins, enum bwStatsType type) {
+    double *output = malloc(sizeof(double)*nBins), total;
+    uint32_t i, pos = start, end2;
+    uint64_t covered;
+    if(!output) return NULL;
+
+    for(i=0; i<nBins; i++) {
+        end2 = start + ((double)(end-start)*(i+1))/((int) nBins);
+        prefixSumsQuery(ps, tid, pos, end2, &total, &covered);
+        if(!covered) {
+            output[i] = strtod("NaN", NULL);
+        } else if(type == mean) {
+            output[i] = total/covered;
+        } else if(type == coverage) {
+            output[i] = ((double) covered)/(end2-pos);
+        } else {
+            output[i] = total;
+        }
+        pos = end2;
+    }
 
     return output;
 }
@@ -530,8 +1429,110 @@ double *bwStatsFromFull(bigWigFile_t *fp, const char *chrom, uint32_t start, uin
 double *bwStats(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, uint32_t nBins, enum bwStatsType type) {
     int32_t level = determineZoomLevel(fp, ((double)(end-start))/((int) nBins));
     uint32_t tid = bwGetTid(fp, chrom);
+    bwPrefixSums_t *ps = __atomic_load_n(&(fp->hdr->prefixSums), __ATOMIC_ACQUIRE);
+    const double half = 0.5;
     if(tid == (uint32_t) -1) return NULL;
 
+    //Zoom levels can't give medians, so large bins use the sketch instead
+    if(type == median) return bwQuantiles(fp, chrom, start, end, nBins, &half, 1, level != -1);
+    //Exact and constant time per bin
+    if(ps && tid < ps->nKeys && (type == mean || type == coverage || type == sum)) return bwStatsFromPrefixSums(ps, tid, start, end, nBins, type);
     if(level == -1) return bwStatsFromFull(fp, chrom, start, end, nBins, type);
     return bwStatsFromZoom(fp, level, tid, start, end, nBins, type);
 }
+
+/// @cond SKIP
+//The bins computed by one thread in bwStatsParallel()
+struct statsJob_t {
+    bigWigFile_t *fp;
+    const char *chrom;
+    uint32_t tid, start, end, nBins, first, last;
+    int32_t level;
+    enum bwStatsType type;
+    double *output;
+    int rv;
+};
+/// @endcond
+
+//This makes the same choices as bwStats()
+static void *statsWorker(void *arg) {
+    struct statsJob_t *job = (struct statsJob_t*) arg;
+    const double half = 0.5;
+
+    if(job->type == median) {
+        job->rv = quantilesInRange(job->fp, job->chrom, job->start, job->end, job->nBins, job->first, job->last, &half, 1, job->level != -1, job->output);
+    } else if(job->level == -1) {
+        statsFromFull(job->fp, job->chrom, job->start, job->end, job->nBins, job->first, job->last, job->type, job->output);
+    } else {
+        job->rv = statsFromZoom(job->fp, job->level, job->tid, job->start, job->end, job->nBins, job->first, job->last, job->type, job->output);
+    }
+    return NULL;
+}
+
+double *bwStatsParallel(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, uint32_t nBins, enum bwStatsType type, int nThreads) {
+    int32_t level = determineZoomLevel(fp, ((double)(end-start))/((int) nBins));
+    uint32_t tid = bwGetTid(fp, chrom);
+    bwPrefixSums_t *ps = __atomic_load_n(&(fp->hdr->prefixSums), __ATOMIC_ACQUIRE);
+    struct statsJob_t *jobs = NULL;
+    pthread_t *threads = NULL;
+    double *output = NULL;
+    int i, nStarted = 0;
+    long nCPUs;
+
+    if(tid == (uint32_t) -1 || !nBins || start >= end) return NULL;
+    if(ps && tid < ps->nKeys && (type == mean || type == coverage || type == sum)) return bwStatsFromPrefixSums(ps, tid, start, end, nBins, type);
+
+    if(nThreads <= 0) {
+        nCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+        nThreads = (nCPUs > 0) ? nCPUs : 1;
+    }
+    if((uint32_t) nThreads > nBins) nThreads = nBins;
+
+    output = malloc(sizeof(double) * nBins);
+    jobs = calloc(nThreads, sizeof(struct statsJob_t));
+    threads = malloc(sizeof(pthread_t) * nThreads);
+    if(!output || !jobs || !threads) goto error;
+
+    //Each thread gets a contiguous chunk of bins and its own handle, so that reads and decompression buffers aren't shared
+    for(i=0; i<nThreads; i++) {
+        jobs[i].fp = i ? bwClone(fp) : fp;
+        if(!jobs[i].fp) goto error;
+        jobs[i].chrom = chrom;
+        jobs[i].tid = tid;
+        jobs[i].start = start;
+        jobs[i].end = end;
+        jobs[i].nBins = nBins;
+        jobs[i].first = ((uint64_t) nBins * i) / nThreads;
+        jobs[i].last = ((uint64_t) nBins * (i+1)) / nThreads;
+        jobs[i].level = level;
+        jobs[i].type = type;
+        jobs[i].output = output;
+    }
+
+    //The calling thread takes the first chunk
+    for(i=1; i<nThreads; i++) {
+        if(pthread_create(threads + i, NULL, statsWorker, jobs + i)) break;
+        nStarted++;
+    }
+    if(nStarted == nThreads - 1) statsWorker(jobs);
+    for(i=1; i<=nStarted; i++) pthread_join(threads[i], NULL);
+    if(nStarted != nThreads - 1) goto error;
+
+    for(i=0; i<nThreads; i++) {
+        if(jobs[i].rv) goto error;
+    }
+    for(i=1; i<nThreads; i++) bwClose(jobs[i].fp);
+    free(jobs);
+    free(threads);
+    return output;
+
+error:
+    fprintf(stderr, "got an error in bwStatsParallel\n");
+    if(jobs) {
+        for(i=1; i<nThreads; i++) bwClose(jobs[i].fp);
+    }
+    free(jobs);
+    free(threads);
+    free(output);
+    return NULL;
+}
@@ -0,0 +1,631 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <float.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "bigWig.h"
+#include "bwCommon.h"
+
+//The amount of text read at a time. Each chunk of a bedGraph file is parsed as a unit, possibly on another thread
+#define TEXT_CHUNK_SIZE (1<<22)
+//The number of wiggle entries handed to the writer at a time
+#define WIG_BATCH_SIZE (1<<16)
+
+//Values of textChunk_t.state
+#define CHUNK_FREE 0 //The chunk can be given more text
+#define CHUNK_FILLED 1 //The text is waiting to be, or is being, parsed
+#define CHUNK_PARSED 2 //The entries are waiting to be added to the file
+
+/// @cond SKIP
+//Chromosome names sorted for lookups, since bwGetTid() compares a name against every chromosome in turn
+typedef struct {
+    const char *name;
+    uint32_t tid;
+} chromEntry_t;
+
+typedef struct {
+    chromEntry_t *entries;
+    uint32_t n;
+} chromIndex_t;
+
+//A chunk of complete lines of text and the entries parsed from them
+typedef struct {
+    char *text; //Not NUL terminated, but there's always at least one spare byte after the text
+    size_t l, m; //The length of the text and the size of the buffer
+    uint32_t *tid, *start, *end;
+    float *value;
+    uint32_t n, mEntries; //The number of entries and the number that the arrays can hold
+    uint64_t nLines; //The number of lines parsed
+    int rv; //Not 0 if line nLines couldn't be parsed
+    int state;
+} textChunk_t;
+
+//Splits input into chunks that end at a newline
+typedef struct {
+    FILE *in;
+    char *carry; //The start of a line that didn't fit in the last chunk
+    size_t carryL, carryM;
+    int eof;
+} textReader_t;
+
+//Chunks are parsed by a set of threads and added to the file, in order, by the caller
+struct textPool_t {
+    const chromIndex_t *chroms;
+    pthread_mutex_t lock;
+    pthread_cond_t cond; //Signalled whenever a chunk changes state
+    pthread_t *threads;
+    int nThreads, nStarted;
+    textChunk_t *chunks; //A ring of chunks, chunk i going in slot i%nChunks
+    uint32_t nChunks;
+    uint64_t nRead, nClaimed; //The number of chunks read and started being parsed
+    int done; //Set when the threads should exit
+};
+
+//The current section of a wiggle file and the entries not yet added from it
+typedef struct {
+    int type; //2 for variableStep, 3 for fixedStep (matching the block types they're written as) and 0 before the first declaration
+    uint32_t tid, start, step, span;
+    int added; //Set once entries from this section have been added, after which they're appended
+    uint32_t *starts;
+    float *values;
+    uint32_t n;
+} wigSection_t;
+/// @endcond
+
+//Values can be exactly computed with a single float division if both the digits and the power of 10 are exact floats
+static const float pow10f[11] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+
+static inline int isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline char *skipBlanks(char *p, char *eol) {
+    while(p < eol && isBlank(*p)) p++;
+    return p;
+}
+
+static inline char *nextBlank(char *p, char *eol) {
+    while(p < eol && !isBlank(*p)) p++;
+    return p;
+}
+
+//Returns 1 for empty lines, comments and track and browser lines
+static int skipLine(char *p, char *eol) {
+    p = skipBlanks(p, eol);
+    if(p == eol || *p == '#') return 1;
+    if(eol - p >= 5 && strncmp(p, "track", 5) == 0 && (eol - p == 5 || isBlank(p[5]))) return 1;
+    if(eol - p >= 7 && strncmp(p, "browser", 7) == 0 && (eol - p == 7 || isBlank(p[7]))) return 1;
+    return 0;
+}
+
+//Parse an unsigned integer in [*p, eol), which must be followed by a blank or the end of the line, and move *p past it
+//Returns 0 on success
+static int parseUint(char **p, char *eol, uint32_t *val) {
+    char *s = *p;
+    uint64_t v = 0;
+    if(s == eol || *s < '0' || *s > '9') return 1;
+    for(; s < eol && *s >= '0' && *s <= '9'; s++) {
+        v = 10*v + (*s - '0');
+        if(v > (uint32_t) -1) return 1;
+    }
+    if(s < eol && !isBlank(*s)) return 1;
+    *val = v;
+    *p = s;
+    return 0;
+}
+
+//Parse the number in [s, e), which must be followed by a blank, newline or the spare byte after a chunk's text
+//Plain decimals whose digits, ignoring the decimal point, form an integer no larger than 2^24 and that have at most 10 decimal places are converted directly (since both operands are then exact floats, a single correctly rounded division gives the same result as strtof()), anything else by strtof()
+//Returns 0 on success
+static int parseFloat(char *s, char *e, float *val) {
+    char *p = s, *q, c;
+    uint32_t mant = 0, nFrac = 0;
+    int neg = 0, nDigits = 0, fast = (FLT_EVAL_METHOD == 0);
+
+    if(p < e && (*p == '-' || *p == '+')) neg = (*p++ == '-');
+    for(; p < e && *p >= '0' && *p <= '9'; p++, nDigits++) {
+        if(fast && mant <= ((1u<<24) - (uint32_t) (*p - '0'))/10) mant = 10*mant + (*p - '0');
+        else fast = 0;
+    }
+    if(p < e && *p == '.') {
+        for(p++; p < e && *p >= '0' && *p <= '9'; p++, nDigits++, nFrac++) {
+            if(fast && nFrac < 10 && mant <= ((1u<<24) - (uint32_t) (*p - '0'))/10) mant = 10*mant + (*p - '0');
+            else fast = 0;
+        }
+    }
+    if(fast && nDigits && p == e) {
+        *val = (float) mant / pow10f[nFrac];
+        if(neg) *val = -*val;
+        return 0;
+    }
+
+    c = *e;
+    *e = '\0';
+    *val = strtof(s, &q);
+    *e = c;
+    return (s == e || q != e);
+}
+
+//Make room for at least one more entry
+//Returns 0 on success
+static int growEntries(textChunk_t *c) {
+    uint32_t m = c->mEntries ? 2*c->mEntries : 4096;
+    void *tmp;
+    tmp = realloc(c->tid, m * sizeof(uint32_t));
+    if(!tmp) return 1;
+    c->tid = tmp;
+    tmp = realloc(c->start, m * sizeof(uint32_t));
+    if(!tmp) return 1;
+    c->start = tmp;
+    tmp = realloc(c->end, m * sizeof(uint32_t));
+    if(!tmp) return 1;
+    c->end = tmp;
+    tmp = realloc(c->value, m * sizeof(float));
+    if(!tmp) return 1;
+    c->value = tmp;
+    c->mEntries = m;
+    return 0;
+}
+
+static void destroyChunk(textChunk_t *c) {
+    free(c->text);
+    free(c->tid);
+    free(c->start);
+    free(c->end);
+    free(c->value);
+}
+
+//Fill a chunk with the next complete lines of input (or whatever's left, at the end)
+//c->l is 0 once there's nothing left
+//Returns 0 on success
+static int readChunk(textReader_t *r, textChunk_t *c) {
+    size_t nRead, i;
+    char *tmp;
+
+    //Chunks in the ring can be smaller than the one the carry came from, and there must be room to read more after it
+    if(c->m <= r->carryL + 1) {
+        tmp = realloc(c->text, r->carryL + TEXT_CHUNK_SIZE);
+        if(!tmp) return 1;
+        c->text = tmp;
+        c->m = r->carryL + TEXT_CHUNK_SIZE;
+    }
+    if(r->carryL) memcpy(c->text, r->carry, r->carryL);
+    c->l = r->carryL;
+    r->carryL = 0;
+
+    while(!r->eof) {
+        //Keep a spare byte
+        nRead = fread(c->text + c->l, 1, c->m - c->l - 1, r->in);
+        c->l += nRead;
+        if(!nRead) {
+            if(ferror(r->in)) return 2;
+            r->eof = 1;
+            break;
+        }
+
+        //Anything after the last newline goes in the next chunk
+        for(i=c->l; i>0 && c->text[i-1] != '\n'; i--);
+        if(i == c->l) break;
+        if(i) {
+            if(r->carryM < c->l - i) {
+                tmp = realloc(r->carry, c->l - i);
+                if(!tmp) return 1;
+                r->carry = tmp;
+                r->carryM = c->l - i;
+            }
+            memcpy(r->carry, c->text + i, c->l - i);
+            r->carryL = c->l - i;
+            c->l = i;
+            break;
+        }
+
+        //A single line longer than the buffer
+        if(c->l + 1 == c->m) {
+            tmp = realloc(c->text, 2*c->m);
+            if(!tmp) return 1;
+            c->text = tmp;
+            c->m *= 2;
+        }
+    }
+    return 0;
+}
+
+static int chromEntryCmp(const void *a, const void *b) {
+    const chromEntry_t *x = a, *y = b;
+    int rv = strcmp(x->name, y->name);
+    if(rv) return rv;
+    return (x->tid < y->tid) ? -1 : (x->tid > y->tid);
+}
+
+//Sort the chromosome names of a file being written
+//Returns 0 on success
+static int createChromIndex(bigWigFile_t *fp, chromIndex_t *idx) {
+    uint32_t i;
+    idx->n = fp->cl->nKeys;
+    idx->entries = malloc(idx->n * sizeof(chromEntry_t) + 1);
+    if(!idx->entries) return 1;
+    for(i=0; i<idx->n; i++) {
+        idx->entries[i].name = fp->cl->chrom[i];
+        idx->entries[i].tid = i;
+    }
+    qsort(idx->entries, idx->n, sizeof(chromEntry_t), chromEntryCmp);
+    return 0;
+}
+
+//Returns the entry for chrom, or NULL if there's no such chromosome. Should a name be listed twice, the first chromosome with it is found, as with bwGetTid()
+static const chromEntry_t *chromIndexGet(const chromIndex_t *idx, const char *chrom) {
+    uint32_t lo = 0, hi = idx->n, mid;
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if(strcmp(idx->entries[mid].name, chrom) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    if(lo == idx->n || strcmp(idx->entries[lo].name, chrom) != 0) return NULL;
+    return idx->entries + lo;
+}
+
+//Parse every line of a chunk of a bedGraph file
+//Returns 0 on success, otherwise c->rv is set and c->nLines is the line that couldn't be parsed
+static int parseBedGraphChunk(const chromIndex_t *chroms, textChunk_t *c) {
+    char *p = c->text, *end = c->text + c->l, *eol, *f, save;
+    const chromEntry_t *chrom = NULL;
+    size_t chromL = 0;
+
+    c->n = 0;
+    c->nLines = 0;
+    c->rv = 0;
+    for(; p < end; p = eol + 1) {
+        eol = memchr(p, '\n', end - p);
+        if(!eol) eol = end;
+        c->nLines++;
+        if(skipLine(p, eol)) continue;
+        if(c->n == c->mEntries && growEntries(c)) goto error;
+
+        //Consecutive lines are nearly always on the same chromosome
+        p = skipBlanks(p, eol);
+        f = nextBlank(p, eol);
+        if(!chrom || (size_t) (f - p) != chromL || memcmp(p, chrom->name, chromL) != 0) {
+            save = *f;
+            *f = '\0';
+            chrom = chromIndexGet(chroms, p);
+            *f = save;
+            if(!chrom) goto error;
+            chromL = f - p;
+        }
+
+        p = skipBlanks(f, eol);
+        if(parseUint(&p, eol, c->start + c->n)) goto error;
+        p = skipBlanks(p, eol);
+        if(parseUint(&p, eol, c->end + c->n)) goto error;
+        p = skipBlanks(p, eol);
+        f = nextBlank(p, eol);
+        if(parseFloat(p, f, c->value + c->n)) goto error;
+        if(skipBlanks(f, eol) != eol) goto error;
+        if(c->end[c->n] <= c->start[c->n]) goto error;
+
+        c->tid[c->n++] = chrom->tid;
+    }
+    return 0;
+
+error:
+    c->rv = 1;
+    return 1;
+}
+
+//Add the entries from a chunk, continuing the last block where they're on the same chromosome as the previous entry
+//Returns 0 on success
+static int addChunkEntries(bigWigFile_t *fp, textChunk_t *c, uint32_t *lastTid) {
+    uint32_t i, j;
+    const char *chrom;
+
+    for(i=0; i<c->n; i=j) {
+        for(j=i+1; j<c->n && c->tid[j] == c->tid[i]; j++);
+        if(c->tid[i] != *lastTid) {
+            chrom = fp->cl->chrom[c->tid[i]];
+            if(bwAddIntervals(fp, &chrom, c->start+i, c->end+i, c->value+i, 1)) return 1;
+            *lastTid = c->tid[i];
+            i++;
+        }
+        if(i < j && bwAppendIntervals(fp, c->start+i, c->end+i, c->value+i, j-i)) return 2;
+    }
+    return 0;
+}
+
+static void *parseWorker(void *arg) {
+    struct textPool_t *pool = (struct textPool_t*) arg;
+    textChunk_t *c;
+
+    pthread_mutex_lock(&(pool->lock));
+    while(1) {
+        while(pool->nClaimed == pool->nRead && !pool->done) pthread_cond_wait(&(pool->cond), &(pool->lock));
+        if(pool->nClaimed == pool->nRead) break;
+        c = pool->chunks + pool->nClaimed++ % pool->nChunks;
+        pthread_mutex_unlock(&(pool->lock));
+
+        parseBedGraphChunk(pool->chroms, c);
+
+        pthread_mutex_lock(&(pool->lock));
+        c->state = CHUNK_PARSED;
+        pthread_cond_broadcast(&(pool->cond));
+    }
+    pthread_mutex_unlock(&(pool->lock));
+    return NULL;
+}
+
+static void destroyTextPool(struct textPool_t *pool) {
+    uint32_t i;
+    int j;
+    if(!pool) return;
+
+    pthread_mutex_lock(&(pool->lock));
+    pool->done = 1;
+    pthread_cond_broadcast(&(pool->cond));
+    pthread_mutex_unlock(&(pool->lock));
+    for(j=0; j<pool->nStarted; j++) pthread_join(pool->threads[j], NULL);
+
+    if(pool->chunks) {
+        for(i=0; i<pool->nChunks; i++) destroyChunk(pool->chunks + i);
+    }
+    free(pool->chunks);
+    free(pool->threads);
+    pthread_cond_destroy(&(pool->cond));
+    pthread_mutex_destroy(&(pool->lock));
+    free(pool);
+}
+
+static struct textPool_t *createTextPool(const chromIndex_t *chroms, int nThreads) {
+    struct textPool_t *pool = calloc(1, sizeof(struct textPool_t));
+    if(!pool) return NULL;
+    pool->chroms = chroms;
+    pool->nThreads = nThreads;
+    pool->nChunks = 2*nThreads;
+    if(pthread_mutex_init(&(pool->lock), NULL)) {
+        free(pool);
+        return NULL;
+    }
+    if(pthread_cond_init(&(pool->cond), NULL)) {
+        pthread_mutex_destroy(&(pool->lock));
+        free(pool);
+        return NULL;
+    }
+
+    pool->chunks = calloc(pool->nChunks, sizeof(textChunk_t));
+    pool->threads = calloc(nThreads, sizeof(pthread_t));
+    if(!pool->chunks || !pool->threads) goto error;
+    for(; pool->nStarted < nThreads; pool->nStarted++) {
+        if(pthread_create(pool->threads + pool->nStarted, NULL, parseWorker, pool)) goto error;
+    }
+    return pool;
+
+error:
+    destroyTextPool(pool);
+    return NULL;
+}
+
+int bwAddBedGraph(bigWigFile_t *fp, FILE *in, int nThreads) {
+    textReader_t r = {in, NULL, 0, 0, 0};
+    textChunk_t chunk, *c;
+    struct textPool_t *pool = NULL;
+    uint64_t nAdded = 0, nLines = 0;
+    chromIndex_t chroms;
+    uint32_t lastTid = -1;
+    int eof = 0, rv = 0;
+    if(!fp->isWrite) return 1;
+    if(!fp->writeBuffer || !fp->hdr || !fp->cl) return 2;
+    if(createChromIndex(fp, &chroms)) return 6;
+
+    if(nThreads <= 0) nThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if(nThreads <= 1) {
+        memset(&chunk, 0, sizeof(textChunk_t));
+        while(!rv) {
+            if(readChunk(&r, &chunk)) rv = 3;
+            else if(!chunk.l) break;
+            else if(parseBedGraphChunk(&chroms, &chunk)) rv = 4;
+            else if(addChunkEntries(fp, &chunk, &lastTid)) rv = 5;
+            else nLines += chunk.nLines;
+        }
+        if(rv == 4) fprintf(stderr, "[bwAddBedGraph] Couldn't parse line %"PRIu64"\n", nLines + chunk.nLines);
+        destroyChunk(&chunk);
+        free(chroms.entries);
+        free(r.carry);
+        return rv;
+    }
+
+    pool = createTextPool(&chroms, nThreads);
+    if(!pool) {
+        free(chroms.entries);
+        free(r.carry);
+        return 6;
+    }
+
+    //This thread reads chunks and adds the parsed entries in order
+    pthread_mutex_lock(&(pool->lock));
+    while(!rv) {
+        c = pool->chunks + nAdded % pool->nChunks;
+        if(nAdded < pool->nRead && c->state == CHUNK_PARSED) {
+            pthread_mutex_unlock(&(pool->lock));
+            if(c->rv) {
+                fprintf(stderr, "[bwAddBedGraph] Couldn't parse line %"PRIu64"\n", nLines + c->nLines);
+                rv = 4;
+            } else if(addChunkEntries(fp, c, &lastTid)) {
+                rv = 5;
+            }
+            nLines += c->nLines;
+            pthread_mutex_lock(&(pool->lock));
+            c->state = CHUNK_FREE;
+            nAdded++;
+            continue;
+        }
+
+        c = pool->chunks + pool->nRead % pool->nChunks;
+        if(!eof && c->state == CHUNK_FREE) {
+            pthread_mutex_unlock(&(pool->lock));
+            if(readChunk(&r, c)) rv = 3;
+            pthread_mutex_lock(&(pool->lock));
+            if(!rv && !c->l) eof = 1;
+            if(!rv && c->l) {
+                c->state = CHUNK_FILLED;
+                pool->nRead++;
+                pthread_cond_broadcast(&(pool->cond));
+            }
+            continue;
+        }
+
+        if(eof && nAdded == pool->nRead) break;
+        pthread_cond_wait(&(pool->cond), &(pool->lock));
+    }
+    pthread_mutex_unlock(&(pool->lock));
+
+    destroyTextPool(pool);
+    free(chroms.entries);
+    free(r.carry);
+    return rv;
+}
+
+//Add the entries held for the current wiggle section
+//Returns 0 on success
+static int flushWigSection(bigWigFile_t *fp, wigSection_t *s) {
+    const char *chrom = fp->cl->chrom[s->tid];
+    int rv = 0;
+    if(!s->n) return 0;
+
+    if(s->type == 2) {
+        if(s->added) rv = bwAppendIntervalSpans(fp, s->starts, s->values, s->n);
+        else rv = bwAddIntervalSpans(fp, chrom, s->starts, s->span, s->values, s->n);
+    } else {
+        if(s->added) rv = bwAppendIntervalSpanSteps(fp, s->values, s->n);
+        else rv = bwAddIntervalSpanSteps(fp, chrom, s->start, s->span, s->step, s->values, s->n);
+    }
+    s->added = 1;
+    s->n = 0;
+    return rv;
+}
+
+//Parse a variableStep or fixedStep line, starting a new section
+//Returns 0 on success
+static int parseWigDeclaration(const chromIndex_t *chroms, wigSection_t *s, char *p, char *eol) {
+    const chromEntry_t *chrom;
+    char *f, *v, save;
+    uint32_t val;
+    int haveChrom = 0, haveStart = 0, haveStep = 0;
+
+    f = nextBlank(p, eol);
+    if(f - p == 12 && strncmp(p, "variableStep", 12) == 0) s->type = 2;
+    else if(f - p == 9 && strncmp(p, "fixedStep", 9) == 0) s->type = 3;
+    else return 1;
+    s->span = 1;
+    s->added = 0;
+
+    for(p = skipBlanks(f, eol); p < eol; p = skipBlanks(f, eol)) {
+        f = nextBlank(p, eol);
+        v = memchr(p, '=', f - p);
+        if(!v) return 2;
+        v++;
+        if(v - p == 6 && strncmp(p, "chrom=", 6) == 0) {
+            save = *f;
+            *f = '\0';
+            chrom = chromIndexGet(chroms, v);
+            *f = save;
+            if(!chrom) return 3;
+            s->tid = chrom->tid;
+            haveChrom = 1;
+            continue;
+        }
+        if(parseUint(&v, f, &val) || v != f) return 4;
+        if(v - p > 5 && strncmp(p, "span=", 5) == 0 && val) s->span = val;
+        else if(v - p > 5 && strncmp(p, "step=", 5) == 0 && val) {
+            s->step = val;
+            haveStep = 1;
+        } else if(v - p > 6 && strncmp(p, "start=", 6) == 0 && val) {
+            //Wiggle files are 1-based
+            s->start = val - 1;
+            haveStart = 1;
+        } else {
+            return 5;
+        }
+    }
+
+    if(!haveChrom) return 6;
+    if(s->type == 3 && (!haveStart || !haveStep)) return 7;
+    return 0;
+}
+
+int bwAddWiggle(bigWigFile_t *fp, FILE *in) {
+    textReader_t r = {in, NULL, 0, 0, 0};
+    textChunk_t c;
+    wigSection_t s;
+    chromIndex_t chroms = {NULL, 0};
+    char *p, *end, *eol, *f;
+    uint64_t nLines = 0;
+    uint32_t pos;
+    int rv = 0;
+    if(!fp->isWrite) return 1;
+    if(!fp->writeBuffer || !fp->hdr || !fp->cl) return 2;
+
+    memset(&c, 0, sizeof(textChunk_t));
+    memset(&s, 0, sizeof(wigSection_t));
+    s.starts = malloc(WIG_BATCH_SIZE * sizeof(uint32_t));
+    s.values = malloc(WIG_BATCH_SIZE * sizeof(float));
+    if(!s.starts || !s.values || createChromIndex(fp, &chroms)) {
+        rv = 3;
+        goto done;
+    }
+
+    while(!rv) {
+        if(readChunk(&r, &c)) {
+            rv = 4;
+            break;
+        }
+        if(!c.l) break;
+
+        end = c.text + c.l;
+        for(p = c.text; p < end && !rv; p = eol + 1) {
+            eol = memchr(p, '\n', end - p);
+            if(!eol) eol = end;
+            nLines++;
+            if(skipLine(p, eol)) continue;
+
+            p = skipBlanks(p, eol);
+            if(*p == 'v' || *p == 'f') {
+                if(flushWigSection(fp, &s)) rv = 6;
+                else if(parseWigDeclaration(&chroms, &s, p, eol)) rv = 5;
+                continue;
+            }
+
+            if(s.n == WIG_BATCH_SIZE && flushWigSection(fp, &s)) {
+                rv = 6;
+                break;
+            }
+            if(s.type == 2) {
+                if(parseUint(&p, eol, &pos) || !pos) {
+                    rv = 5;
+                    break;
+                }
+                s.starts[s.n] = pos - 1;
+                p = skipBlanks(p, eol);
+            } else if(s.type != 3) {
+                //Data before any declaration
+                rv = 5;
+                break;
+            }
+            f = nextBlank(p, eol);
+            if(parseFloat(p, f, s.values + s.n) || skipBlanks(f, eol) != eol) {
+                rv = 5;
+                break;
+            }
+            s.n++;
+        }
+    }
+    if(!rv && flushWigSection(fp, &s)) rv = 6;
+    if(rv == 5) fprintf(stderr, "[bwAddWiggle] Couldn't parse line %"PRIu64"\n", nLines);
+
+done:
+    destroyChunk(&c);
+    free(r.carry);
+    free(s.starts);
+    free(s.values);
+    free(chroms.entries);
+    return rv;
+}
@@ -59,6 +59,58 @@ error:
     return NULL;
 }
 
+static bwRTreeNode_t *bwGetRTreeNode(bigWigFile_t *fp, uint64_t offset);
+static void bwDestroyFlatIndex(bwFlatIndex_t *f);
+
+//Parts of an index are read as they're needed, while the index may be shared between threads (directly or via bwClone())
+//Each part is read in privately and then published with a compare-and-swap. Whichever thread loses the race frees its copy and uses the winner's
+//These return the published pointer, or NULL on error
+static bwRTreeNode_t *publishNode(bwRTreeNode_t **slot, bwRTreeNode_t *node) {
+    bwRTreeNode_t *expected = NULL;
+    if(!node) return NULL;
+    if(__atomic_compare_exchange_n(slot, &expected, node, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return node;
+    bwDestroyIndexNode(node);
+    return expected;
+}
+
+static bwRTree_t *publishIndex(bwRTree_t **slot, bwRTree_t *idx) {
+    bwRTree_t *expected = NULL;
+    if(!idx) return NULL;
+    if(__atomic_compare_exchange_n(slot, &expected, idx, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return idx;
+    bwDestroyIndex(idx);
+    return expected;
+}
+
+static bwFlatIndex_t *publishFlatIndex(bwFlatIndex_t **slot, bwFlatIndex_t *f) {
+    bwFlatIndex_t *expected = NULL;
+    if(!f) return NULL;
+    if(__atomic_compare_exchange_n(slot, &expected, f, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return f;
+    bwDestroyFlatIndex(f);
+    return expected;
+}
+
+//Child i of a non-leaf node, reading it in if needed
+static bwRTreeNode_t *getChild(bigWigFile_t *fp, bwRTreeNode_t *node, uint16_t i) {
+    bwRTreeNode_t *child = __atomic_load_n(&(node->x.child[i]), __ATOMIC_ACQUIRE);
+    if(child) return child;
+    return publishNode(&(node->x.child[i]), bwGetRTreeNode(fp, node->dataOffset[i]));
+}
+
+//The root node of an index, reading it in if needed
+static bwRTreeNode_t *getRoot(bigWigFile_t *fp, bwRTree_t *idx) {
+    bwRTreeNode_t *root = __atomic_load_n(&(idx->root), __ATOMIC_ACQUIRE);
+    if(root) return root;
+    return publishNode(&(idx->root), bwGetRTreeNode(fp, idx->rootOffset));
+}
+
+bwRTree_t *bwGetZoomIndex(bigWigFile_t *fp, uint16_t level) {
+    bwRTree_t *idx;
+    if(level >= fp->hdr->nLevels) return NULL;
+    idx = __atomic_load_n(&(fp->hdr->zoomHdrs->idx[level]), __ATOMIC_ACQUIRE);
+    if(idx) return idx;
+    return publishIndex(&(fp->hdr->zoomHdrs->idx[level]), bwReadIndex(fp, fp->hdr->zoomHdrs->indexOffset[level]));
+}
+
 //Returns a bwRTreeNode_t on success and NULL on an error
 //For the root node, set offset to 0
 static bwRTreeNode_t *bwGetRTreeNode(bigWigFile_t *fp, uint64_t offset) {
@@ -225,6 +277,7 @@ error:
 //The output needs to be free()d if not NULL (likewise with *sizes)
 static bwOverlapBlock_t *overlapsNonLeaf(bigWigFile_t *fp, bwRTreeNode_t *node, uint32_t tid, uint32_t start, uint32_t end) {
     uint16_t i;
+    bwRTreeNode_t *child;
     bwOverlapBlock_t *nodeBlocks, *output = calloc(1, sizeof(bwOverlapBlock_t));
     if(!output) return NULL;
 
@@ -242,14 +295,13 @@ static bwOverlapBlock_t *overlapsNonLeaf(bigWigFile_t *fp, bwRTreeNode_t *node,
         }
 
         //We have an overlap!
-        if(!node->x.child[i])
-          node->x.child[i] = bwGetRTreeNode(fp, node->dataOffset[i]);
-        if(!node->x.child[i]) goto error;
+        child = getChild(fp, node, i);
+        if(!child) goto error;
 
-        if(node->x.child[i]->isLeaf) { //leaf
-            nodeBlocks = overlapsLeaf(node->x.child[i], tid, start, end);
+        if(child->isLeaf) { //leaf
+            nodeBlocks = overlapsLeaf(child, tid, start, end);
         } else { //non-leaf
-            nodeBlocks = overlapsNonLeaf(fp, node->x.child[i], tid, start, end);
+            nodeBlocks = overlapsNonLeaf(fp, child, tid, start, end);
         }
 
         //The output is processed the same regardless of leaf/non-leaf
@@ -277,11 +329,269 @@ bwOverlapBlock_t *walkRTreeNodes(bigWigFile_t *bw, bwRTreeNode_t *root, uint32_t
     return overlapsNonLeaf(bw, root, tid, start, end);
 }
 
+/// @cond SKIP
+struct flatEntry_t {
+    uint32_t tid, start, end;
+    uint64_t offset, size, seq;
+};
+/// @endcond
+
+//Appends every leaf entry under node to *e, reading child nodes as needed. Entries spanning multiple chromosomes are added once per chromosome, clipped to it
+//Returns 0 on success
+static int collectLeaves(bigWigFile_t *fp, bwRTreeNode_t *node, struct flatEntry_t **e, uint64_t *n, uint64_t *m) {
+    uint16_t i;
+    uint32_t tid;
+    struct flatEntry_t *tmp;
+    bwRTreeNode_t *child;
+
+    if(!node->isLeaf) {
+        for(i=0; i<node->nChildren; i++) {
+            child = getChild(fp, node, i);
+            if(!child) return 1;
+            if(collectLeaves(fp, child, e, n, m)) return 1;
+        }
+        return 0;
+    }
+
+    for(i=0; i<node->nChildren; i++) {
+        if(node->chrIdxEnd[i] < node->chrIdxStart[i]) continue;
+        for(tid=node->chrIdxStart[i]; ; tid++) {
+            if(*n >= *m) {
+                *m = (*m) ? 2*(*m) : 1024;
+                tmp = realloc(*e, *m * sizeof(struct flatEntry_t));
+                if(!tmp) return 1;
+                *e = tmp;
+            }
+            (*e)[*n].tid = tid;
+            (*e)[*n].start = (tid == node->chrIdxStart[i]) ? node->baseStart[i] : 0;
+            (*e)[*n].end = (tid == node->chrIdxEnd[i]) ? node->baseEnd[i] : (uint32_t) -1;
+            (*e)[*n].offset = node->dataOffset[i];
+            (*e)[*n].size = node->x.size[i];
+            (*e)[*n].seq = *n;
+            (*n)++;
+            if(tid == node->chrIdxEnd[i]) break;
+        }
+    }
+    return 0;
+}
+
+static int flatEntryCmp(const void *a, const void *b) {
+    const struct flatEntry_t *x = a, *y = b;
+    if(x->tid != y->tid) return (x->tid < y->tid) ? -1 : 1;
+    if(x->start != y->start) return (x->start < y->start) ? -1 : 1;
+    if(x->seq != y->seq) return (x->seq < y->seq) ? -1 : 1;
+    return 0;
+}
+
+//Fill the 1-based Eytzinger array (eytz[k-1] for node k) with an in-order traversal of sorted, and rank (unless it's NULL) with the index of each element in sorted
+//Returns the next index into sorted
+static uint64_t eytzFill(const uint32_t *sorted, uint32_t *eytz, uint32_t *rank, uint64_t i, uint64_t k, uint64_t n) {
+    if(k <= n) {
+        i = eytzFill(sorted, eytz, rank, i, 2*k, n);
+        eytz[k-1] = sorted[i];
+        if(rank) rank[k-1] = i;
+        i++;
+        i = eytzFill(sorted, eytz, rank, i, 2*k+1, n);
+    }
+    return i;
+}
+
+//Returns the sorted index of the first element in the Eytzinger-ordered b that is >= x (> x if strict), or n if there's none
+static uint64_t eytzSearch(const uint32_t *b, const uint32_t *rank, uint64_t n, uint32_t x, int strict) {
+    uint64_t k = 1;
+    if(strict) {
+        while(k <= n) k = 2*k + (b[k-1] <= x);
+    } else {
+        while(k <= n) k = 2*k + (b[k-1] < x);
+    }
+    k >>= __builtin_ffsll(~k);
+    if(!k) return n;
+    return rank[k-1];
+}
+
+static void bwDestroyFlatIndex(bwFlatIndex_t *f) {
+    if(!f) return;
+    free(f->tidOffset);
+    free(f->start);
+    free(f->end);
+    free(f->dataOffset);
+    free(f->size);
+    free(f->eytzStart);
+    free(f->eytzMaxEnd);
+    free(f->eytzRank);
+    free(f);
+}
+
+//Returns NULL on error
+static bwFlatIndex_t *bwCreateFlatIndex(bigWigFile_t *fp, bwRTree_t *idx) {
+    struct flatEntry_t *e = NULL;
+    uint64_t i, n = 0, m = 0, off, len;
+    uint32_t tid, maxEnd, *runningEnd = NULL;
+    bwFlatIndex_t *f = NULL;
+    bwRTreeNode_t *root = getRoot(fp, idx);
+
+    if(!root) return NULL;
+    if(collectLeaves(fp, root, &e, &n, &m)) goto error;
+    qsort(e, n, sizeof(struct flatEntry_t), flatEntryCmp);
+
+    f = calloc(1, sizeof(bwFlatIndex_t));
+    if(!f) goto error;
+    f->nTids = n ? e[n-1].tid + 1 : 0;
+    f->tidOffset = calloc(f->nTids + 1, sizeof(uint64_t));
+    f->start = malloc(n * sizeof(uint32_t) + 1);
+    f->end = malloc(n * sizeof(uint32_t) + 1);
+    f->dataOffset = malloc(n * sizeof(uint64_t) + 1);
+    f->size = malloc(n * sizeof(uint64_t) + 1);
+    f->eytzStart = malloc(n * sizeof(uint32_t) + 1);
+    f->eytzMaxEnd = malloc(n * sizeof(uint32_t) + 1);
+    f->eytzRank = malloc(n * sizeof(uint32_t) + 1);
+    runningEnd = malloc(n * sizeof(uint32_t) + 1);
+    if(!f->tidOffset || !f->start || !f->end || !f->dataOffset || !f->size) goto error;
+    if(!f->eytzStart || !f->eytzMaxEnd || !f->eytzRank || !runningEnd) goto error;
+
+    for(i=0; i<n; i++) {
+        f->tidOffset[e[i].tid+1]++;
+        f->start[i] = e[i].start;
+        f->end[i] = e[i].end;
+        f->dataOffset[i] = e[i].offset;
+        f->size[i] = e[i].size;
+    }
+    for(tid=0; tid<f->nTids; tid++) f->tidOffset[tid+1] += f->tidOffset[tid];
+
+    //The running maximum end of each chromosome's blocks, before it's put in Eytzinger order
+    for(tid=0; tid<f->nTids; tid++) {
+        off = f->tidOffset[tid];
+        len = f->tidOffset[tid+1] - off;
+        maxEnd = 0;
+        for(i=off; i<off+len; i++) {
+            if(f->end[i] > maxEnd) maxEnd = f->end[i];
+            runningEnd[i] = maxEnd;
+        }
+        eytzFill(runningEnd+off, f->eytzMaxEnd+off, f->eytzRank+off, 0, 1, len);
+        eytzFill(f->start+off, f->eytzStart+off, NULL, 0, 1, len);
+    }
+
+    free(e);
+    free(runningEnd);
+    return f;
+
+error:
+    if(e) free(e);
+    if(runningEnd) free(runningEnd);
+    bwDestroyFlatIndex(f);
+    return NULL;
+}
+
+//Returns a bwOverlapBlock_t * object or NULL on error.
+static bwOverlapBlock_t *overlapsFlat(bwFlatIndex_t *f, uint32_t tid, uint32_t start, uint32_t end) {
+    uint64_t i, lo, hi, off, n;
+    bwOverlapBlock_t *o = calloc(1, sizeof(bwOverlapBlock_t));
+    if(!o) return NULL;
+    if(tid >= f->nTids) return o;
+
+    off = f->tidOffset[tid];
+    n = f->tidOffset[tid+1] - off;
+    //Blocks [lo, hi) are those that might overlap: all later blocks start too late and all earlier ones end too early
+    lo = eytzSearch(f->eytzMaxEnd+off, f->eytzRank+off, n, start, 1);
+    hi = eytzSearch(f->eytzStart+off, f->eytzRank+off, n, end, 0);
+    if(lo >= hi) return o;
+
+    o->offset = malloc(sizeof(uint64_t) * (hi-lo));
+    if(!o->offset) goto error;
+    o->size = malloc(sizeof(uint64_t) * (hi-lo));
+    if(!o->size) goto error;
+    for(i=off+lo; i<off+hi; i++) {
+        if(f->end[i] <= start) continue;
+        o->offset[o->n] = f->dataOffset[i];
+        o->size[o->n++] = f->size[i];
+    }
+
+    return o;
+
+error:
+    destroyBWOverlapBlock(o);
+    return NULL;
+}
+
+//Like walkRTreeNodes, but uses the flattened index when there is one
+bwOverlapBlock_t *bwIndexOverlaps(bigWigFile_t *bw, bwRTree_t *idx, uint32_t tid, uint32_t start, uint32_t end) {
+    bwFlatIndex_t *flat = __atomic_load_n(&(idx->flat), __ATOMIC_ACQUIRE);
+    bwRTreeNode_t *root;
+    if(flat) return overlapsFlat(flat, tid, start, end);
+    root = getRoot(bw, idx);
+    if(!root) return NULL;
+    return walkRTreeNodes(bw, root, tid, start, end);
+}
+
+//Appends every block below node to o, whose arrays have room for *m blocks
+//Returns 0 on success
+static int appendAllBlocks(bigWigFile_t *fp, bwRTreeNode_t *node, bwOverlapBlock_t *o, uint64_t *m) {
+    bwRTreeNode_t *child;
+    uint64_t *tmp;
+    uint16_t i;
+
+    for(i=0; i<node->nChildren; i++) {
+        if(!node->isLeaf) {
+            child = getChild(fp, node, i);
+            if(!child || appendAllBlocks(fp, child, o, m)) return 1;
+            continue;
+        }
+        if(o->n >= *m) {
+            *m = (*m) ? 2*(*m) : 1024;
+            tmp = realloc(o->offset, *m * sizeof(uint64_t));
+            if(!tmp) return 1;
+            o->offset = tmp;
+            tmp = realloc(o->size, *m * sizeof(uint64_t));
+            if(!tmp) return 1;
+            o->size = tmp;
+        }
+        o->offset[o->n] = node->dataOffset[i];
+        o->size[o->n++] = node->x.size[i];
+    }
+    return 0;
+}
+
+bwOverlapBlock_t *bwIndexAllBlocks(bigWigFile_t *fp, bwRTree_t *idx) {
+    bwOverlapBlock_t *o = calloc(1, sizeof(bwOverlapBlock_t));
+    bwRTreeNode_t *root = getRoot(fp, idx);
+    uint64_t m = 0;
+    if(!o || !root) goto error;
+    if(appendAllBlocks(fp, root, o, &m)) goto error;
+    return o;
+
+error:
+    destroyBWOverlapBlock(o);
+    return NULL;
+}
+
+//Returns 0 on success
+int bwFlattenIndex(bigWigFile_t *fp) {
+    uint16_t i;
+    bwRTree_t *idx;
+    if(fp->isWrite) return 1;
+
+    if(fp->idx && !__atomic_load_n(&(fp->idx->flat), __ATOMIC_ACQUIRE)) {
+        if(!publishFlatIndex(&(fp->idx->flat), bwCreateFlatIndex(fp, fp->idx))) return 2;
+    }
+
+    for(i=0; i<fp->hdr->nLevels; i++) {
+        idx = bwGetZoomIndex(fp, i);
+        if(!idx) return 3;
+        if(!__atomic_load_n(&(idx->flat), __ATOMIC_ACQUIRE)) {
+            if(!publishFlatIndex(&(idx->flat), bwCreateFlatIndex(fp, idx))) return 4;
+        }
+    }
+
+    return 0;
+}
+
 //In reality, a hash or some sort of tree structure is probably faster...
 //Return -1 (AKA 0xFFFFFFFF...) on "not there", so we can hold (2^32)-1 items.
 uint32_t bwGetTid(const bigWigFile_t *fp, const char *chrom) {
     uint32_t i;
     if(!chrom) return -1;
+    //Lazy lookups need to read from the file and cache what they find. Handles are only ever allocated by bwOpen(), never defined const, so dropping the const is well defined
+    if(fp->cl->tree) return bwLazyGetTid((bigWigFile_t*) fp, chrom);
     for(i=0; i<fp->cl->nKeys; i++) {
         if(strcmp(chrom, fp->cl->chrom[i]) == 0) return i;
     }
@@ -290,6 +600,7 @@ uint32_t bwGetTid(const bigWigFile_t *fp, const char *chrom) {
 
 static bwOverlapBlock_t *bwGetOverlappingBlocks(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end) {
     uint32_t tid = bwGetTid(fp, chrom);
+    bwRTree_t *idx = __atomic_load_n(&(fp->idx), __ATOMIC_ACQUIRE);
 
     if(tid == (uint32_t) -1) {
         fprintf(stderr, "[bwGetOverlappingBlocks] Non-existent contig: %s\n", chrom);
@@ -297,17 +608,12 @@ static bwOverlapBlock_t *bwGetOverlappingBlocks(bigWigFile_t *fp, const char *ch
     }
 
     //Get the info if needed
-    if(!fp->idx) {
-        fp->idx = readRTreeIdx(fp, fp->hdr->indexOffset);
-        if(!fp->idx) {
-            return NULL;
-        }
+    if(!idx) {
+        idx = publishIndex(&(fp->idx), readRTreeIdx(fp, fp->hdr->indexOffset));
+        if(!idx) return NULL;
     }
 
-    if(!fp->idx->root) fp->idx->root = bwGetRTreeNode(fp, 0);
-    if(!fp->idx->root) return NULL;
-
-    return walkRTreeNodes(fp, fp->idx->root, tid, start, end);
+    return bwIndexOverlaps(fp, idx, tid, start, end);
 }
 
 void bwFillDataHdr(bwDataHeader_t *hdr, void *b) {
@@ -386,45 +692,86 @@ error:
     return NULL;
 }
 
+uint64_t bwReadBlocks(bigWigFile_t *fp, bwOverlapBlock_t *o, uint64_t first, void **buf, size_t *bufSz) {
+    uint64_t i, n;
+    size_t total = 0, *lens = NULL;
+    void **bufs = NULL, *p;
+
+    for(i=first; i<o->n; i++) {
+        if(i > first && total + o->size[i] > BW_MAX_BATCH_BYTES) break;
+        total += o->size[i];
+    }
+    n = i - first;
+    if(!n) return 0;
+
+    if(*bufSz < total) {
+        p = realloc(*buf, total);
+        if(!p) return 0;
+        *buf = p;
+        *bufSz = total;
+    }
+
+    bufs = malloc(n * sizeof(void*));
+    lens = malloc(n * sizeof(size_t));
+    if(!bufs || !lens) goto error;
+    p = *buf;
+    for(i=0; i<n; i++) {
+        bufs[i] = p;
+        lens[i] = o->size[first+i];
+        p = (char*)p + lens[i];
+    }
+
+    if(urlReadBatch(fp->URL, n, bufs, lens, o->offset + first)) goto error;
+
+    free(bufs);
+    free(lens);
+    return n;
+
+error:
+    free(bufs);
+    free(lens);
+    return 0;
+}
+
 //Returns NULL on error
-bwOverlappingIntervals_t *bwGetOverlappingIntervalsCore(bigWigFile_t *fp, bwOverlapBlock_t *o, uint32_t tid, uint32_t ostart, uint32_t oend) {
-    uint64_t i;
+//Decodes the blocks in o, calling visit() on every entry overlapping [ostart, oend) in the order they're stored
+//Returns 0 on success, or 1 on error (including visit() returning non-zero)
+static int visitOverlappingValuesCore(bigWigFile_t *fp, bwOverlapBlock_t *o, uint32_t tid, uint32_t ostart, uint32_t oend, bwValueVisitor_t visit, void *data) {
+    uint64_t i, nBlocks, batchEnd = 0;
     uint16_t j;
     int compressed = 0, rv;
     uLongf sz = fp->hdr->bufSize, tmp;
-    void *buf = NULL, *compBuf = NULL;
+    size_t compSz = 0;
+    void *buf = NULL, *compBuf = NULL, *block = NULL;
     uint32_t start = 0, end , *p;
     float value;
     bwDataHeader_t hdr;
-    bwOverlappingIntervals_t *output = calloc(1, sizeof(bwOverlappingIntervals_t));
-
-    if(!output) goto error;
 
-    if(!o) return output;
-    if(!o->n) return output;
+    if(!o) return 0;
+    if(!o->n) return 0;
 
     if(sz) {
         compressed = 1;
         buf = malloc(sz);
     }
-    sz = 0; //This is now the size of the compressed buffer
 
     for(i=0; i<o->n; i++) {
-        if(bwSetPos(fp, o->offset[i])) goto error;
-
-        if(sz < o->size[i]) {
-            compBuf = realloc(compBuf, o->size[i]);
-            sz = o->size[i];
+        //Blocks are fetched in batches, then decompressed one at a time
+        if(i == batchEnd) {
+            nBlocks = bwReadBlocks(fp, o, i, &compBuf, &compSz);
+            if(!nBlocks) goto error;
+            batchEnd = i + nBlocks;
+            block = compBuf;
+        } else {
+            block = (char*)block + o->size[i-1];
         }
-        if(!compBuf) goto error;
 
-        if(bwRead(compBuf, o->size[i], 1, fp) != 1) goto error;
         if(compressed) {
             tmp = fp->hdr->bufSize; //This gets over-written by uncompress
-            rv = uncompress(buf, (uLongf *) &tmp, compBuf, o->size[i]);
+            rv = uncompress(buf, (uLongf *) &tmp, block, o->size[i]);
             if(rv != Z_OK) goto error;
         } else {
-            buf = compBuf;
+            buf = block;
         }
 
         //TODO: ensure that tmp is large enough!
@@ -466,28 +813,46 @@ bwOverlappingIntervals_t *bwGetOverlappingIntervalsCore(bigWigFile_t *fp, bwOver
             }
 
             if(end <= ostart || start >= oend) continue;
-            //Push the overlap
-            if(!pushIntervals(output, start, end, value)) goto error;
+            if(visit(start, end, value, data)) goto error;
         }
     }
 
     if(compressed && buf) free(buf);
     if(compBuf) free(compBuf);
+    return 0;
+
+error:
+    if(compressed && buf) free(buf);
+    if(compBuf) free(compBuf);
+    return 1;
+}
+
+//Adds an entry to *data, which is set to NULL if it had to be free()d due to an error
+static int pushVisitor(uint32_t start, uint32_t end, float value, void *data) {
+    bwOverlappingIntervals_t **o = (bwOverlappingIntervals_t**) data;
+    *o = pushIntervals(*o, start, end, value);
+    return *o == NULL;
+}
+
+bwOverlappingIntervals_t *bwGetOverlappingIntervalsCore(bigWigFile_t *fp, bwOverlapBlock_t *o, uint32_t tid, uint32_t ostart, uint32_t oend) {
+    bwOverlappingIntervals_t *output = calloc(1, sizeof(bwOverlappingIntervals_t));
+    if(!output) goto error;
+
+    if(visitOverlappingValuesCore(fp, o, tid, ostart, oend, pushVisitor, &output)) goto error;
     return output;
 
 error:
     fprintf(stderr, "[bwGetOverlappingIntervalsCore] Got an error\n");
     if(output) bwDestroyOverlappingIntervals(output);
-    if(compressed && buf) free(buf);
-    if(compBuf) free(compBuf);
     return NULL;
 }
 
 bbOverlappingEntries_t *bbGetOverlappingEntriesCore(bigWigFile_t *fp, bwOverlapBlock_t *o, uint32_t tid, uint32_t ostart, uint32_t oend, int withString) {
-    uint64_t i;
+    uint64_t i, nBlocks, batchEnd = 0;
     int compressed = 0, rv, slen;
     uLongf sz = fp->hdr->bufSize, tmp = 0;
-    void *buf = NULL, *bufEnd = NULL, *compBuf = NULL;
+    size_t compSz = 0;
+    void *buf = NULL, *bufEnd = NULL, *compBuf = NULL, *block = NULL;
     uint32_t entryTid = 0, start = 0, end;
     char *str;
     bbOverlappingEntries_t *output = calloc(1, sizeof(bbOverlappingEntries_t));
@@ -501,24 +866,24 @@ bbOverlappingEntries_t *bbGetOverlappingEntriesCore(bigWigFile_t *fp, bwOverlapB
         compressed = 1;
         buf = malloc(sz);
     }
-    sz = 0; //This is now the size of the compressed buffer
 
     for(i=0; i<o->n; i++) {
-        if(bwSetPos(fp, o->offset[i])) goto error;
-
-        if(sz < o->size[i]) {
-            compBuf = realloc(compBuf, o->size[i]);
-            sz = o->size[i];
+        //Blocks are fetched in batches, then decompressed one at a time
+        if(i == batchEnd) {
+            nBlocks = bwReadBlocks(fp, o, i, &compBuf, &compSz);
+            if(!nBlocks) goto error;
+            batchEnd = i + nBlocks;
+            block = compBuf;
+        } else {
+            block = (char*)block + o->size[i-1];
         }
-        if(!compBuf) goto error;
 
-        if(bwRead(compBuf, o->size[i], 1, fp) != 1) goto error;
         if(compressed) {
             tmp = fp->hdr->bufSize; //This gets over-written by uncompress
-            rv = uncompress(buf, (uLongf *) &tmp, compBuf, o->size[i]);
+            rv = uncompress(buf, (uLongf *) &tmp, block, o->size[i]);
             if(rv != Z_OK) goto error;
         } else {
-            buf = compBuf;
+            buf = block;
             tmp = o->size[i]; //TODO: Is this correct? Do non-gzipped bigBeds exist?
         }
 
@@ -569,6 +934,18 @@ bwOverlappingIntervals_t *bwGetOverlappingIntervals(bigWigFile_t *fp, const char
     return output;
 }
 
+int bwVisitOverlappingValues(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, bwValueVisitor_t visit, void *data) {
+    bwOverlapBlock_t *blocks;
+    uint32_t tid = bwGetTid(fp, chrom);
+    int rv;
+    if(tid == (uint32_t) -1) return 1;
+    blocks = bwGetOverlappingBlocks(fp, chrom, start, end);
+    if(!blocks) return 1;
+    rv = visitOverlappingValuesCore(fp, blocks, tid, start, end, visit, data);
+    destroyBWOverlapBlock(blocks);
+    return rv;
+}
+
 //Like above, but for bigBed files
 bbOverlappingEntries_t *bbGetOverlappingEntries(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, int withString) {
     bbOverlappingEntries_t *output;
@@ -781,6 +1158,7 @@ void bwDestroyIndexNode(bwRTreeNode_t *node) {
 
 void bwDestroyIndex(bwRTree_t *idx) {
     bwDestroyIndexNode(idx->root);
+    bwDestroyFlatIndex(idx->flat);
     free(idx);
 }
 
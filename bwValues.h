@@ -32,6 +32,23 @@ typedef struct bwRTreeNode_t {
     } x; /**<A union holding either size or child*/
 } bwRTreeNode_t;
 
+/*!
+ * @brief A flattened copy of the leaves of an R-tree, for fast in-memory overlap searches.
+ *
+ * Blocks are grouped by chromosome and sorted by their start position. A block spanning multiple chromosomes is listed under each of them, with its start/end clipped to that chromosome (i.e., 0 and/or 0xFFFFFFFF). The block starts and the running maximum of the block ends of each chromosome are additionally stored in Eytzinger (BFS) order, so finding the overlapping range of blocks is a pair of cache-friendly binary searches rather than a walk through the tree.
+ */
+typedef struct {
+    uint32_t nTids; /**<The number of chromosomes with blocks (one more than the largest chromosome index).*/
+    uint64_t *tidOffset; /**<The blocks for chromosome i are at [tidOffset[i], tidOffset[i+1]). Of length nTids+1.*/
+    uint32_t *start; /**<The (clipped) start position of each block.*/
+    uint32_t *end; /**<The (clipped) end position of each block.*/
+    uint64_t *dataOffset; /**<The offset to the on-disk data of each block.*/
+    uint64_t *size; /**<The on-disk size of each block.*/
+    uint32_t *eytzStart; /**<For each chromosome, start in Eytzinger order.*/
+    uint32_t *eytzMaxEnd; /**<For each chromosome, the running maximum of end in Eytzinger order.*/
+    uint32_t *eytzRank; /**<For each chromosome, the sorted rank of each element in Eytzinger order.*/
+} bwFlatIndex_t;
+
 /*!
  * A header and index that points to an R-tree that in turn points to data blocks.
  */
@@ -48,6 +65,7 @@ typedef struct {
     //There's 4 bytes of padding in the file here
     uint64_t rootOffset; /**<The offset to the root node of the R-Tree (on disk). Yes, this is redundant.*/
     bwRTreeNode_t *root; /**<A pointer to the root node.*/
+    bwFlatIndex_t *flat; /**<If not NULL, a flattened copy of the leaves that is used for searches instead of root.*/
 } bwRTree_t;
 
 /*!
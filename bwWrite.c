@@ -1,11 +1,22 @@
 #include <limits.h>
 #include <float.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "bigWig.h"
 #include "bwCommon.h"
 
+//The number of entries held in memory to choose the zoom level sizes from
+#define ZOOM_SAMPLE_SIZE (1<<20)
+
+//Values of bwWriteBuffer_t.zoomState
+#define ZOOM_SAMPLING 0 //Entries are held until there are enough to choose the zoom level sizes from
+#define ZOOM_INCREMENTAL 1 //Entries are added to the zoom levels as they're written
+#define ZOOM_REREAD 2 //Entries were added out of chromosome order, so the zoom levels are made by re-reading the file when it's finalized
+
 /// @cond SKIP
 struct val_t {
     uint32_t tid;
@@ -15,12 +26,44 @@ struct val_t {
     double scalar;
     struct val_t *next;
 };
+
+//States of a block in a bwWritePool_t
+#define SLOT_FREE 0 //The slot can be given a new block
+#define SLOT_FILLED 1 //The block is waiting to be, or is being, compressed
+#define SLOT_COMPRESSED 2 //The block is waiting to be written
+#define SLOT_FAILED 3 //The block couldn't be compressed
+
+struct writeSlot_t {
+    void *buf; //A spare buffer of size bufSize, swapped with the caller's when it hands over a data block
+    const void *src; //The uncompressed block
+    uLongf l; //The size of src
+    void *comp; //The compressed block, of size pool->compSz
+    uLongf compSz; //The size of the compressed block
+    uint32_t tid0, tid1, start, end; //For the index
+    int state;
+};
+
+//Blocks are handed to a set of threads that compress them and then to a single thread that writes them in order and adds them to the index
+struct bwWritePool_t {
+    bigWigFile_t *fp;
+    pthread_mutex_t lock;
+    pthread_cond_t cond; //Signalled whenever a slot changes state
+    pthread_t *threads; //nThreads compression threads followed by the writer
+    int nThreads, nStarted;
+    uint32_t nSlots;
+    struct writeSlot_t *slots; //A ring of blocks, block i going in slot i%nSlots
+    uLongf compSz;
+    uint64_t nSubmitted, nClaimed, nWritten; //The number of blocks handed over, started being compressed and written
+    int done; //Set when the threads should exit
+    int rv; //The first error encountered by the writer
+};
 /// @endcond
 
 //Create a chromList_t and attach it to a bigWigFile_t *. Returns NULL on error
 //Note that chroms and lengths are duplicated, so you MUST free the input
 chromList_t *bwCreateChromList(const char* const* chroms, const uint32_t *lengths, int64_t n) {
     int64_t i = 0;
+    size_t l, arenaLen = 0;
     chromList_t *cl = calloc(1, sizeof(chromList_t));
     if(!cl) return NULL;
 
@@ -30,29 +73,31 @@ chromList_t *bwCreateChromList(const char* const* chroms, const uint32_t *length
     if(!cl->chrom) goto error;
     if(!cl->len) goto error;
 
+    //All of the names go in a single buffer
+    for(i=0; i<n; i++) arenaLen += strlen(chroms[i]) + 1;
+    cl->arena = malloc(arenaLen ? arenaLen : 1);
+    if(!cl->arena) goto error;
+    cl->arenaLen = arenaLen;
+
+    arenaLen = 0;
     for(i=0; i<n; i++) {
         cl->len[i] = lengths[i];
-        cl->chrom[i] = bwStrdup(chroms[i]);
-        if(!cl->chrom[i]) goto error;
+        l = strlen(chroms[i]) + 1;
+        cl->chrom[i] = memcpy(cl->arena + arenaLen, chroms[i], l);
+        arenaLen += l;
     }
 
     return cl;
 
 error:
-    if(i) {
-        int64_t j;
-        for(j=0; j<i; j++) free(cl->chrom[j]);
-    }
-    if(cl) {
-        if(cl->chrom) free(cl->chrom);
-        if(cl->len) free(cl->len);
-        free(cl);
-    }
+    if(cl->chrom) free(cl->chrom);
+    if(cl->len) free(cl->len);
+    free(cl);
     return NULL;
 }
 
 //If maxZooms == 0, then 0 is used (i.e., there are no zoom levels). If maxZooms < 0 or > 65535 then 10 is used.
-//TODO allow changing bufSize and blockSize
+//bufSize, blockSize and the compression level can be changed afterward with bwSetBufSize(), bwSetBlockSize() and bwSetCompressionLevel()
 int bwCreateHdr(bigWigFile_t *fp, int32_t maxZooms) {
     if(!fp->isWrite) return 1;
     bigWigHdr_t *hdr = calloc(1, sizeof(bigWigHdr_t));
@@ -70,6 +115,7 @@ int bwCreateHdr(bigWigFile_t *fp, int32_t maxZooms) {
     hdr->maxVal = DBL_MIN;
     fp->hdr = hdr;
     fp->writeBuffer->blockSize = 64;
+    fp->writeBuffer->compressLevel = Z_DEFAULT_COMPRESSION;
 
     //Allocate the writeBuffer buffers
     fp->writeBuffer->compressPsz = compressBound(hdr->bufSize);
@@ -81,17 +127,64 @@ int bwCreateHdr(bigWigFile_t *fp, int32_t maxZooms) {
     return 0;
 }
 
+int bwSetBufSize(bigWigFile_t *fp, uint32_t bufSize) {
+    bwWriteBuffer_t *wb = fp->writeBuffer;
+    void *p, *compressP;
+    if(!fp->isWrite) return 1;
+    if(!wb || !fp->hdr) return 2;
+    //The buffers are sized once the header is written, blocks can be compressed on other threads or bwSetZoomLevels() has made the zoom buffers
+    if(fp->hdr->dataOffset || wb->pool || fp->hdr->zoomHdrs || wb->firstZoomBuffer) return 3;
+    //A zoom level block must hold at least one 32 byte record (with room for another) and a data block no more than 65535 entries
+    if(bufSize < 64 || bufSize > 24 + 4*65535) return 4;
+
+    p = calloc(1, bufSize);
+    compressP = malloc(compressBound(bufSize));
+    if(!p || !compressP) {
+        free(p);
+        free(compressP);
+        return 5;
+    }
+    free(wb->p);
+    free(wb->compressP);
+    wb->p = p;
+    wb->compressP = compressP;
+    wb->compressPsz = compressBound(bufSize);
+    fp->hdr->bufSize = bufSize;
+    return 0;
+}
+
+int bwSetBlockSize(bigWigFile_t *fp, uint32_t blockSize) {
+    if(!fp->isWrite) return 1;
+    if(!fp->writeBuffer || !fp->hdr) return 2;
+    if(fp->hdr->dataOffset) return 3;
+    //Index nodes hold at most 65535 children
+    if(blockSize < 2 || blockSize > 65535) return 4;
+
+    fp->writeBuffer->blockSize = blockSize;
+    return 0;
+}
+
+int bwSetCompressionLevel(bigWigFile_t *fp, int level) {
+    if(!fp->isWrite) return 1;
+    if(!fp->writeBuffer || !fp->hdr) return 2;
+    if(fp->hdr->dataOffset) return 3;
+    if(level != Z_DEFAULT_COMPRESSION && (level < Z_NO_COMPRESSION || level > Z_BEST_COMPRESSION)) return 4;
+
+    fp->writeBuffer->compressLevel = level;
+    return 0;
+}
+
 //return 0 on success
-static int writeAtPos(void *ptr, size_t sz, size_t nmemb, size_t pos, FILE *fp) {
-    size_t curpos = ftell(fp);
-    if(fseek(fp, pos, SEEK_SET)) return 1;
-    if(fwrite(ptr, sz, nmemb, fp) != nmemb) return 2;
-    if(fseek(fp, curpos, SEEK_SET)) return 3;
+static int writeAtPos(void *ptr, size_t sz, size_t nmemb, size_t pos, bigWigFile_t *fp) {
+    size_t curpos = bwTell(fp);
+    if(bwSetPos(fp, pos)) return 1;
+    if(bwWrite(ptr, sz, nmemb, fp) != nmemb) return 2;
+    if(bwSetPos(fp, curpos)) return 3;
     return 0;
 }
 
 //We lose keySize bytes on error
-static int writeChromList(FILE *fp, chromList_t *cl) {
+static int writeChromList(bigWigFile_t *fp, chromList_t *cl) {
     uint16_t k;
     uint32_t j, magic = CIRTREE_MAGIC;
     uint32_t nperblock = (cl->nKeys > 0x7FFF) ? 0x7FFF : cl->nKeys; //Items per leaf/non-leaf, there are no unsigned ints in java :(
@@ -117,35 +210,35 @@ static int writeChromList(FILE *fp, chromList_t *cl) {
     chrom = calloc(keySize, sizeof(char));
 
     //Write the root node of a largely pointless tree
-    if(fwrite(&magic, sizeof(uint32_t), 1, fp) != 1) return 1;
-    if(fwrite(&nperblock, sizeof(uint32_t), 1, fp) != 1) return 2;
-    if(fwrite(&keySize, sizeof(uint32_t), 1, fp) != 1) return 3;
-    if(fwrite(&valSize, sizeof(uint32_t), 1, fp) != 1) return 4;
-    if(fwrite(&(cl->nKeys), sizeof(uint64_t), 1, fp) != 1) return 5;
+    if(bwWrite(&magic, sizeof(uint32_t), 1, fp) != 1) return 1;
+    if(bwWrite(&nperblock, sizeof(uint32_t), 1, fp) != 1) return 2;
+    if(bwWrite(&keySize, sizeof(uint32_t), 1, fp) != 1) return 3;
+    if(bwWrite(&valSize, sizeof(uint32_t), 1, fp) != 1) return 4;
+    if(bwWrite(&(cl->nKeys), sizeof(uint64_t), 1, fp) != 1) return 5;
 
     //Padding?
     i=0;
-    if(fwrite(&i, sizeof(uint64_t), 1, fp) != 1) return 6;
+    if(bwWrite(&i, sizeof(uint64_t), 1, fp) != 1) return 6;
 
     //Do we need a non-leaf node?
     if(nblocks > 1) {
         eight = 0;
-        if(fwrite(&eight, sizeof(uint8_t), 1, fp) != 1) return 7;
-        if(fwrite(&eight, sizeof(uint8_t), 1, fp) != 1) return 8; //padding
-        if(fwrite(&nblocks, sizeof(uint16_t), 1, fp) != 1) return 8;
-        nonLeafEnd = ftell(fp) + nperblock * (keySize + 8);
+        if(bwWrite(&eight, sizeof(uint8_t), 1, fp) != 1) return 7;
+        if(bwWrite(&eight, sizeof(uint8_t), 1, fp) != 1) return 8; //padding
+        if(bwWrite(&nblocks, sizeof(uint16_t), 1, fp) != 1) return 8;
+        nonLeafEnd = bwTell(fp) + nperblock * (keySize + 8);
         leafSize = nperblock * (keySize + 8) + 4;
         for(i=0; i<nblocks; i++) { //Why yes, this is pointless
             chrom = strncpy(chrom, cl->chrom[i * nperblock], keySize);
             nextLeaf = nonLeafEnd + i * leafSize;
-            if(fwrite(chrom, keySize, 1, fp) != 1) return 9;
-            if(fwrite(&nextLeaf, sizeof(uint64_t), 1, fp) != 1) return 10;
+            if(bwWrite(chrom, keySize, 1, fp) != 1) return 9;
+            if(bwWrite(&nextLeaf, sizeof(uint64_t), 1, fp) != 1) return 10;
         }
         for(i=0; i<keySize; i++) chrom[i] = '\0';
         nextLeaf = 0;
         for(i=nblocks; i<nperblock; i++) {
-            if(fwrite(chrom, keySize, 1, fp) != 1) return 9;
-            if(fwrite(&nextLeaf, sizeof(uint64_t), 1, fp) != 1) return 10;
+            if(bwWrite(chrom, keySize, 1, fp) != 1) return 9;
+            if(bwWrite(&nextLeaf, sizeof(uint64_t), 1, fp) != 1) return 10;
         }
     }
 
@@ -153,27 +246,27 @@ static int writeChromList(FILE *fp, chromList_t *cl) {
     nextLeaf = 0;
     for(i=0, j=0; i<nblocks; i++) {
         eight = 1;
-        if(fwrite(&eight, sizeof(uint8_t), 1, fp) != 1) return 11;
+        if(bwWrite(&eight, sizeof(uint8_t), 1, fp) != 1) return 11;
         eight = 0;
-        if(fwrite(&eight, sizeof(uint8_t), 1, fp) != 1) return 12;
+        if(bwWrite(&eight, sizeof(uint8_t), 1, fp) != 1) return 12;
         if(cl->nKeys - j < nperblock) {
             k = cl->nKeys - j;
-            if(fwrite(&k, sizeof(uint16_t), 1, fp) != 1) return 13;
+            if(bwWrite(&k, sizeof(uint16_t), 1, fp) != 1) return 13;
         } else {
-            if(fwrite(&nperblock, sizeof(uint16_t), 1, fp) != 1) return 13;
+            if(bwWrite(&nperblock, sizeof(uint16_t), 1, fp) != 1) return 13;
         }
         for(k=0; k<nperblock; k++) {
             if(j>=cl->nKeys) {
                 if(chrom[0]) {
                     for(l=0; l<keySize; l++) chrom[l] = '\0';
                 }
-                if(fwrite(chrom, keySize, 1, fp) != 1) return 15;
-                if(fwrite(&nextLeaf, sizeof(uint64_t), 1, fp) != 1) return 16;
+                if(bwWrite(chrom, keySize, 1, fp) != 1) return 15;
+                if(bwWrite(&nextLeaf, sizeof(uint64_t), 1, fp) != 1) return 16;
             } else {
                 chrom = strncpy(chrom, cl->chrom[j], keySize);
-                if(fwrite(chrom, keySize, 1, fp) != 1) return 15;
-                if(fwrite(&j, sizeof(uint32_t), 1, fp) != 1) return 16;
-                if(fwrite(&(cl->len[j++]), sizeof(uint32_t), 1, fp) != 1) return 17;
+                if(bwWrite(chrom, keySize, 1, fp) != 1) return 15;
+                if(bwWrite(&j, sizeof(uint32_t), 1, fp) != 1) return 16;
+                if(bwWrite(&(cl->len[j++]), sizeof(uint32_t), 1, fp) != 1) return 17;
             }
         }
     }
@@ -187,122 +280,301 @@ static int writeChromList(FILE *fp, chromList_t *cl) {
 int bwWriteHdr(bigWigFile_t *bw) {
     uint32_t magic = BIGWIG_MAGIC;
     uint16_t two = 4;
-    FILE *fp;
     const uint8_t pbuff[58] = {0}; // 58 bytes of nothing
     const void *p = (const void *)&pbuff;
     if(!bw->isWrite) return 1;
 
     //The header itself, largely just reserving space...
-    fp = bw->URL->x.fp;
-    if(!fp) return 2;
-    if(fseek(fp, 0, SEEK_SET)) return 3;
-    if(fwrite(&magic, sizeof(uint32_t), 1, fp) != 1) return 4;
-    if(fwrite(&two, sizeof(uint16_t), 1, fp) != 1) return 5;
-    if(fwrite(p, sizeof(uint8_t), 58, fp) != 58) return 6;
+    if(!bw->URL) return 2;
+    if(bwSetPos(bw, 0)) return 3;
+    if(bwWrite(&magic, sizeof(uint32_t), 1, bw) != 1) return 4;
+    if(bwWrite(&two, sizeof(uint16_t), 1, bw) != 1) return 5;
+    if(bwWrite(p, sizeof(uint8_t), 58, bw) != 58) return 6;
 
     //Empty zoom headers
     if(bw->hdr->nLevels) {
         for(two=0; two<bw->hdr->nLevels; two++) {
-            if(fwrite(p, sizeof(uint8_t), 24, fp) != 24) return 9;
+            if(bwWrite(p, sizeof(uint8_t), 24, bw) != 24) return 9;
         }
     }
 
     //Update summaryOffset and write an empty summary block
-    bw->hdr->summaryOffset = ftell(fp);
-    if(fwrite(p, sizeof(uint8_t), 40, fp) != 40) return 10;
-    if(writeAtPos(&(bw->hdr->summaryOffset), sizeof(uint64_t), 1, 0x2c, fp)) return 11;
+    bw->hdr->summaryOffset = bwTell(bw);
+    if(bwWrite(p, sizeof(uint8_t), 40, bw) != 40) return 10;
+    if(writeAtPos(&(bw->hdr->summaryOffset), sizeof(uint64_t), 1, 0x2c, bw)) return 11;
 
     //Write the chromosome list as a stupid freaking tree (because let's TREE ALL THE THINGS!!!)
-    bw->hdr->ctOffset = ftell(fp);
-    if(writeChromList(fp, bw->cl)) return 7;
-    if(writeAtPos(&(bw->hdr->ctOffset), sizeof(uint64_t), 1, 0x8, fp)) return 8;
+    bw->hdr->ctOffset = bwTell(bw);
+    if(writeChromList(bw, bw->cl)) return 7;
+    if(writeAtPos(&(bw->hdr->ctOffset), sizeof(uint64_t), 1, 0x8, bw)) return 8;
 
     //Update the dataOffset
-    bw->hdr->dataOffset = ftell(fp);
-    if(writeAtPos(&bw->hdr->dataOffset, sizeof(uint64_t), 1, 0x10, fp)) return 12;
+    bw->hdr->dataOffset = bwTell(bw);
+    if(writeAtPos(&bw->hdr->dataOffset, sizeof(uint64_t), 1, 0x10, bw)) return 12;
 
     //Save space for the number of blocks
-    if(fwrite(p, sizeof(uint8_t), 8, fp) != 8) return 13;
+    if(bwWrite(p, sizeof(uint8_t), 8, bw) != 8) return 13;
 
     return 0;
 }
 
-static int insertIndexNode(bigWigFile_t *fp, bwRTreeNode_t *leaf) {
-    bwLL *l = malloc(sizeof(bwLL));
-    if(!l) return 1;
-    l->node = leaf;
-    l->next = NULL;
+//Record a written block for the index
+//Returns 0 on success
+static int addIndexEntry(bigWigFile_t *fp, uint32_t tid0, uint32_t tid1, uint32_t start, uint32_t end, uint64_t offset, uint64_t size) {
+    bwWriteBuffer_t *wb = fp->writeBuffer;
+    bwBlockRecord_t *blocks, *b;
 
-    if(!fp->writeBuffer->firstIndexNode) {
-        fp->writeBuffer->firstIndexNode = l;
-    } else {
-        fp->writeBuffer->currentIndexNode->next = l;
+    if(wb->nBlocks == wb->mBlocks) {
+        wb->mBlocks = wb->mBlocks ? 2*wb->mBlocks : 1024;
+        blocks = realloc(wb->blocks, wb->mBlocks * sizeof(bwBlockRecord_t));
+        if(!blocks) return 1;
+        wb->blocks = blocks;
     }
-    fp->writeBuffer->currentIndexNode = l;
+
+    b = wb->blocks + wb->nBlocks;
+    b->tid0 = tid0;
+    b->start = start;
+    b->tid1 = tid1;
+    b->end = end;
+    b->offset = offset;
+    b->size = size;
     return 0;
 }
 
-//0 on success
-static int appendIndexNodeEntry(bigWigFile_t *fp, uint32_t tid0, uint32_t tid1, uint32_t start, uint32_t end, uint64_t offset, uint64_t size) {
-    bwLL *n = fp->writeBuffer->currentIndexNode;
-    if(!n) return 1;
-    if(n->node->nChildren >= fp->writeBuffer->blockSize) return 2;
-
-    n->node->chrIdxStart[n->node->nChildren] = tid0;
-    n->node->baseStart[n->node->nChildren] = start;
-    n->node->chrIdxEnd[n->node->nChildren] = tid1;
-    n->node->baseEnd[n->node->nChildren] = end;
-    n->node->dataOffset[n->node->nChildren] = offset;
-    n->node->x.size[n->node->nChildren] = size;
-    n->node->nChildren++;
-    return 0;
+//Compress blocks in the order they were handed over
+static void *compressWorker(void *arg) {
+    struct bwWritePool_t *pool = (struct bwWritePool_t*) arg;
+    struct writeSlot_t *slot;
+    uLongf sz;
+    int rv;
+
+    pthread_mutex_lock(&(pool->lock));
+    while(1) {
+        while(pool->nClaimed == pool->nSubmitted && !pool->done) pthread_cond_wait(&(pool->cond), &(pool->lock));
+        if(pool->nClaimed == pool->nSubmitted) break;
+        slot = pool->slots + pool->nClaimed++ % pool->nSlots;
+        pthread_mutex_unlock(&(pool->lock));
+
+        sz = pool->compSz;
+        rv = compress2(slot->comp, &sz, slot->src, slot->l, pool->fp->writeBuffer->compressLevel);
+
+        pthread_mutex_lock(&(pool->lock));
+        slot->compSz = sz;
+        slot->state = (rv == Z_OK) ? SLOT_COMPRESSED : SLOT_FAILED;
+        pthread_cond_broadcast(&(pool->cond));
+    }
+    pthread_mutex_unlock(&(pool->lock));
+    return NULL;
+}
+
+//Write compressed blocks and add them to the index, in the order they were handed over
+//This is the only thread doing I/O on the file while blocks are outstanding
+static void *writeWorker(void *arg) {
+    struct bwWritePool_t *pool = (struct bwWritePool_t*) arg;
+    bigWigFile_t *fp = pool->fp;
+    struct writeSlot_t *slot;
+    int rv;
+
+    pthread_mutex_lock(&(pool->lock));
+    while(1) {
+        slot = pool->slots + pool->nWritten % pool->nSlots;
+        while(pool->nWritten < pool->nSubmitted && slot->state < SLOT_COMPRESSED) pthread_cond_wait(&(pool->cond), &(pool->lock));
+        while(pool->nWritten == pool->nSubmitted && !pool->done) pthread_cond_wait(&(pool->cond), &(pool->lock));
+        if(pool->nWritten == pool->nSubmitted) break;
+        if(slot->state < SLOT_COMPRESSED) continue;
+        rv = pool->rv;
+        pthread_mutex_unlock(&(pool->lock));
+
+        //Once something has gone wrong the remaining blocks are only discarded
+        if(!rv) {
+            if(slot->state == SLOT_FAILED) rv = 1;
+            else if(bwWrite(slot->comp, sizeof(uint8_t), slot->compSz, fp) != slot->compSz) rv = 2;
+            else if(addIndexEntry(fp, slot->tid0, slot->tid1, slot->start, slot->end, bwTell(fp)-slot->compSz, slot->compSz)) rv = 3;
+            else fp->writeBuffer->nBlocks++;
+        }
+
+        pthread_mutex_lock(&(pool->lock));
+        if(rv) pool->rv = rv;
+        slot->state = SLOT_FREE;
+        pool->nWritten++;
+        pthread_cond_broadcast(&(pool->cond));
+    }
+    pthread_mutex_unlock(&(pool->lock));
+    return NULL;
 }
 
+//Wait for every block handed over so far to be written
 //Returns 0 on success
-static int addIndexEntry(bigWigFile_t *fp, uint32_t tid0, uint32_t tid1, uint32_t start, uint32_t end, uint64_t offset, uint64_t size) {
-    bwRTreeNode_t *node;
-
-    if(appendIndexNodeEntry(fp, tid0, tid1, start, end, offset, size)) {
-        //The last index node is full, we need to add a new one
-        node = calloc(1, sizeof(bwRTreeNode_t));
-        if(!node) return 1;
-
-        //Allocate and set the fields
-        node->isLeaf = 1;
-        node->nChildren = 1;
-        node->chrIdxStart = malloc(sizeof(uint32_t)*fp->writeBuffer->blockSize);
-        if(!node->chrIdxStart) goto error;
-        node->baseStart = malloc(sizeof(uint32_t)*fp->writeBuffer->blockSize);
-        if(!node->baseStart) goto error;
-        node->chrIdxEnd = malloc(sizeof(uint32_t)*fp->writeBuffer->blockSize);
-        if(!node->chrIdxEnd) goto error;
-        node->baseEnd = malloc(sizeof(uint32_t)*fp->writeBuffer->blockSize);
-        if(!node->baseEnd) goto error;
-        node->dataOffset = malloc(sizeof(uint64_t)*fp->writeBuffer->blockSize);
-        if(!node->dataOffset) goto error;
-        node->x.size = malloc(sizeof(uint64_t)*fp->writeBuffer->blockSize);
-        if(!node->x.size) goto error;
-
-        node->chrIdxStart[0] = tid0;
-        node->baseStart[0] = start;
-        node->chrIdxEnd[0] = tid1;
-        node->baseEnd[0] = end;
-        node->dataOffset[0] = offset;
-        node->x.size[0] = size;
-
-        if(insertIndexNode(fp, node)) goto error;
+static int drainWritePool(struct bwWritePool_t *pool) {
+    int rv;
+    pthread_mutex_lock(&(pool->lock));
+    while(pool->nWritten < pool->nSubmitted) pthread_cond_wait(&(pool->cond), &(pool->lock));
+    rv = pool->rv;
+    pthread_mutex_unlock(&(pool->lock));
+    return rv;
+}
+
+void bwDestroyWritePool(struct bwWritePool_t *pool) {
+    uint32_t i;
+    if(!pool) return;
+
+    pthread_mutex_lock(&(pool->lock));
+    pool->done = 1;
+    pthread_cond_broadcast(&(pool->cond));
+    pthread_mutex_unlock(&(pool->lock));
+    for(i=0; i<(uint32_t) pool->nStarted; i++) pthread_join(pool->threads[i], NULL);
+
+    if(pool->slots) {
+        for(i=0; i<pool->nSlots; i++) {
+            if(pool->slots[i].buf) free(pool->slots[i].buf);
+            if(pool->slots[i].comp) free(pool->slots[i].comp);
+        }
+        free(pool->slots);
     }
+    if(pool->threads) free(pool->threads);
+    pthread_cond_destroy(&(pool->cond));
+    pthread_mutex_destroy(&(pool->lock));
+    free(pool);
+}
 
+int bwSetCompressionThreads(bigWigFile_t *fp, int nThreads) {
+    struct bwWritePool_t *pool;
+    uint32_t i;
+    if(!fp->isWrite) return 1;
+    if(!fp->writeBuffer || !fp->hdr) return 2;
+    if(fp->writeBuffer->pool) return 3;
+
+    if(nThreads <= 0) nThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if(nThreads <= 1) return 0; //Compress on the caller's thread
+
+    pool = calloc(1, sizeof(struct bwWritePool_t));
+    if(!pool) return 4;
+    pool->fp = fp;
+    pool->nThreads = nThreads;
+    pool->nSlots = 2*nThreads;
+    pool->compSz = compressBound(fp->hdr->bufSize);
+    if(pthread_mutex_init(&(pool->lock), NULL)) {
+        free(pool);
+        return 5;
+    }
+    if(pthread_cond_init(&(pool->cond), NULL)) {
+        pthread_mutex_destroy(&(pool->lock));
+        free(pool);
+        return 5;
+    }
+
+    pool->slots = calloc(pool->nSlots, sizeof(struct writeSlot_t));
+    pool->threads = calloc(nThreads + 1, sizeof(pthread_t));
+    if(!pool->slots || !pool->threads) goto error;
+    for(i=0; i<pool->nSlots; i++) {
+        pool->slots[i].buf = calloc(1, fp->hdr->bufSize); //The padding byte in block headers is never set
+        pool->slots[i].comp = malloc(pool->compSz);
+        if(!pool->slots[i].buf || !pool->slots[i].comp) goto error;
+    }
+
+    for(i=0; i<(uint32_t) nThreads; i++) {
+        if(pthread_create(pool->threads + i, NULL, compressWorker, pool)) goto error;
+        pool->nStarted++;
+    }
+    if(pthread_create(pool->threads + nThreads, NULL, writeWorker, pool)) goto error;
+    pool->nStarted++;
+
+    fp->writeBuffer->pool = pool;
     return 0;
 
 error:
-    if(node->chrIdxStart) free(node->chrIdxStart);
-    if(node->baseStart) free(node->baseStart);
-    if(node->chrIdxEnd) free(node->chrIdxEnd);
-    if(node->baseEnd) free(node->baseEnd);
-    if(node->dataOffset) free(node->dataOffset);
-    if(node->x.size) free(node->x.size);
-    return 2;
+    bwDestroyWritePool(pool);
+    return 6;
+}
+
+//Compress a block, write it and add it to the index, or hand it to the compression threads to do so
+//For data blocks (own != 0), *p may be swapped for another buffer of the same size
+//Otherwise, *p must remain valid until the write pool has been drained
+//Returns 0 on success
+static int writeBlock(bigWigFile_t *fp, void **p, uint32_t l, int own, uint32_t tid0, uint32_t tid1, uint32_t start, uint32_t end) {
+    bwWriteBuffer_t *wb = fp->writeBuffer;
+    struct bwWritePool_t *pool = wb->pool;
+    struct writeSlot_t *slot;
+    uLongf sz = wb->compressPsz;
+    void *tmp;
+    int rv;
+
+    if(!pool) {
+        if(compress2(wb->compressP, &sz, *p, l, wb->compressLevel) != Z_OK) return 1;
+        if(bwWrite(wb->compressP, sizeof(uint8_t), sz, fp) != sz) return 2;
+        if(addIndexEntry(fp, tid0, tid1, start, end, bwTell(fp)-sz, sz)) return 3;
+        wb->nBlocks++;
+        return 0;
+    }
+
+    pthread_mutex_lock(&(pool->lock));
+    slot = pool->slots + pool->nSubmitted % pool->nSlots;
+    while(slot->state != SLOT_FREE) pthread_cond_wait(&(pool->cond), &(pool->lock));
+    rv = pool->rv;
+    if(!rv) {
+        if(own) {
+            tmp = slot->buf;
+            slot->buf = *p;
+            *p = tmp;
+            slot->src = slot->buf;
+        } else {
+            slot->src = *p;
+        }
+        slot->l = l;
+        slot->tid0 = tid0;
+        slot->tid1 = tid1;
+        slot->start = start;
+        slot->end = end;
+        slot->state = SLOT_FILLED;
+        pool->nSubmitted++;
+        pthread_cond_broadcast(&(pool->cond));
+    }
+    pthread_mutex_unlock(&(pool->lock));
+
+    return rv ? 4 : 0;
+}
+
+int bwSetAdaptiveBlockType(bigWigFile_t *fp, int adaptive) {
+    if(!fp->isWrite) return 1;
+    if(!fp->writeBuffer || !fp->hdr) return 2;
+
+    fp->writeBuffer->adaptiveType = (adaptive != 0);
+    return 0;
+}
+
+//If every entry in a block of type 1 has the same span, re-encode it in place as type 2 or, if the entries are also evenly spaced, type 3
+//Returns the new size of the block, which is unchanged if it can't be re-encoded
+static uint32_t compactBlock(bwWriteBuffer_t *wb, uint8_t *type, uint32_t *step, uint32_t *span) {
+    uint32_t *e = (uint32_t*) wb->p + 6, n = (wb->l-24)/12, i, sp, st;
+    if(!n) return wb->l;
+
+    sp = e[1] - e[0];
+    if(!sp) return wb->l;
+    for(i=1; i<n; i++) {
+        if(e[3*i+1] - e[3*i] != sp) return wb->l;
+    }
+    //A single entry is a step of its own span
+    st = (n > 1) ? e[3] - e[0] : sp;
+    for(i=2; i<n && st; i++) {
+        if(e[3*i] - e[3*(i-1)] != st) st = 0;
+    }
+    if(st < sp || e[0] != wb->start) st = 0;
+
+    //Entries only ever move toward the start of the block
+    *span = sp;
+    if(st) {
+        for(i=0; i<n; i++) e[i] = e[3*i+2];
+        *type = 3;
+        *step = st;
+        return 24 + 4*n;
+    }
+    for(i=0; i<n; i++) {
+        e[2*i] = e[3*i];
+        e[2*i+1] = e[3*i+2];
+    }
+    *type = 2;
+    *step = 0;
+    return 24 + 8*n;
 }
 
 /*
@@ -313,27 +585,32 @@ static int flushBuffer(bigWigFile_t *fp) {
     bwWriteBuffer_t *wb = fp->writeBuffer;
     uLongf sz = wb->compressPsz;
     uint16_t nItems;
+    uint8_t type = wb->ltype;
+    uint32_t step = wb->step, span = wb->span, l = wb->l;
     if(!fp->writeBuffer->l) return 0;
     if(!wb->ltype) return 0;
 
+    //bedGraph-style entries may be stored more compactly
+    if(wb->adaptiveType && type == 1) l = compactBlock(wb, &type, &step, &span);
+
     //Fill in the header
     if(!memcpy((char*)wb->p, &(wb->tid), sizeof(uint32_t))) return 1;
     if(!memcpy((char*)wb->p+4, &(wb->start), sizeof(uint32_t))) return 2;
     if(!memcpy((char*)wb->p+8, &(wb->end), sizeof(uint32_t))) return 3;
-    if(!memcpy((char*)wb->p+12, &(wb->step), sizeof(uint32_t))) return 4;
-    if(!memcpy((char*)wb->p+16, &(wb->span), sizeof(uint32_t))) return 5;
-    if(!memcpy((char*)wb->p+20, &(wb->ltype), sizeof(uint8_t))) return 6;
+    if(!memcpy((char*)wb->p+12, &step, sizeof(uint32_t))) return 4;
+    if(!memcpy((char*)wb->p+16, &span, sizeof(uint32_t))) return 5;
+    if(!memcpy((char*)wb->p+20, &type, sizeof(uint8_t))) return 6;
     //1 byte padding
     //Determine the number of items
-    switch(wb->ltype) {
+    switch(type) {
     case 1:
-        nItems = (wb->l-24)/12;
+        nItems = (l-24)/12;
         break;
     case 2:
-        nItems = (wb->l-24)/8;
+        nItems = (l-24)/8;
         break;
     case 3:
-        nItems = (wb->l-24)/4;
+        nItems = (l-24)/4;
         break;
     default:
         return 7;
@@ -341,25 +618,26 @@ static int flushBuffer(bigWigFile_t *fp) {
     if(!memcpy((char*)wb->p+22, &nItems, sizeof(uint16_t))) return 8;
 
     if(sz) {
-        //compress
-        if(compress(wb->compressP, &sz, wb->p, wb->l) != Z_OK) return 9;
-
-        //write the data to disk
-        if(fwrite(wb->compressP, sizeof(uint8_t), sz, fp->URL->x.fp) != sz) return 10;
+        //compress, write the data to disk and add an entry into the index
+        if(writeBlock(fp, &(wb->p), l, 1, wb->tid, wb->tid, wb->start, wb->end)) return 9;
     } else {
-        sz = wb->l;
-        if(fwrite(wb->p, sizeof(uint8_t), wb->l, fp->URL->x.fp) != wb->l) return 10;
-    }
+        sz = l;
+        if(bwWrite(wb->p, sizeof(uint8_t), l, fp) != l) return 10;
 
-    //Add an entry into the index
-    if(addIndexEntry(fp, wb->tid, wb->tid, wb->start, wb->end, bwTell(fp)-sz, sz)) return 11;
+        //Add an entry into the index
+        if(addIndexEntry(fp, wb->tid, wb->tid, wb->start, wb->end, bwTell(fp)-sz, sz)) return 11;
+        wb->nBlocks++;
+    }
 
-    wb->nBlocks++;
     wb->l = 24;
     return 0;
 }
 
-static void updateStats(bigWigFile_t *fp, uint32_t span, float val) {
+static int addZoomEntry(bigWigFile_t *fp, uint32_t start, uint32_t end, float value);
+
+//Returns 0 on success
+static int updateStats(bigWigFile_t *fp, uint32_t start, uint32_t end, float val) {
+    uint32_t span = end-start;
     if(val < fp->hdr->minVal) fp->hdr->minVal = val;
     else if(val > fp->hdr->maxVal) fp->hdr->maxVal = val;
     fp->hdr->nBasesCovered += span;
@@ -368,6 +646,87 @@ static void updateStats(bigWigFile_t *fp, uint32_t span, float val) {
 
     fp->writeBuffer->nEntries++;
     fp->writeBuffer->runningWidthSum += span;
+
+    return addZoomEntry(fp, start, end, val);
+}
+
+//Add a single entry to a block of type 1, starting a new block if needed
+//Returns 0 on success
+static int addInterval(bigWigFile_t *fp, uint32_t tid, uint32_t start, uint32_t end, float value) {
+    bwWriteBuffer_t *wb = fp->writeBuffer;
+    if(wb->ltype != 1 || tid != wb->tid || wb->l+12 > fp->hdr->bufSize) {
+        if(wb->l > 24 && flushBuffer(fp)) return 1;
+        wb->l = 24;
+        wb->tid = tid;
+        wb->start = start;
+        wb->span = 0;
+        wb->step = 0;
+        wb->ltype = 1;
+    }
+    memcpy((char*)wb->p+wb->l, &start, sizeof(uint32_t));
+    memcpy((char*)wb->p+wb->l+4, &end, sizeof(uint32_t));
+    memcpy((char*)wb->p+wb->l+8, &value, sizeof(float));
+    if(updateStats(fp, start, end, value)) return 2;
+    wb->l += 12;
+    wb->end = end;
+    return 0;
+}
+
+//Write out the run of merged entries, if there is one
+//Returns 0 on success
+static int flushMergedRun(bigWigFile_t *fp) {
+    bwWriteBuffer_t *wb = fp->writeBuffer;
+    float value;
+    if(!wb->mergeRun) return 0;
+
+    //Equal values are kept as they are, rather than going through the mean
+    if(wb->runMin == wb->runMax) value = wb->runMin;
+    else value = wb->runSum / (wb->runEnd - wb->runStart);
+    wb->mergeRun = 0;
+    return addInterval(fp, wb->runTid, wb->runStart, wb->runEnd, value);
+}
+
+//Add an entry to the current run of merged entries if it directly follows it and its value is close enough, otherwise write out the run and start a new one
+//Returns 0 on success
+static int mergeInterval(bigWigFile_t *fp, uint32_t tid, uint32_t start, uint32_t end, float value) {
+    bwWriteBuffer_t *wb = fp->writeBuffer;
+    float lo, hi;
+
+    if(wb->mergeQuantum > 0) value = roundf(value / wb->mergeQuantum) * wb->mergeQuantum;
+    if(wb->mergeRun && tid == wb->runTid && start == wb->runEnd && !isnan(value)) {
+        lo = (value < wb->runMin) ? value : wb->runMin;
+        hi = (value > wb->runMax) ? value : wb->runMax;
+        if(hi - lo <= wb->mergeTol) {
+            wb->runEnd = end;
+            wb->runMin = lo;
+            wb->runMax = hi;
+            wb->runSum += (double) (end - start) * value;
+            return 0;
+        }
+    }
+
+    if(flushMergedRun(fp)) return 1;
+    wb->runTid = tid;
+    wb->runStart = start;
+    wb->runEnd = end;
+    wb->runMin = wb->runMax = value;
+    wb->runSum = (double) (end - start) * value;
+    wb->mergeRun = 1;
+    return 0;
+}
+
+int bwSetMergeIntervals(bigWigFile_t *fp, float tolerance, float quantum) {
+    bwWriteBuffer_t *wb = fp->writeBuffer;
+    if(!fp->isWrite) return 1;
+    if(!wb || !fp->hdr) return 2;
+    if(isnan(tolerance) || isnan(quantum) || quantum < 0) return 3;
+    //Settings apply to the next run
+    if(flushMergedRun(fp)) return 4;
+
+    wb->merge = (tolerance >= 0);
+    wb->mergeTol = tolerance;
+    wb->mergeQuantum = quantum;
+    return 0;
 }
 
 //12 bytes per entry
@@ -379,6 +738,18 @@ int bwAddIntervals(bigWigFile_t *fp, const char* const* chrom, const uint32_t *s
     if(!fp->isWrite) return 1;
     if(!wb) return 2;
 
+    if(wb->merge) {
+        for(i=0; i<n; i++) {
+            if(!lastChrom || strcmp(chrom[i], lastChrom) != 0) {
+                lastChrom = chrom[i];
+                tid = bwGetTid(fp, chrom[i]);
+                if(tid == (uint32_t) -1) return 5;
+            }
+            if(mergeInterval(fp, tid, start[i], end[i], values[i])) return 3;
+        }
+        return 0;
+    }
+
     //Flush if needed
     if(wb->ltype != 1) if(flushBuffer(fp)) return 3;
     if(wb->l+36 > fp->hdr->bufSize) if(flushBuffer(fp)) return 4;
@@ -402,7 +773,7 @@ int bwAddIntervals(bigWigFile_t *fp, const char* const* chrom, const uint32_t *s
     if(!memcpy((char*)wb->p+wb->l, start, sizeof(uint32_t))) return 7;
     if(!memcpy((char*)wb->p+wb->l+4, end, sizeof(uint32_t))) return 8;
     if(!memcpy((char*)wb->p+wb->l+8, values, sizeof(float))) return 9;
-    updateStats(fp, end[0]-start[0], values[0]);
+    if(updateStats(fp, start[0], end[0], values[0])) return 14;
     wb->l += 12;
 
     for(i=1; i<n; i++) {
@@ -423,7 +794,7 @@ int bwAddIntervals(bigWigFile_t *fp, const char* const* chrom, const uint32_t *s
         if(!memcpy((char*)wb->p+wb->l, &(start[i]), sizeof(uint32_t))) return 11;
         if(!memcpy((char*)wb->p+wb->l+4, &(end[i]), sizeof(uint32_t))) return 12;
         if(!memcpy((char*)wb->p+wb->l+8, &(values[i]), sizeof(float))) return 13;
-        updateStats(fp, end[i]-start[i], values[i]);
+        if(updateStats(fp, start[i], end[i], values[i])) return 15;
         wb->l += 12;
     }
     wb->end = end[i-1];
@@ -432,11 +803,21 @@ int bwAddIntervals(bigWigFile_t *fp, const char* const* chrom, const uint32_t *s
 }
 
 int bwAppendIntervals(bigWigFile_t *fp, const uint32_t *start, const uint32_t *end, const float *values, uint32_t n) {
-    uint32_t i;
+    uint32_t i, tid;
     bwWriteBuffer_t *wb = fp->writeBuffer;
     if(!n) return 0;
     if(!fp->isWrite) return 1;
     if(!wb) return 2;
+
+    //Entries continue the open run or, if bwSetMergeIntervals() wrote it out, the last entry added to the buffer
+    if(wb->merge) {
+        if(!wb->mergeRun && wb->ltype != 1) return 3;
+        tid = wb->mergeRun ? wb->runTid : wb->tid;
+        for(i=0; i<n; i++) {
+            if(mergeInterval(fp, tid, start[i], end[i], values[i])) return 4;
+        }
+        return 0;
+    }
     if(wb->ltype != 1) return 3;
 
     for(i=0; i<n; i++) {
@@ -450,7 +831,7 @@ int bwAppendIntervals(bigWigFile_t *fp, const uint32_t *start, const uint32_t *e
         if(!memcpy((char*)wb->p+wb->l, &(start[i]), sizeof(uint32_t))) return 4;
         if(!memcpy((char*)wb->p+wb->l+4, &(end[i]), sizeof(uint32_t))) return 5;
         if(!memcpy((char*)wb->p+wb->l+8, &(values[i]), sizeof(float))) return 6;
-        updateStats(fp, end[i]-start[i], values[i]);
+        if(updateStats(fp, start[i], end[i], values[i])) return 7;
         wb->l += 12;
     }
     wb->end = end[i-1];
@@ -465,6 +846,7 @@ int bwAddIntervalSpans(bigWigFile_t *fp, const char *chrom, const uint32_t *star
     if(!n) return 0;
     if(!fp->isWrite) return 1;
     if(!wb) return 2;
+    if(flushMergedRun(fp)) return 3;
     if(wb->ltype != 2) if(flushBuffer(fp)) return 3;
     if(flushBuffer(fp)) return 4;
 
@@ -484,7 +866,7 @@ int bwAddIntervalSpans(bigWigFile_t *fp, const char *chrom, const uint32_t *star
         }
         if(!memcpy((char*)wb->p+wb->l, &(start[i]), sizeof(uint32_t))) return 5;
         if(!memcpy((char*)wb->p+wb->l+4, &(values[i]), sizeof(float))) return 6;
-        updateStats(fp, span, values[i]);
+        if(updateStats(fp, start[i], start[i]+span, values[i])) return 7;
         wb->l += 8;
     }
     wb->end = start[n-1] + span;
@@ -498,7 +880,8 @@ int bwAppendIntervalSpans(bigWigFile_t *fp, const uint32_t *start, const float *
     if(!n) return 0;
     if(!fp->isWrite) return 1;
     if(!wb) return 2;
-    if(wb->ltype != 2) return 3;
+    //Entries can't be appended ahead of a run of merged entries
+    if(wb->ltype != 2 || wb->mergeRun) return 3;
 
     for(i=0; i<n; i++) {
         if(wb->l + 8 >= fp->hdr->bufSize) {
@@ -508,7 +891,7 @@ int bwAppendIntervalSpans(bigWigFile_t *fp, const uint32_t *start, const float *
         }
         if(!memcpy((char*)wb->p+wb->l, &(start[i]), sizeof(uint32_t))) return 4;
         if(!memcpy((char*)wb->p+wb->l+4, &(values[i]), sizeof(float))) return 5;
-        updateStats(fp, wb->span, values[i]);
+        if(updateStats(fp, start[i], start[i]+wb->span, values[i])) return 6;
         wb->l += 8;
     }
     wb->end = start[n-1] + wb->span;
@@ -518,11 +901,12 @@ int bwAppendIntervalSpans(bigWigFile_t *fp, const uint32_t *start, const float *
 
 //4 bytes per entry
 int bwAddIntervalSpanSteps(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t span, uint32_t step, const float *values, uint32_t n) {
-    uint32_t i, tid;
+    uint32_t i, tid, pos;
     bwWriteBuffer_t *wb = fp->writeBuffer;
     if(!n) return 0;
     if(!fp->isWrite) return 1;
     if(!wb) return 2;
+    if(flushMergedRun(fp)) return 3;
     if(wb->ltype != 3) flushBuffer(fp);
     if(flushBuffer(fp)) return 3;
 
@@ -541,7 +925,8 @@ int bwAddIntervalSpanSteps(bigWigFile_t *fp, const char *chrom, uint32_t start,
             wb->start = wb->end;
         }
         if(!memcpy((char*)wb->p+wb->l, &(values[i]), sizeof(float))) return 5;
-        updateStats(fp, wb->span, values[i]);
+        pos = wb->start + ((wb->l-24)>>2) * step;
+        if(updateStats(fp, pos, pos+span, values[i])) return 6;
         wb->l += 4;
     }
     wb->end = wb->start + (wb->l>>2) * step;
@@ -550,12 +935,12 @@ int bwAddIntervalSpanSteps(bigWigFile_t *fp, const char *chrom, uint32_t start,
 }
 
 int bwAppendIntervalSpanSteps(bigWigFile_t *fp, const float *values, uint32_t n) {
-    uint32_t i;
+    uint32_t i, pos;
     bwWriteBuffer_t *wb = fp->writeBuffer;
     if(!n) return 0;
     if(!fp->isWrite) return 1;
     if(!wb) return 2;
-    if(wb->ltype != 3) return 3;
+    if(wb->ltype != 3 || wb->mergeRun) return 3;
 
     for(i=0; i<n; i++) {
         if(wb->l + 4 >= fp->hdr->bufSize) {
@@ -564,7 +949,8 @@ int bwAppendIntervalSpanSteps(bigWigFile_t *fp, const float *values, uint32_t n)
             wb->start = wb->end;
         }
         if(!memcpy((char*)wb->p+wb->l, &(values[i]), sizeof(float))) return 4;
-        updateStats(fp, wb->span, values[i]);
+        pos = wb->start + ((wb->l-24)>>2) * wb->step;
+        if(updateStats(fp, pos, pos+wb->span, values[i])) return 5;
         wb->l += 4;
     }
     wb->end = wb->start + (wb->l>>2) * wb->step;
@@ -574,233 +960,310 @@ int bwAppendIntervalSpanSteps(bigWigFile_t *fp, const float *values, uint32_t n)
 
 //0 on success
 int writeSummary(bigWigFile_t *fp) {
-    if(writeAtPos(&(fp->hdr->nBasesCovered), sizeof(uint64_t), 1, fp->hdr->summaryOffset, fp->URL->x.fp)) return 1;
-    if(writeAtPos(&(fp->hdr->minVal), sizeof(double), 1, fp->hdr->summaryOffset+8, fp->URL->x.fp)) return 2;
-    if(writeAtPos(&(fp->hdr->maxVal), sizeof(double), 1, fp->hdr->summaryOffset+16, fp->URL->x.fp)) return 3;
-    if(writeAtPos(&(fp->hdr->sumData), sizeof(double), 1, fp->hdr->summaryOffset+24, fp->URL->x.fp)) return 4;
-    if(writeAtPos(&(fp->hdr->sumSquared), sizeof(double), 1, fp->hdr->summaryOffset+32, fp->URL->x.fp)) return 5;
+    if(writeAtPos(&(fp->hdr->nBasesCovered), sizeof(uint64_t), 1, fp->hdr->summaryOffset, fp)) return 1;
+    if(writeAtPos(&(fp->hdr->minVal), sizeof(double), 1, fp->hdr->summaryOffset+8, fp)) return 2;
+    if(writeAtPos(&(fp->hdr->maxVal), sizeof(double), 1, fp->hdr->summaryOffset+16, fp)) return 3;
+    if(writeAtPos(&(fp->hdr->sumData), sizeof(double), 1, fp->hdr->summaryOffset+24, fp)) return 4;
+    if(writeAtPos(&(fp->hdr->sumSquared), sizeof(double), 1, fp->hdr->summaryOffset+32, fp)) return 5;
     return 0;
 }
 
-static bwRTreeNode_t *makeEmptyNode(uint32_t blockSize) {
-    bwRTreeNode_t *n = calloc(1, sizeof(bwRTreeNode_t));
-    if(!n) return NULL;
-
-    n->chrIdxStart = malloc(blockSize*sizeof(uint32_t));
-    if(!n->chrIdxStart) goto error;
-    n->baseStart = malloc(blockSize*sizeof(uint32_t));
-    if(!n->baseStart) goto error;
-    n->chrIdxEnd = malloc(blockSize*sizeof(uint32_t));
-    if(!n->chrIdxEnd) goto error;
-    n->baseEnd = malloc(blockSize*sizeof(uint32_t));
-    if(!n->baseEnd) goto error;
-    n->dataOffset = calloc(blockSize,sizeof(uint64_t)); //This MUST be 0 for node writing!
-    if(!n->dataOffset) goto error;
-    n->x.child = malloc(blockSize*sizeof(uint64_t));
-    if(!n->x.child) goto error;
-
-    return n;
+//Make an index node with room for n children
+static bwRTreeNode_t *makeIndexNode(uint8_t isLeaf, uint16_t n) {
+    bwRTreeNode_t *node = calloc(1, sizeof(bwRTreeNode_t));
+    if(!node) return NULL;
+    node->isLeaf = isLeaf;
+
+    node->chrIdxStart = malloc(n*sizeof(uint32_t));
+    if(!node->chrIdxStart) goto error;
+    node->baseStart = malloc(n*sizeof(uint32_t));
+    if(!node->baseStart) goto error;
+    node->chrIdxEnd = malloc(n*sizeof(uint32_t));
+    if(!node->chrIdxEnd) goto error;
+    node->baseEnd = malloc(n*sizeof(uint32_t));
+    if(!node->baseEnd) goto error;
+    node->dataOffset = calloc(n, sizeof(uint64_t));
+    if(!node->dataOffset) goto error;
+    if(isLeaf) node->x.size = malloc(n*sizeof(uint64_t));
+    else node->x.child = calloc(n, sizeof(bwRTreeNode_t*));
+    if(!node->x.size) goto error;
+
+    return node;
 
 error:
-    if(n->chrIdxStart) free(n->chrIdxStart);
-    if(n->baseStart) free(n->baseStart);
-    if(n->chrIdxEnd) free(n->chrIdxEnd);
-    if(n->baseEnd) free(n->baseEnd);
-    if(n->dataOffset) free(n->dataOffset);
-    if(n->x.child) free(n->x.child);
-    free(n);
+    bwDestroyIndexNode(node);
     return NULL;
 }
 
-//Returns 0 on success. This doesn't attempt to clean up!
-static bwRTreeNode_t *addLeaves(bwLL **ll, uint64_t *sz, uint64_t toProcess, uint32_t blockSize) {
-    uint32_t i;
-    uint64_t foo;
-    bwRTreeNode_t *n = makeEmptyNode(blockSize);
-    if(!n) return NULL;
-
-    if(toProcess <= blockSize) {
-        for(i=0; i<toProcess; i++) {
-            n->chrIdxStart[i] = (*ll)->node->chrIdxStart[0];
-            n->baseStart[i] = (*ll)->node->baseStart[0];
-            n->chrIdxEnd[i] = (*ll)->node->chrIdxEnd[(*ll)->node->nChildren-1];
-            n->baseEnd[i] = (*ll)->node->baseEnd[(*ll)->node->nChildren-1];
-            n->x.child[i] = (*ll)->node;
-            *sz += 4 + 32*(*ll)->node->nChildren;
-            *ll = (*ll)->next;
-            n->nChildren++;
+//Build an index over the blocks written so far, from the leaves up, with every node but the last in each level full
+//sz is incremented by the on-disk size of every node
+//Returns the root or NULL on error
+static bwRTreeNode_t *buildIndexTree(bigWigFile_t *fp, uint64_t *sz) {
+    bwWriteBuffer_t *wb = fp->writeBuffer;
+    bwBlockRecord_t *b;
+    bwRTreeNode_t **level, *node, *child;
+    uint64_t nNodes = (wb->nBlocks + wb->blockSize - 1)/wb->blockSize, nParents, i, j;
+    uint16_t n;
+
+    level = calloc(nNodes, sizeof(bwRTreeNode_t*));
+    if(!level) return NULL;
+
+    //The leaves point to the blocks
+    for(i=0; i<nNodes; i++) {
+        n = (wb->nBlocks - i*wb->blockSize < wb->blockSize) ? wb->nBlocks - i*wb->blockSize : wb->blockSize;
+        node = makeIndexNode(1, n);
+        if(!node) goto error;
+        for(j=0; j<n; j++) {
+            b = wb->blocks + i*wb->blockSize + j;
+            node->chrIdxStart[j] = b->tid0;
+            node->baseStart[j] = b->start;
+            node->chrIdxEnd[j] = b->tid1;
+            node->baseEnd[j] = b->end;
+            node->dataOffset[j] = b->offset;
+            node->x.size[j] = b->size;
         }
-    } else {
-        for(i=0; i<blockSize; i++) {
-            foo = ceil(((double) toProcess)/((double) blockSize-i));
-            if(!ll) break;
-            n->x.child[i] = addLeaves(ll, sz, foo, blockSize);
-            if(!n->x.child[i]) goto error;
-            n->chrIdxStart[i] = n->x.child[i]->chrIdxStart[0];
-            n->baseStart[i] = n->x.child[i]->baseStart[0];
-            n->chrIdxEnd[i] = n->x.child[i]->chrIdxEnd[n->x.child[i]->nChildren-1];
-            n->baseEnd[i] = n->x.child[i]->baseEnd[n->x.child[i]->nChildren-1];
-            n->nChildren++;
-            toProcess -= foo;
+        node->nChildren = n;
+        level[i] = node;
+        *sz += 4 + 32*n;
+    }
+
+    //Each level replaces the one below it at the start of the array
+    while(nNodes > 1) {
+        nParents = (nNodes + wb->blockSize - 1)/wb->blockSize;
+        for(i=0; i<nParents; i++) {
+            n = (nNodes - i*wb->blockSize < wb->blockSize) ? nNodes - i*wb->blockSize : wb->blockSize;
+            node = makeIndexNode(0, n);
+            if(!node) goto error;
+            for(j=0; j<n; j++) {
+                child = level[i*wb->blockSize + j];
+                level[i*wb->blockSize + j] = NULL;
+                node->chrIdxStart[j] = child->chrIdxStart[0];
+                node->baseStart[j] = child->baseStart[0];
+                node->chrIdxEnd[j] = child->chrIdxEnd[child->nChildren-1];
+                node->baseEnd[j] = child->baseEnd[child->nChildren-1];
+                node->x.child[j] = child;
+            }
+            node->nChildren = n;
+            level[i] = node;
+            *sz += 4 + 24*n;
         }
+        for(i=nParents; i<nNodes; i++) level[i] = NULL;
+        nNodes = nParents;
     }
 
-    *sz += 4 + 24*n->nChildren;
-    return n;
+    node = level[0];
+    free(level);
+    return node;
 
 error:
-    bwDestroyIndexNode(n);
+    for(i=0; i<nNodes; i++) bwDestroyIndexNode(level[i]);
+    free(level);
     return NULL;
 }
 
-//Returns 1 on error
-int writeIndexTreeNode(FILE *fp, bwRTreeNode_t *n, uint8_t *wrote, int level) {
-    uint8_t one = 0;
-    uint32_t i, j, vector[6] = {0, 0, 0, 0, 0, 0}; //The last 8 bytes are left as 0
-
-    if(n->isLeaf) return 0;
+//The on-disk size of an index node
+static uint64_t indexNodeSize(bwRTreeNode_t *n) {
+    return 4 + (n->isLeaf ? 32 : 24) * (uint64_t) n->nChildren;
+}
 
-    for(i=0; i<n->nChildren; i++) {
-        if(n->dataOffset[i]) { //traverse into child
-            if(n->isLeaf) return 0; //Only write leaves once!
-            if(writeIndexTreeNode(fp, n->x.child[i], wrote, level+1)) return 1;
-        } else {
-            n->dataOffset[i] = ftell(fp);
-            if(fwrite(&(n->x.child[i]->isLeaf), sizeof(uint8_t), 1, fp) != 1) return 1;
-            if(fwrite(&one, sizeof(uint8_t), 1, fp) != 1) return 1; //one byte of padding
-            if(fwrite(&(n->x.child[i]->nChildren), sizeof(uint16_t), 1, fp) != 1) return 1;
-            for(j=0; j<n->x.child[i]->nChildren; j++) {
-                vector[0] = n->x.child[i]->chrIdxStart[j];
-                vector[1] = n->x.child[i]->baseStart[j];
-                vector[2] = n->x.child[i]->chrIdxEnd[j];
-                vector[3] = n->x.child[i]->baseEnd[j];
-                if(n->x.child[i]->isLeaf) {
-                    //Include the offset and size
-                    if(fwrite(vector, sizeof(uint32_t), 4, fp) != 4) return 1;
-                    if(fwrite(&(n->x.child[i]->dataOffset[j]), sizeof(uint64_t), 1, fp) != 1) return 1;
-                    if(fwrite(&(n->x.child[i]->x.size[j]), sizeof(uint64_t), 1, fp) != 1) return 1;
-                } else {
-                    if(fwrite(vector, sizeof(uint32_t), 6, fp) != 6) return 1;
-                }
+//Write an index (its header followed by every node of the tree) at the current position and set idx->rootOffset
+//The nodes are written breadth-first, so where each one goes can be worked out beforehand and everything written at once
+//Returns 0 on success
+static int writeRTree(bigWigFile_t *fp, bwRTree_t *idx, uint64_t nBlocks, uint64_t idxSize, uint32_t itemsPerSlot) {
+    bwRTreeNode_t **nodes = NULL, **tmp, *n, *root = idx->root;
+    uint64_t *offsets = NULL, *tmp2, nextOffset, nNodes = 1, mNodes = 64, i, sz;
+    uint32_t j, vector[6] = {0, 0, 0, 0, 0, 0}; //The last 8 bytes are left as 0
+    char *buf = NULL, *p;
+    int rv = 1;
+
+    nodes = malloc(mNodes * sizeof(bwRTreeNode_t*));
+    offsets = malloc(mNodes * sizeof(uint64_t));
+    if(!nodes || !offsets) goto error;
+
+    //Where each node goes
+    idx->rootOffset = bwTell(fp) + 48;
+    nodes[0] = root;
+    offsets[0] = idx->rootOffset;
+    nextOffset = offsets[0] + indexNodeSize(root);
+    for(i=0; i<nNodes; i++) {
+        if(nodes[i]->isLeaf) continue;
+        for(j=0; j<nodes[i]->nChildren; j++) {
+            if(nNodes == mNodes) {
+                mNodes *= 2;
+                tmp = realloc(nodes, mNodes * sizeof(bwRTreeNode_t*));
+                if(!tmp) goto error;
+                nodes = tmp;
+                tmp2 = realloc(offsets, mNodes * sizeof(uint64_t));
+                if(!tmp2) goto error;
+                offsets = tmp2;
             }
-            *wrote = 1;
+            n = nodes[i]->x.child[j];
+            nodes[i]->dataOffset[j] = nextOffset;
+            nodes[nNodes] = n;
+            offsets[nNodes++] = nextOffset;
+            nextOffset += indexNodeSize(n);
         }
     }
 
-    return 0;
-}
-
-//returns 1 on success
-int writeIndexOffsets(FILE *fp, bwRTreeNode_t *n, uint64_t offset) {
-    uint32_t i;
-
-    if(n->isLeaf) return 0;
-    for(i=0; i<n->nChildren; i++) {
-        if(writeIndexOffsets(fp, n->x.child[i], n->dataOffset[i])) return 1;
-        if(writeAtPos(&(n->dataOffset[i]), sizeof(uint64_t), 1, offset+20+24*i, fp)) return 2;
-    }
-    return 0;
-}
-
-//Returns 0 on success
-int writeIndexTree(bigWigFile_t *fp) {
-    uint64_t offset;
-    uint8_t wrote = 0;
-    int rv;
-
-    while((rv = writeIndexTreeNode(fp->URL->x.fp, fp->idx->root, &wrote, 0)) == 0) {
-        if(!wrote) break;
-        wrote = 0;
+    sz = nextOffset - idx->rootOffset + 48;
+    buf = malloc(sz);
+    if(!buf) goto error;
+
+    //The header
+    p = buf;
+    j = IDX_MAGIC;
+    memcpy(p, &j, sizeof(uint32_t));
+    memcpy(p+4, &(fp->writeBuffer->blockSize), sizeof(uint32_t));
+    memcpy(p+8, &nBlocks, sizeof(uint64_t));
+    memcpy(p+16, &(root->chrIdxStart[0]), sizeof(uint32_t));
+    memcpy(p+20, &(root->baseStart[0]), sizeof(uint32_t));
+    memcpy(p+24, &(root->chrIdxEnd[root->nChildren-1]), sizeof(uint32_t));
+    memcpy(p+28, &(root->baseEnd[root->nChildren-1]), sizeof(uint32_t));
+    memcpy(p+32, &idxSize, sizeof(uint64_t));
+    memcpy(p+40, &itemsPerSlot, sizeof(uint32_t));
+    memset(p+44, 0, 4); //padding
+    p += 48;
+
+    for(i=0; i<nNodes; i++) {
+        n = nodes[i];
+        *p = n->isLeaf;
+        *(p+1) = 0; //one byte of padding
+        memcpy(p+2, &(n->nChildren), sizeof(uint16_t));
+        p += 4;
+        for(j=0; j<n->nChildren; j++) {
+            vector[0] = n->chrIdxStart[j];
+            vector[1] = n->baseStart[j];
+            vector[2] = n->chrIdxEnd[j];
+            vector[3] = n->baseEnd[j];
+            memcpy(p, vector, 4*sizeof(uint32_t));
+            //Leaves include the offset and size of each block, other nodes the offset of each child
+            memcpy(p+16, &(n->dataOffset[j]), sizeof(uint64_t));
+            if(n->isLeaf) {
+                memcpy(p+24, &(n->x.size[j]), sizeof(uint64_t));
+                p += 32;
+            } else {
+                p += 24;
+            }
+        }
     }
 
-    if(rv || wrote) return 1;
-
-    //Save the file position
-    offset = bwTell(fp);
+    if(bwWrite(buf, sizeof(uint8_t), sz, fp) != sz) goto error;
+    rv = 0;
 
-    //Write the offsets
-    if(writeIndexOffsets(fp->URL->x.fp, fp->idx->root, fp->idx->rootOffset)) return 2;
-
-    //Move the file pointer back to the end
-    bwSetPos(fp, offset);
-
-    return 0;
+error:
+    if(nodes) free(nodes);
+    if(offsets) free(offsets);
+    if(buf) free(buf);
+    return rv;
 }
 
 //Returns 0 on success. The original state SHOULD be preserved on error
 int writeIndex(bigWigFile_t *fp) {
-    uint32_t four = IDX_MAGIC;
     uint64_t idxSize = 0, foo;
-    uint8_t one = 0;
-    uint32_t i, vector[6] = {0, 0, 0, 0, 0, 0}; //The last 8 bytes are left as 0
-    bwLL *ll = fp->writeBuffer->firstIndexNode, *p;
     bwRTreeNode_t *root = NULL;
 
     if(!fp->writeBuffer->nBlocks) return 0;
-    fp->idx = malloc(sizeof(bwRTree_t));
+    fp->idx = calloc(1, sizeof(bwRTree_t));
     if(!fp->idx) return 2;
     fp->idx->root = root;
 
     //Update the file header to indicate the proper index position
     foo = bwTell(fp);
-    if(writeAtPos(&foo, sizeof(uint64_t), 1, 0x18, fp->URL->x.fp)) return 3;
+    if(writeAtPos(&foo, sizeof(uint64_t), 1, 0x18, fp)) return 3;
 
     //Make the tree
-    if(ll == fp->writeBuffer->currentIndexNode) {
-        root = ll->node;
-        idxSize = 4 + 24*root->nChildren;
-    } else {
-        root = addLeaves(&ll, &idxSize, ceil(((double)fp->writeBuffer->nBlocks)/fp->writeBuffer->blockSize), fp->writeBuffer->blockSize);
-    }
+    root = buildIndexTree(fp, &idxSize);
     if(!root) return 4;
+    if(root->isLeaf) idxSize = 4 + 24*root->nChildren;
     fp->idx->root = root;
 
-    ll = fp->writeBuffer->firstIndexNode;
-    while(ll) {
-        p = ll->next;
-        free(ll);
-        ll=p;
-    }
-
-    //write the header
-    if(fwrite(&four, sizeof(uint32_t), 1, fp->URL->x.fp) != 1) return 5;
-    if(fwrite(&(fp->writeBuffer->blockSize), sizeof(uint32_t), 1, fp->URL->x.fp) != 1) return 6;
-    if(fwrite(&(fp->writeBuffer->nBlocks), sizeof(uint64_t), 1, fp->URL->x.fp) != 1) return 7;
-    if(fwrite(&(root->chrIdxStart[0]), sizeof(uint32_t), 1, fp->URL->x.fp) != 1) return 8;
-    if(fwrite(&(root->baseStart[0]), sizeof(uint32_t), 1, fp->URL->x.fp) != 1) return 9;
-    if(fwrite(&(root->chrIdxEnd[root->nChildren-1]), sizeof(uint32_t), 1, fp->URL->x.fp) != 1) return 10;
-    if(fwrite(&(root->baseEnd[root->nChildren-1]), sizeof(uint32_t), 1, fp->URL->x.fp) != 1) return 11;
-    if(fwrite(&idxSize, sizeof(uint64_t), 1, fp->URL->x.fp) != 1) return 12;
-    four = 1;
-    if(fwrite(&four, sizeof(uint32_t), 1, fp->URL->x.fp) != 1) return 13;
-    four = 0;
-    if(fwrite(&four, sizeof(uint32_t), 1, fp->URL->x.fp) != 1) return 14; //padding
-    fp->idx->rootOffset = bwTell(fp);
-
-    //Write the root node, since writeIndexTree writes the children and fills in the offset
-    if(fwrite(&(root->isLeaf), sizeof(uint8_t), 1, fp->URL->x.fp) != 1) return 16;
-    if(fwrite(&one, sizeof(uint8_t), 1, fp->URL->x.fp) != 1) return 17; //one byte of padding
-    if(fwrite(&(root->nChildren), sizeof(uint16_t), 1, fp->URL->x.fp) != 1) return 18;
-    for(i=0; i<root->nChildren; i++) {
-        vector[0] = root->chrIdxStart[i];
-        vector[1] = root->baseStart[i];
-        vector[2] = root->chrIdxEnd[i];
-        vector[3] = root->baseEnd[i];
-        if(root->isLeaf) {
-            //Include the offset and size
-            if(fwrite(vector, sizeof(uint32_t), 4, fp->URL->x.fp) != 4) return 19;
-            if(fwrite(&(root->dataOffset[i]), sizeof(uint64_t), 1, fp->URL->x.fp) != 1) return 20;
-            if(fwrite(&(root->x.size[i]), sizeof(uint64_t), 1, fp->URL->x.fp) != 1) return 21;
-        } else {
-            root->dataOffset[i] = 0; //FIXME: Something upstream is setting this to impossible values (e.g., 0x21?!?!?)
-            if(fwrite(vector, sizeof(uint32_t), 6, fp->URL->x.fp) != 6) return 22;
-        }
+    //write the header and tree
+    if(writeRTree(fp, fp->idx, fp->writeBuffer->nBlocks, idxSize, 1)) return 5;
+
+    return 0;
+}
+
+//Allocate the zoom headers for up to n levels
+//Returns 0 on success
+static int allocZoomHdrs(bigWigFile_t *fp, uint16_t n) {
+    fp->hdr->zoomHdrs = calloc(1, sizeof(bwZoomHdr_t));
+    if(!fp->hdr->zoomHdrs) return 1;
+    fp->hdr->zoomHdrs->level = malloc(n * sizeof(uint32_t));
+    fp->hdr->zoomHdrs->dataOffset = calloc(n, sizeof(uint64_t));
+    fp->hdr->zoomHdrs->indexOffset = calloc(n, sizeof(uint64_t));
+    fp->hdr->zoomHdrs->idx = calloc(n, sizeof(bwRTree_t*));
+    if(!fp->hdr->zoomHdrs->level) return 2;
+    if(!fp->hdr->zoomHdrs->dataOffset) return 3;
+    if(!fp->hdr->zoomHdrs->indexOffset) return 4;
+    if(!fp->hdr->zoomHdrs->idx) return 5;
+    return 0;
+}
+
+//Free a linked list of zoom buffers
+static void destroyZoomBuffer(bwZoomBuffer_t *zb) {
+    bwZoomBuffer_t *zb2;
+    while(zb) {
+        if(zb->p) free(zb->p);
+        zb2 = zb->next;
+        free(zb);
+        zb = zb2;
     }
+}
+
+//Free whatever remains of the zoom buffers
+static void destroyZoomBuffers(bigWigFile_t *fp) {
+    bwWriteBuffer_t *wb = fp->writeBuffer;
+    uint32_t i;
+    if(wb->firstZoomBuffer) {
+        for(i=0; i<fp->hdr->nLevels; i++) destroyZoomBuffer(wb->firstZoomBuffer[i]);
+        free(wb->firstZoomBuffer);
+    }
+    if(wb->lastZoomBuffer) free(wb->lastZoomBuffer);
+    if(wb->nNodes) free(wb->nNodes);
+    if(wb->zoomSum) free(wb->zoomSum);
+    if(wb->zoomSumsq) free(wb->zoomSumsq);
+    wb->firstZoomBuffer = NULL;
+    wb->lastZoomBuffer = NULL;
+    wb->nNodes = NULL;
+    wb->zoomSum = NULL;
+    wb->zoomSumsq = NULL;
+}
+
+//Allocate an empty buffer for each zoom level, whose sizes must already be set
+//Returns 0 on success
+static int allocZoomBuffers(bigWigFile_t *fp) {
+    uint16_t nLevels = fp->hdr->nLevels;
+    uint32_t i;
+
+    fp->writeBuffer->firstZoomBuffer = calloc(nLevels,sizeof(bwZoomBuffer_t*));
+    if(!fp->writeBuffer->firstZoomBuffer) goto error;
+    fp->writeBuffer->lastZoomBuffer = calloc(nLevels,sizeof(bwZoomBuffer_t*));
+    if(!fp->writeBuffer->lastZoomBuffer) goto error;
+    fp->writeBuffer->nNodes = calloc(nLevels, sizeof(uint64_t));
+    if(!fp->writeBuffer->nNodes) goto error;
+    fp->writeBuffer->zoomSum = calloc(nLevels, sizeof(double));
+    if(!fp->writeBuffer->zoomSum) goto error;
+    fp->writeBuffer->zoomSumsq = calloc(nLevels, sizeof(double));
+    if(!fp->writeBuffer->zoomSumsq) goto error;
 
-    //Write each level
-    if(writeIndexTree(fp)) return 23;
+    for(i=0; i<nLevels; i++) {
+        fp->writeBuffer->firstZoomBuffer[i] = calloc(1, sizeof(bwZoomBuffer_t));
+        if(!fp->writeBuffer->firstZoomBuffer[i]) goto error;
+        fp->writeBuffer->firstZoomBuffer[i]->p = calloc(fp->hdr->bufSize/32, 32);
+        if(!fp->writeBuffer->firstZoomBuffer[i]->p) goto error;
+        fp->writeBuffer->firstZoomBuffer[i]->m = fp->hdr->bufSize;
+        ((uint32_t*)fp->writeBuffer->firstZoomBuffer[i]->p)[0] = 0;
+        ((uint32_t*)fp->writeBuffer->firstZoomBuffer[i]->p)[1] = 0;
+        ((uint32_t*)fp->writeBuffer->firstZoomBuffer[i]->p)[2] = fp->hdr->zoomHdrs->level[i];
+        if(fp->hdr->zoomHdrs->level[i] > fp->cl->len[0]) ((uint32_t*)fp->writeBuffer->firstZoomBuffer[i]->p)[2] = fp->cl->len[0];
+        fp->writeBuffer->lastZoomBuffer[i] =  fp->writeBuffer->firstZoomBuffer[i];
+    }
 
     return 0;
+
+error:
+    destroyZoomBuffers(fp);
+    return 1;
 }
 
 //The first zoom level has a resolution of 4x mean entry size
@@ -814,19 +1277,13 @@ int makeZoomLevels(bigWigFile_t *fp) {
     //In reality, one level is skipped
     meanBinSize *= 4;
     //N.B., we must ALWAYS check that the zoom doesn't overflow a uint32_t!
-    if(((uint32_t)-1)>>2 < meanBinSize) return 0; //No zoom levels!
+    if(((uint32_t)-1)>>2 < meanBinSize) { //No zoom levels!
+        fp->hdr->nLevels = 0;
+        return 0;
+    }
     if(meanBinSize*4 > zoom) zoom = multiplier*meanBinSize;
 
-    fp->hdr->zoomHdrs = calloc(1, sizeof(bwZoomHdr_t));
-    if(!fp->hdr->zoomHdrs) return 1;
-    fp->hdr->zoomHdrs->level = malloc(fp->hdr->nLevels * sizeof(uint32_t));
-    fp->hdr->zoomHdrs->dataOffset = calloc(fp->hdr->nLevels, sizeof(uint64_t));
-    fp->hdr->zoomHdrs->indexOffset = calloc(fp->hdr->nLevels, sizeof(uint64_t));
-    fp->hdr->zoomHdrs->idx = calloc(fp->hdr->nLevels, sizeof(bwRTree_t*));
-    if(!fp->hdr->zoomHdrs->level) return 2;
-    if(!fp->hdr->zoomHdrs->dataOffset) return 3;
-    if(!fp->hdr->zoomHdrs->indexOffset) return 4;
-    if(!fp->hdr->zoomHdrs->idx) return 5;
+    if(allocZoomHdrs(fp, fp->hdr->nLevels)) return 1;
 
     //There's no point in having a zoom level larger than the largest chromosome
     //This will none the less allow at least one zoom level, which is generally needed for IGV et al.
@@ -844,40 +1301,30 @@ int makeZoomLevels(bigWigFile_t *fp) {
     }
     fp->hdr->nLevels = nLevels;
 
-    fp->writeBuffer->firstZoomBuffer = calloc(nLevels,sizeof(bwZoomBuffer_t*));
-    if(!fp->writeBuffer->firstZoomBuffer) goto error;
-    fp->writeBuffer->lastZoomBuffer = calloc(nLevels,sizeof(bwZoomBuffer_t*));
-    if(!fp->writeBuffer->lastZoomBuffer) goto error;
-    fp->writeBuffer->nNodes = calloc(nLevels, sizeof(uint64_t));
-
-    for(i=0; i<fp->hdr->nLevels; i++) {
-        fp->writeBuffer->firstZoomBuffer[i] = calloc(1, sizeof(bwZoomBuffer_t));
-        if(!fp->writeBuffer->firstZoomBuffer[i]) goto error;
-        fp->writeBuffer->firstZoomBuffer[i]->p = calloc(fp->hdr->bufSize/32, 32);
-        if(!fp->writeBuffer->firstZoomBuffer[i]->p) goto error;
-        fp->writeBuffer->firstZoomBuffer[i]->m = fp->hdr->bufSize;
-        ((uint32_t*)fp->writeBuffer->firstZoomBuffer[i]->p)[0] = 0;
-        ((uint32_t*)fp->writeBuffer->firstZoomBuffer[i]->p)[1] = 0;
-        ((uint32_t*)fp->writeBuffer->firstZoomBuffer[i]->p)[2] = fp->hdr->zoomHdrs->level[i];
-        if(fp->hdr->zoomHdrs->level[i] > fp->cl->len[0]) ((uint32_t*)fp->writeBuffer->firstZoomBuffer[i]->p)[2] = fp->cl->len[0];
-        fp->writeBuffer->lastZoomBuffer[i] =  fp->writeBuffer->firstZoomBuffer[i];
-    }
+    if(allocZoomBuffers(fp)) return 6;
 
     return 0;
+}
 
-error:
-    if(fp->writeBuffer->firstZoomBuffer) {
-        for(i=0; i<fp->hdr->nLevels; i++) {
-            if(fp->writeBuffer->firstZoomBuffer[i]) {
-                if(fp->writeBuffer->firstZoomBuffer[i]->p) free(fp->writeBuffer->firstZoomBuffer[i]->p);
-                free(fp->writeBuffer->firstZoomBuffer[i]);
-            }
-        }
-        free(fp->writeBuffer->firstZoomBuffer);
+int bwSetZoomLevels(bigWigFile_t *fp, const uint32_t *sizes, uint16_t n) {
+    uint16_t i;
+    if(!fp->isWrite) return 1;
+    if(!fp->writeBuffer || !fp->hdr || !fp->cl) return 2;
+    //Space for the zoom headers may already have been reserved by bwWriteHdr()
+    if(n > fp->hdr->nLevels) return 3;
+    if(fp->writeBuffer->nEntries || fp->hdr->zoomHdrs) return 4;
+    for(i=0; i<n; i++) {
+        if(!sizes[i] || (i && sizes[i] <= sizes[i-1])) return 5;
     }
-    if(fp->writeBuffer->lastZoomBuffer) free(fp->writeBuffer->lastZoomBuffer);
-    if(fp->writeBuffer->nNodes) free(fp->writeBuffer->lastZoomBuffer);
-    return 6;
+
+    fp->hdr->nLevels = n;
+    if(!n) return 0;
+    if(allocZoomHdrs(fp, n)) return 6;
+    memcpy(fp->hdr->zoomHdrs->level, sizes, n * sizeof(uint32_t));
+    if(allocZoomBuffers(fp)) return 7;
+    fp->writeBuffer->zoomState = ZOOM_INCREMENTAL;
+
+    return 0;
 }
 
 //Given an interval start, calculate the next one at a zoom level
@@ -921,7 +1368,6 @@ uint32_t updateInterval(bigWigFile_t *fp, bwZoomBuffer_t *buffer, double *sum, d
     float *fp2 = (float*) p2;
     uint32_t rv = 0, offset = 0;
     if(!buffer) return 0;
-    if(buffer->l+32 >= buffer->m) return 0;
 
     //Make sure that we don't overflow a uint32_t by adding some huge value to start
     if(start + size < start) size = ((uint32_t) -1) - start;
@@ -947,6 +1393,8 @@ uint32_t updateInterval(bigWigFile_t *fp, bwZoomBuffer_t *buffer, double *sum, d
             *sumsq += rv*pow(value, 2.0);
             return rv;
         } else {
+            //A new record is needed. If the buffer is full, the caller starts a new one, storing the sums of this one's last record
+            if(buffer->l+32 >= buffer->m) return 0;
             fp2[8*(offset-1)+6] = *sum;
             fp2[8*(offset-1)+7] = *sumsq;
             *sum = 0.0;
@@ -980,6 +1428,112 @@ uint32_t updateInterval(bigWigFile_t *fp, bwZoomBuffer_t *buffer, double *sum, d
     return rv;
 }
 
+//Move a completed zoom buffer to the spill file, freeing its memory
+//Returns 0 on success
+static int spillZoomBuffer(bigWigFile_t *fp, bwZoomBuffer_t *zb) {
+    bwWriteBuffer_t *wb = fp->writeBuffer;
+    if(fwrite(zb->p, sizeof(uint8_t), zb->l, wb->zoomSpill) != zb->l) return 1;
+    zb->offset = wb->zoomSpillSz;
+    wb->zoomSpillSz += zb->l;
+    free(zb->p);
+    zb->p = NULL;
+    return 0;
+}
+
+//Read a spilled zoom buffer back into buf, which must hold at least bufSize bytes
+//Returns 0 on success
+static int readSpilledZoomBuffer(bigWigFile_t *fp, bwZoomBuffer_t *zb, void *buf) {
+    FILE *f = fp->writeBuffer->zoomSpill;
+    if(fseek(f, zb->offset, SEEK_SET)) return 1;
+    if(fread(buf, sizeof(uint8_t), zb->l, f) != zb->l) return 2;
+    return 0;
+}
+
+//Open a temporary file in dir, or from tmpfile() if dir is NULL, that's removed once it's closed
+//Returns NULL on error
+static FILE *openTempFile(const char *dir) {
+    char *fname = NULL;
+    FILE *f = NULL;
+    int fd;
+
+    if(!dir) return tmpfile();
+
+    fname = malloc(strlen(dir) + 20);
+    if(!fname) return NULL;
+    sprintf(fname, "%s/libBigWig.XXXXXX", dir);
+    fd = mkstemp(fname);
+    if(fd < 0) {
+        free(fname);
+        return NULL;
+    }
+    unlink(fname);
+    free(fname);
+    f = fdopen(fd, "w+b");
+    if(!f) close(fd);
+    return f;
+}
+
+int bwSetZoomSpill(bigWigFile_t *fp, const char *dir) {
+    bwWriteBuffer_t *wb = fp->writeBuffer;
+    if(!fp->isWrite) return 1;
+    if(!wb || !fp->hdr) return 2;
+    if(wb->zoomSpill || wb->nEntries) return 3;
+
+    wb->zoomSpill = openTempFile(dir);
+    return wb->zoomSpill ? 0 : 4;
+}
+
+int bwSetStreamOutput(bigWigFile_t *fp, const char *dir) {
+    bwWriteBuffer_t *wb = fp->writeBuffer;
+    FILE *spool;
+    if(!fp->isWrite) return 1;
+    if(!wb || !fp->hdr || fp->URL->type != BWG_FILE) return 2;
+    //Nothing can have been written yet
+    if(wb->sink || fp->hdr->dataOffset) return 3;
+
+    spool = openTempFile(dir);
+    if(!spool) return 4;
+    //Everything is written to the spool until the file is finalized
+    wb->sink = fp->URL->x.fp;
+    fp->URL->x.fp = spool;
+
+    //bwOpen() opens the output for reading too, which for a pipe would keep it from ever being closed by the other end
+    wb->sink = freopen(NULL, "wb", wb->sink);
+    if(!wb->sink) return 5;
+    return 0;
+}
+
+//Copy the finished file from the spool to the output, from start to end
+//Returns 0 on success
+static int copySpool(bigWigFile_t *fp) {
+    bwWriteBuffer_t *wb = fp->writeBuffer;
+    FILE *spool = fp->URL->x.fp;
+    size_t l, bufSize = 1<<20;
+    void *buf = malloc(bufSize);
+    int rv = 0;
+    if(!buf) return 1;
+
+    if(fflush(spool) || fseek(spool, 0, SEEK_SET)) rv = 2;
+    while(!rv && (l = fread(buf, 1, bufSize, spool)) > 0) {
+        if(fwrite(buf, 1, l, wb->sink) != l) rv = 3;
+    }
+    if(!rv && ferror(spool)) rv = 4;
+    if(!rv && fflush(wb->sink)) rv = 5;
+    //Leave the spool where it was, in case anything else is written
+    if(fseek(spool, 0, SEEK_END)) rv = 6;
+
+    free(buf);
+    return rv;
+}
+
+//Store the running sum and sum of squares in the last record of a zoom buffer, which updateInterval() only does once the next record is started
+static void storeZoomSums(bwZoomBuffer_t *zb, double sum, double sumsq) {
+    float *f = (float*) zb->p;
+    if(!zb->l) return;
+    f[zb->l/4 - 2] = sum;
+    f[zb->l/4 - 1] = sumsq;
+}
+
 //Returns 0 on success
 int addIntervalValue(bigWigFile_t *fp, uint64_t *nEntries, double *sum, double *sumsq, bwZoomBuffer_t *buffer, uint32_t itemsPerSlot, uint32_t zoom, uint32_t tid, uint32_t start, uint32_t end, float value) {
     bwZoomBuffer_t *newBuffer = NULL;
@@ -997,10 +1551,13 @@ int addIntervalValue(bigWigFile_t *fp, uint64_t *nEntries, double *sum, double *
             memcpy(newBuffer->p, (unsigned char*)buffer->p+buffer->l-32, 4);
             memcpy((unsigned char*)newBuffer->p+4, (unsigned char*)buffer->p + buffer->l-28, 4);
             ((uint32_t*) newBuffer->p)[2] = ((uint32_t*) newBuffer->p)[1] + zoom;
+            storeZoomSums(buffer, *sum, *sumsq);
             *sum = *sumsq = 0.0;
             rv = updateInterval(fp, newBuffer, sum, sumsq, zoom, tid, start, end, value);
             if(!rv) goto error;
             buffer->next = newBuffer;
+            //Nothing more is added to a buffer once the next one is started
+            if(fp->writeBuffer->zoomSpill && spillZoomBuffer(fp, buffer)) return 3;
             buffer = buffer->next;
             *nEntries += 1;
         }
@@ -1017,25 +1574,101 @@ error:
     return 2;
 }
 
+//Add an interval to every zoom level
+//Returns 0 on success
+static int addZoomValue(bigWigFile_t *fp, uint32_t tid, uint32_t start, uint32_t end, float value) {
+    bwWriteBuffer_t *wb = fp->writeBuffer;
+    uint32_t k;
+
+    for(k=0; k<fp->hdr->nLevels; k++) {
+        if(addIntervalValue(fp, &(wb->nNodes[k]), wb->zoomSum+k, wb->zoomSumsq+k, wb->lastZoomBuffer[k], fp->hdr->bufSize/32, fp->hdr->zoomHdrs->level[k], tid, start, end, value)) return 1;
+        while(wb->lastZoomBuffer[k]->next) wb->lastZoomBuffer[k] = wb->lastZoomBuffer[k]->next;
+    }
+    return 0;
+}
+
+//Choose the zoom level sizes from the entries added so far and then add the held entries to them
+//Returns 0 on success
+static int startZoomLevels(bigWigFile_t *fp) {
+    bwWriteBuffer_t *wb = fp->writeBuffer;
+    bwZoomEntry_t *e;
+    uint32_t i;
+
+    if(makeZoomLevels(fp)) return 1;
+    wb->zoomState = ZOOM_INCREMENTAL;
+    for(i=0; i<wb->nZoomSample; i++) {
+        e = wb->zoomSample + i;
+        if(addZoomValue(fp, e->tid, e->start, e->end, e->value)) return 2;
+    }
+
+    free(wb->zoomSample);
+    wb->zoomSample = NULL;
+    wb->nZoomSample = wb->mZoomSample = 0;
+    return 0;
+}
+
+//Entries can only be added to the zoom levels as they're written if they're in chromosome order
+//Otherwise, discard what's been done so far and make the zoom levels from the file when it's finalized
+//Returns 0 on success
+static int abandonZoomLevels(bigWigFile_t *fp) {
+    bwWriteBuffer_t *wb = fp->writeBuffer;
+
+    wb->zoomState = ZOOM_REREAD;
+    if(wb->zoomSample) free(wb->zoomSample);
+    wb->zoomSample = NULL;
+    wb->nZoomSample = wb->mZoomSample = 0;
+
+    //Any sizes already chosen are kept
+    if(!fp->hdr->zoomHdrs || !wb->firstZoomBuffer) return 0;
+    destroyZoomBuffers(fp);
+    if(wb->zoomSpill) {
+        if(fseek(wb->zoomSpill, 0, SEEK_SET)) return 1;
+        wb->zoomSpillSz = 0;
+    }
+    return allocZoomBuffers(fp);
+}
+
+//Add an entry in the current chromosome to the zoom levels, or hold on to it if their sizes haven't been chosen yet
+//Returns 0 on success
+static int addZoomEntry(bigWigFile_t *fp, uint32_t start, uint32_t end, float value) {
+    bwWriteBuffer_t *wb = fp->writeBuffer;
+    bwZoomEntry_t *sample;
+
+    if(!fp->hdr->nLevels || wb->zoomState == ZOOM_REREAD) return 0;
+    if(wb->tid < wb->zoomTid) return abandonZoomLevels(fp);
+    wb->zoomTid = wb->tid;
+    //These would be skipped when reading the file back in
+    if(!end || start >= fp->cl->len[wb->tid]) return 0;
+
+    if(wb->zoomState == ZOOM_INCREMENTAL) return addZoomValue(fp, wb->tid, start, end, value);
+
+    if(wb->nZoomSample == wb->mZoomSample) {
+        wb->mZoomSample = wb->mZoomSample ? 2*wb->mZoomSample : 1024;
+        sample = realloc(wb->zoomSample, wb->mZoomSample * sizeof(bwZoomEntry_t));
+        if(!sample) return 1;
+        wb->zoomSample = sample;
+    }
+    sample = wb->zoomSample + wb->nZoomSample++;
+    sample->tid = wb->tid;
+    sample->start = start;
+    sample->end = end;
+    sample->value = value;
+
+    if(wb->nZoomSample < ZOOM_SAMPLE_SIZE) return 0;
+    return startZoomLevels(fp);
+}
+
 //Get all of the intervals and add them to the appropriate zoomBuffer
 int constructZoomLevels(bigWigFile_t *fp) {
     bwOverlapIterator_t *it = NULL;
-    double *sum = NULL, *sumsq = NULL;
-    uint32_t i, j, k;
-
-    sum = calloc(fp->hdr->nLevels, sizeof(double));
-    sumsq = calloc(fp->hdr->nLevels, sizeof(double));
-    if(!sum || !sumsq) goto error;
+    uint32_t i, j;
 
     for(i=0; i<fp->cl->nKeys; i++) {
         it = bwOverlappingIntervalsIterator(fp, fp->cl->chrom[i], 0, fp->cl->len[i], 100000);
         if(!it) goto error;
 	while(it->data != NULL){
 	  for(j=0;j<it->intervals->l;j++){
-		for(k=0;k<fp->hdr->nLevels;k++){
-			if(addIntervalValue(fp, &(fp->writeBuffer->nNodes[k]), sum+k, sumsq+k, fp->writeBuffer->lastZoomBuffer[k], fp->hdr->bufSize/32, fp->hdr->zoomHdrs->level[k], i, it->intervals->start[j], it->intervals->end[j], it->intervals->value[j])) goto error;
-			while(fp->writeBuffer->lastZoomBuffer[k]->next) fp->writeBuffer->lastZoomBuffer[k] = fp->writeBuffer->lastZoomBuffer[k]->next;
-		}
+		if(addZoomValue(fp, i, it->intervals->start[j], it->intervals->end[j], it->intervals->value[j])) goto error;
 	  }
 	  it = bwIteratorNext(it);
 	}
@@ -1043,37 +1676,45 @@ int constructZoomLevels(bigWigFile_t *fp) {
 
     }
 
-    //Make an index for each zoom level
+    return 0;
+
+error:
+    if(it) bwIteratorDestroy(it);
+    return 1;
+}
+
+//Ensure that every entry is in the zoom levels and make an index for each
+//Returns 0 on success
+static int finishZoomLevels(bigWigFile_t *fp) {
+    uint32_t i;
+
+    switch(fp->writeBuffer->zoomState) {
+    case ZOOM_SAMPLING:
+        if(startZoomLevels(fp)) return 1;
+        break;
+    case ZOOM_REREAD:
+        if(!fp->hdr->zoomHdrs && makeZoomLevels(fp)) return 2;
+        if(fp->hdr->nLevels && constructZoomLevels(fp)) return 3;
+        break;
+    }
+
     for(i=0; i<fp->hdr->nLevels; i++) {
+        storeZoomSums(fp->writeBuffer->lastZoomBuffer[i], fp->writeBuffer->zoomSum[i], fp->writeBuffer->zoomSumsq[i]);
         fp->hdr->zoomHdrs->idx[i] = calloc(1, sizeof(bwRTree_t));
-        if(!fp->hdr->zoomHdrs->idx[i]) return 1;
+        if(!fp->hdr->zoomHdrs->idx[i]) return 4;
         fp->hdr->zoomHdrs->idx[i]->blockSize = fp->writeBuffer->blockSize;
     }
 
-
-    free(sum);
-    free(sumsq);
-
     return 0;
-
-error:
-    if(it) bwIteratorDestroy(it);
-    if(sum) free(sum);
-    if(sumsq) free(sumsq);
-    return 1;
 }
 
 int writeZoomLevels(bigWigFile_t *fp) {
-    uint64_t offset1, offset2, idxSize = 0;
-    uint32_t i, j, four = 0, last, vector[6] = {0, 0, 0, 0, 0, 0}; //The last 8 bytes are left as 0;
-    uint8_t wrote, one = 0;
+    uint64_t offset1, idxSize = 0;
+    uint32_t i, four = 0, last;
     uint16_t actualNLevels = 0;
-    int rv;
-    bwLL *ll, *p;
     bwRTreeNode_t *root;
-    bwZoomBuffer_t *zb, *zb2;
+    bwZoomBuffer_t *zb;
     bwWriteBuffer_t *wb = fp->writeBuffer;
-    uLongf sz;
 
     for(i=0; i<fp->hdr->nLevels; i++) {
         if(i) {
@@ -1086,122 +1727,43 @@ int writeZoomLevels(bigWigFile_t *fp) {
         fp->hdr->zoomHdrs->dataOffset[i] = bwTell(fp);
         fp->writeBuffer->nBlocks = 0;
         fp->writeBuffer->l = 24;
-        if(fwrite(&four, sizeof(uint32_t), 1, fp->URL->x.fp) != 1) return 1;
+        if(bwWrite(&four, sizeof(uint32_t), 1, fp) != 1) return 1;
         zb = fp->writeBuffer->firstZoomBuffer[i];
-        fp->writeBuffer->firstIndexNode = NULL;
-        fp->writeBuffer->currentIndexNode = NULL;
         while(zb) {
-            sz = fp->hdr->bufSize;
-            if(compress(wb->compressP, &sz, zb->p, zb->l) != Z_OK) return 2;
-
-            //write the data to disk
-            if(fwrite(wb->compressP, sizeof(uint8_t), sz, fp->URL->x.fp) != sz) return 3;
-
-            //Add an entry into the index
+            //compress, write the data to disk and add an entry into the index
             last = (zb->l - 32)>>2;
-            if(addIndexEntry(fp, ((uint32_t*)zb->p)[0], ((uint32_t*)zb->p)[last], ((uint32_t*)zb->p)[1], ((uint32_t*)zb->p)[last+2], bwTell(fp)-sz, sz)) return 4;
+            if(zb->p) {
+                if(writeBlock(fp, &(zb->p), zb->l, 0, ((uint32_t*)zb->p)[0], ((uint32_t*)zb->p)[last], ((uint32_t*)zb->p)[1], ((uint32_t*)zb->p)[last+2])) return 2;
+            } else {
+                //Spilled buffers are read into the (now unused) data buffer, which is then handed over like a data block
+                if(readSpilledZoomBuffer(fp, zb, wb->p)) return 2;
+                if(writeBlock(fp, &(wb->p), zb->l, 1, ((uint32_t*)wb->p)[0], ((uint32_t*)wb->p)[last], ((uint32_t*)wb->p)[1], ((uint32_t*)wb->p)[last+2])) return 2;
+            }
 
-            wb->nBlocks++;
             wb->l = 24;
             zb = zb->next;
         }
-        if(writeAtPos(&(wb->nBlocks), sizeof(uint32_t), 1, fp->hdr->zoomHdrs->dataOffset[i], fp->URL->x.fp)) return 5;
+        if(wb->pool && drainWritePool(wb->pool)) return 3;
+        if(writeAtPos(&(wb->nBlocks), sizeof(uint32_t), 1, fp->hdr->zoomHdrs->dataOffset[i], fp)) return 5;
 
         //Make the tree
-        ll = fp->writeBuffer->firstIndexNode;
-        if(ll == fp->writeBuffer->currentIndexNode) {
-            root = ll->node;
-            idxSize = 4 + 24*root->nChildren;
-        } else {
-            root = addLeaves(&ll, &idxSize, ceil(((double)fp->writeBuffer->nBlocks)/fp->writeBuffer->blockSize), fp->writeBuffer->blockSize);
-        }
+        root = buildIndexTree(fp, &idxSize);
         if(!root) return 4;
+        if(root->isLeaf) idxSize = 4 + 24*root->nChildren;
         fp->hdr->zoomHdrs->idx[i]->root = root;
 
-        ll = fp->writeBuffer->firstIndexNode;
-        while(ll) {
-            p = ll->next;
-            free(ll);
-            ll=p;
-        }
-
-
         //write the index
-        wrote = 0;
         fp->hdr->zoomHdrs->indexOffset[i] = bwTell(fp);
-        four = IDX_MAGIC;
-        if(fwrite(&four, sizeof(uint32_t), 1, fp->URL->x.fp) != 1) return 1;
-        root = fp->hdr->zoomHdrs->idx[i]->root;
-        if(fwrite(&(fp->writeBuffer->blockSize), sizeof(uint32_t), 1, fp->URL->x.fp) != 1) return 6;
-        if(fwrite(&(fp->writeBuffer->nBlocks), sizeof(uint64_t), 1, fp->URL->x.fp) != 1) return 7;
-        if(fwrite(&(root->chrIdxStart[0]), sizeof(uint32_t), 1, fp->URL->x.fp) != 1) return 8;
-        if(fwrite(&(root->baseStart[0]), sizeof(uint32_t), 1, fp->URL->x.fp) != 1) return 9;
-        if(fwrite(&(root->chrIdxEnd[root->nChildren-1]), sizeof(uint32_t), 1, fp->URL->x.fp) != 1) return 10;
-        if(fwrite(&(root->baseEnd[root->nChildren-1]), sizeof(uint32_t), 1, fp->URL->x.fp) != 1) return 11;
-        if(fwrite(&idxSize, sizeof(uint64_t), 1, fp->URL->x.fp) != 1) return 12;
-        four = fp->hdr->bufSize/32;
-        if(fwrite(&four, sizeof(uint32_t), 1, fp->URL->x.fp) != 1) return 13;
-        four = 0;
-        if(fwrite(&four, sizeof(uint32_t), 1, fp->URL->x.fp) != 1) return 14; //padding
-        fp->hdr->zoomHdrs->idx[i]->rootOffset = bwTell(fp);
-
-        //Write the root node, since writeIndexTree writes the children and fills in the offset
-        offset1 = bwTell(fp);
-        if(fwrite(&(root->isLeaf), sizeof(uint8_t), 1, fp->URL->x.fp) != 1) return 16;
-        if(fwrite(&one, sizeof(uint8_t), 1, fp->URL->x.fp) != 1) return 17; //one byte of padding
-        if(fwrite(&(root->nChildren), sizeof(uint16_t), 1, fp->URL->x.fp) != 1) return 18;
-        for(j=0; j<root->nChildren; j++) {
-            vector[0] = root->chrIdxStart[j];
-            vector[1] = root->baseStart[j];
-            vector[2] = root->chrIdxEnd[j];
-            vector[3] = root->baseEnd[j];
-            if(root->isLeaf) {
-                //Include the offset and size
-                if(fwrite(vector, sizeof(uint32_t), 4, fp->URL->x.fp) != 4) return 19;
-                if(fwrite(&(root->dataOffset[j]), sizeof(uint64_t), 1, fp->URL->x.fp) != 1) return 20;
-                if(fwrite(&(root->x.size[j]), sizeof(uint64_t), 1, fp->URL->x.fp) != 1) return 21;
-            } else {
-                if(fwrite(vector, sizeof(uint32_t), 6, fp->URL->x.fp) != 6) return 22;
-            }
-        }
-
-        while((rv = writeIndexTreeNode(fp->URL->x.fp, fp->hdr->zoomHdrs->idx[i]->root, &wrote, 0)) == 0) {
-            if(!wrote) break;
-            wrote = 0;
-        }
-
-        if(rv || wrote) return 6;
-
-        //Save the file position
-        offset2 = bwTell(fp);
-
-        //Write the offsets
-        if(writeIndexOffsets(fp->URL->x.fp, root, offset1)) return 2;
-
-        //Move the file pointer back to the end
-        bwSetPos(fp, offset2);
-
+        if(writeRTree(fp, fp->hdr->zoomHdrs->idx[i], fp->writeBuffer->nBlocks, idxSize, fp->hdr->bufSize/32)) return 6;
 
         //Free the linked list
-        zb = fp->writeBuffer->firstZoomBuffer[i];
-        while(zb) {
-            if(zb->p) free(zb->p);
-            zb2 = zb->next;
-            free(zb);
-            zb = zb2;
-        }
+        destroyZoomBuffer(fp->writeBuffer->firstZoomBuffer[i]);
         fp->writeBuffer->firstZoomBuffer[i] = NULL;
     }
 
     //Free unused zoom levels
     for(i=actualNLevels; i<fp->hdr->nLevels; i++) {
-        zb = fp->writeBuffer->firstZoomBuffer[i];
-        while(zb) {
-            if(zb->p) free(zb->p);
-            zb2 = zb->next;
-            free(zb);
-            zb = zb2;
-        }
+        destroyZoomBuffer(fp->writeBuffer->firstZoomBuffer[i]);
         fp->writeBuffer->firstZoomBuffer[i] = NULL;
     }
 
@@ -1210,15 +1772,15 @@ int writeZoomLevels(bigWigFile_t *fp) {
     if(bwSetPos(fp, 0x40)) return 7;
     four = 0;
     for(i=0; i<actualNLevels; i++) {
-        if(fwrite(&(fp->hdr->zoomHdrs->level[i]), sizeof(uint32_t), 1, fp->URL->x.fp) != 1) return 8;
-        if(fwrite(&four, sizeof(uint32_t), 1, fp->URL->x.fp) != 1) return 9;
-        if(fwrite(&(fp->hdr->zoomHdrs->dataOffset[i]), sizeof(uint64_t), 1, fp->URL->x.fp) != 1) return 10;
-        if(fwrite(&(fp->hdr->zoomHdrs->indexOffset[i]), sizeof(uint64_t), 1, fp->URL->x.fp) != 1) return 11;
+        if(bwWrite(&(fp->hdr->zoomHdrs->level[i]), sizeof(uint32_t), 1, fp) != 1) return 8;
+        if(bwWrite(&four, sizeof(uint32_t), 1, fp) != 1) return 9;
+        if(bwWrite(&(fp->hdr->zoomHdrs->dataOffset[i]), sizeof(uint64_t), 1, fp) != 1) return 10;
+        if(bwWrite(&(fp->hdr->zoomHdrs->indexOffset[i]), sizeof(uint64_t), 1, fp) != 1) return 11;
     }
 
     //Write the number of levels if needed
     if(bwSetPos(fp, 0x6)) return 12;
-    if(fwrite(&actualNLevels, sizeof(uint16_t), 1, fp->URL->x.fp) != 1) return 13;
+    if(bwWrite(&actualNLevels, sizeof(uint16_t), 1, fp) != 1) return 13;
 
     if(bwSetPos(fp, offset1)) return 14;
 
@@ -1232,11 +1794,13 @@ int bwFinalize(bigWigFile_t *fp) {
     if(!fp->isWrite) return 0;
 
     //Flush the buffer
+    if(flushMergedRun(fp)) return 1;
     if(flushBuffer(fp)) return 1; //Valgrind reports a problem here!
+    if(fp->writeBuffer->pool && drainWritePool(fp->writeBuffer->pool)) return 1;
 
     //Update the data section with the number of blocks written
     if(fp->hdr) {
-        if(writeAtPos(&(fp->writeBuffer->nBlocks), sizeof(uint64_t), 1, fp->hdr->dataOffset, fp->URL->x.fp)) return 2;
+        if(writeAtPos(&(fp->writeBuffer->nBlocks), sizeof(uint64_t), 1, fp->hdr->dataOffset, fp)) return 2;
     } else {
         //The header wasn't written!
         return 1;
@@ -1244,7 +1808,7 @@ int bwFinalize(bigWigFile_t *fp) {
 
     //write the bufferSize
     if(fp->hdr->bufSize) {
-        if(writeAtPos(&(fp->hdr->bufSize), sizeof(uint32_t), 1, 0x34, fp->URL->x.fp)) return 2;
+        if(writeAtPos(&(fp->hdr->bufSize), sizeof(uint32_t), 1, 0x34, fp)) return 2;
     }
 
     //write the summary information
@@ -1256,15 +1820,18 @@ int bwFinalize(bigWigFile_t *fp) {
     //Zoom level stuff here?
     if(fp->hdr->nLevels && fp->writeBuffer->nBlocks) {
         offset = bwTell(fp);
-        if(makeZoomLevels(fp)) return 5;
-        if(constructZoomLevels(fp)) return 6;
+        if(finishZoomLevels(fp)) return 5;
         bwSetPos(fp, offset);
-        if(writeZoomLevels(fp)) return 7; //This write nLevels as well
+        if(fp->hdr->nLevels && writeZoomLevels(fp)) return 7; //This write nLevels as well
     }
+    destroyZoomBuffers(fp);
 
     //write magic at the end of the file
     four = BIGWIG_MAGIC;
-    if(fwrite(&four, sizeof(uint32_t), 1, fp->URL->x.fp) != 1) return 9;
+    if(bwWrite(&four, sizeof(uint32_t), 1, fp) != 1) return 9;
+
+    //Streamed output is only sent once it's complete
+    if(fp->writeBuffer->sink && copySpool(fp)) return 10;
 
     return 0;
 }
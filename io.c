@@ -84,9 +84,25 @@ size_t url_fread(void *obuf, size_t obufSize, URL_t *URL) {
 }
 #endif
 
+//Copy from an in-memory buffer, returning the number of bytes copied
+static size_t mem_fread(void *obuf, size_t obufSize, URL_t *URL) {
+    if(URL->bufPos >= URL->bufLen) return 0;
+    if(obufSize > URL->bufLen - URL->bufPos) obufSize = URL->bufLen - URL->bufPos;
+    memcpy(obuf, (char*)URL->memBuf + URL->bufPos, obufSize);
+    URL->bufPos += obufSize;
+    return obufSize;
+}
+
 //Returns the number of bytes requested or a smaller number on error
 //Note that in the case of remote files, the actual amount read may be less than the return value!
 size_t urlRead(URL_t *URL, void *buf, size_t bufSize) {
+    size_t rv;
+    if(URL->type == BWG_MEM) return mem_fread(buf, bufSize, URL);
+    if(URL->type == BWG_CUSTOM) {
+        rv = URL->io.read(URL->io.ctx, buf, bufSize, URL->bufPos);
+        URL->bufPos += rv;
+        return rv;
+    }
 #ifndef NOCURL
     if(URL->type==0) {
         return fread(buf, bufSize, 1, URL->x.fp)*bufSize;
@@ -115,13 +131,49 @@ size_t bwFillBuffer(const void *inBuf, size_t l, size_t nmemb, void *pURL) {
     return copied;
 }
 
+//Returns the number of bytes written or a smaller number on error
+size_t urlWrite(URL_t *URL, const void *buf, size_t bufSize) {
+    size_t m;
+    void *p;
+
+    if(URL->type == BWG_FILE) return fwrite(buf, sizeof(uint8_t), bufSize, URL->x.fp);
+    if(URL->type != BWG_MEM || !URL->memOut) return 0;
+
+    //Grow the buffer as needed
+    if(URL->bufPos + bufSize > URL->bufSize) {
+        m = (URL->bufSize) ? URL->bufSize : 4096;
+        while(m < URL->bufPos + bufSize) m *= 2;
+        p = realloc(URL->memBuf, m);
+        if(!p) return 0;
+        URL->memBuf = p;
+        URL->bufSize = m;
+    }
+    memcpy((char*)URL->memBuf + URL->bufPos, buf, bufSize);
+    URL->bufPos += bufSize;
+    if(URL->bufPos > URL->bufLen) URL->bufLen = URL->bufPos;
+    return bufSize;
+}
+
 //Seek to an arbitrary location, returning a CURLcode
 //Note that a local file returns CURLE_OK on success or CURLE_FAILED_INIT on any error;
 CURLcode urlSeek(URL_t *URL, size_t pos) {
 #ifndef NOCURL
     char range[1024];
     CURLcode rv;
+#endif
 
+    if(URL->type == BWG_MEM) {
+        if(pos > URL->bufLen) return CURLE_FAILED_INIT;
+        URL->bufPos = pos;
+        return CURLE_OK;
+    }
+    if(URL->type == BWG_CUSTOM) {
+        if(pos > URL->bufLen) return CURLE_FAILED_INIT;
+        URL->bufPos = pos;
+        return CURLE_OK;
+    }
+
+#ifndef NOCURL
     if(URL->type == BWG_FILE) {
 #endif
         if(fseek(URL->x.fp, pos, SEEK_SET) == 0) {
@@ -167,7 +219,12 @@ URL_t *urlOpen(const char *fname, CURLcode (*callBack)(CURL*), const char *mode)
     char range[1024];
 #endif
 
-    URL->fname = fname;
+    URL->fname = strdup(fname);
+    if(!URL->fname) {
+        free(URL);
+        return NULL;
+    }
+    URL->callBack = callBack;
 
     if((!mode) || (strchr(mode, 'w') == 0)) {
         //Set the protocol
@@ -185,6 +242,7 @@ URL_t *urlOpen(const char *fname, CURLcode (*callBack)(CURL*), const char *mode)
             URL->filePos = -1; //This signals that nothing has been read
             URL->x.fp = fopen(fname, "rb");
             if(!(URL->x.fp)) {
+                free(URL->fname);
                 free(URL);
                 fprintf(stderr, "[urlOpen] Couldn't open %s for reading\n", fname);
                 return NULL;
@@ -194,6 +252,7 @@ URL_t *urlOpen(const char *fname, CURLcode (*callBack)(CURL*), const char *mode)
             //Remote file, set up the memory buffer and get CURL ready
             URL->memBuf = malloc(GLOBAL_DEFAULTBUFFERSIZE);
             if(!(URL->memBuf)) {
+                free(URL->fname);
                 free(URL);
                 fprintf(stderr, "[urlOpen] Couldn't allocate enough space for the file buffer!\n");
                 return NULL;
@@ -262,6 +321,7 @@ URL_t *urlOpen(const char *fname, CURLcode (*callBack)(CURL*), const char *mode)
         URL->type = BWG_FILE;
         URL->x.fp = fopen(fname, mode);
         if(!(URL->x.fp)) {
+            free(URL->fname);
             free(URL);
             fprintf(stderr, "[urlOpen] Couldn't open %s for writing\n", fname);
             return NULL;
@@ -277,14 +337,80 @@ error:
     if(req) free(req);
     free(URL->memBuf);
     curl_easy_cleanup(URL->x.curl);
+    free(URL->fname);
     free(URL);
     return NULL;
 #endif
 }
 
+URL_t *urlOpenBuffer(const void *buf, size_t len) {
+    URL_t *URL = calloc(1, sizeof(URL_t));
+    if(!URL) return NULL;
+
+    URL->type = BWG_MEM;
+    URL->memBuf = (void*) buf;
+    URL->bufSize = len;
+    URL->bufLen = len;
+    return URL;
+}
+
+URL_t *urlOpenBufferWrite(void **buf, size_t *len) {
+    URL_t *URL = NULL;
+    if(!buf || !len) return NULL;
+    URL = calloc(1, sizeof(URL_t));
+    if(!URL) return NULL;
+
+    URL->type = BWG_MEM;
+    URL->memOut = buf;
+    URL->memOutLen = len;
+    return URL;
+}
+
+URL_t *urlOpenIO(const bwIO_t *io) {
+    URL_t *URL = NULL;
+    if(!io || !io->read) return NULL;
+    URL = calloc(1, sizeof(URL_t));
+    if(!URL) return NULL;
+
+    URL->type = BWG_CUSTOM;
+    URL->io = *io;
+    //The size is only asked for once, since for remote backends that can be a round trip
+    URL->bufLen = io->size ? io->size(io->ctx) : (size_t) -1;
+    return URL;
+}
+
+int urlReadBatch(URL_t *URL, size_t n, void **bufs, const size_t *lens, const uint64_t *offsets) {
+    size_t i, j, len;
+
+    if(URL->type == BWG_CUSTOM && URL->io.readBatch) {
+        return URL->io.readBatch(URL->io.ctx, n, bufs, lens, offsets);
+    }
+
+    for(i=0; i<n; i=j) {
+        //Merge runs of regions that are adjacent both on disk and in memory
+        len = lens[i];
+        for(j=i+1; j<n; j++) {
+            if(offsets[j] != offsets[i] + len) break;
+            if((char*)bufs[j] != (char*)bufs[i] + len) break;
+            len += lens[j];
+        }
+        if(urlSeek(URL, offsets[i]) != CURLE_OK) return 1;
+        if(urlRead(URL, bufs[i], len) != len) return 2;
+    }
+    return 0;
+}
+
 //Performs the necessary free() operations and handles cleaning up curl
 void urlClose(URL_t *URL) {
-    if(URL->type == BWG_FILE) {
+    if(URL->type == BWG_MEM) {
+        //Hand the buffer to the caller if we own it
+        if(URL->memOut) {
+            *(URL->memOut) = URL->memBuf;
+            *(URL->memOutLen) = URL->bufLen;
+        }
+    } else if(URL->type == BWG_CUSTOM) {
+        if(URL->io.close) URL->io.close(URL->io.ctx);
+    } else if(URL->type == BWG_FILE) {
         fclose(URL->x.fp);
 #ifndef NOCURL
     } else {
@@ -292,5 +418,6 @@ void urlClose(URL_t *URL) {
         curl_easy_cleanup(URL->x.curl);
 #endif
     }
+    free(URL->fname);
     free(URL);
 }
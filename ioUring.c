@@ -0,0 +1,294 @@
+#include "bigWig.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef WITH_IOURING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdio.h>
+
+//The default number of submission queue entries
+#define URING_DEFAULT_DEPTH 64
+
+//liburing isn't required, the rings are set up directly with the raw system calls
+typedef struct uringRing_t {
+    int ringFd;
+    uint32_t depth; //The number of submission queue entries
+    void *sqRing, *cqRing;
+    size_t sqRingSz, cqRingSz;
+    struct io_uring_sqe *sqes;
+    size_t sqesSz;
+    uint32_t *sqTail, *sqMask, *sqArray;
+    uint32_t *cqHead, *cqTail, *cqMask;
+    struct io_uring_cqe *cqes;
+    struct uringRing_t *next; //The next idle ring
+} uringRing_t;
+
+//A ring's queues can't be used by more than one thread at a time, so each batch of reads takes an idle ring (or makes a new one) and puts it back afterwards
+//This way clones of a handle (see bwClone()) can read batches concurrently through the same backend
+typedef struct {
+    int fd; //The file being read
+    uint32_t queueDepth; //As given to bwIOUringInit()
+    pthread_mutex_t lock; //Protects idle
+    uringRing_t *idle;
+} uringCtx_t;
+
+static void uringDestroyRing(uringRing_t *ring) {
+    if(ring->sqes) munmap(ring->sqes, ring->sqesSz);
+    if(ring->cqRing && ring->cqRing != ring->sqRing) munmap(ring->cqRing, ring->cqRingSz);
+    if(ring->sqRing) munmap(ring->sqRing, ring->sqRingSz);
+    if(ring->ringFd >= 0) close(ring->ringFd);
+    free(ring);
+}
+
+static uringRing_t *uringCreateRing(uint32_t queueDepth) {
+    struct io_uring_params p;
+    uringRing_t *ring = calloc(1, sizeof(uringRing_t));
+    if(!ring) return NULL;
+
+    memset(&p, 0, sizeof(struct io_uring_params));
+    ring->ringFd = syscall(__NR_io_uring_setup, queueDepth, &p);
+    if(ring->ringFd < 0) goto error;
+    ring->depth = p.sq_entries;
+
+    //Map the submission and completion rings, which are a single mapping on newer kernels
+    ring->sqRingSz = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    ring->cqRingSz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        if(ring->cqRingSz > ring->sqRingSz) ring->sqRingSz = ring->cqRingSz;
+        ring->cqRingSz = ring->sqRingSz;
+    }
+    ring->sqRing = mmap(NULL, ring->sqRingSz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringFd, IORING_OFF_SQ_RING);
+    if(ring->sqRing == MAP_FAILED) {
+        ring->sqRing = NULL;
+        goto error;
+    }
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cqRing = ring->sqRing;
+    } else {
+        ring->cqRing = mmap(NULL, ring->cqRingSz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringFd, IORING_OFF_CQ_RING);
+        if(ring->cqRing == MAP_FAILED) {
+            ring->cqRing = NULL;
+            goto error;
+        }
+    }
+    ring->sqesSz = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringFd, IORING_OFF_SQES);
+    if(ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        goto error;
+    }
+
+    ring->sqTail = (uint32_t*) ((char*)ring->sqRing + p.sq_off.tail);
+    ring->sqMask = (uint32_t*) ((char*)ring->sqRing + p.sq_off.ring_mask);
+    ring->sqArray = (uint32_t*) ((char*)ring->sqRing + p.sq_off.array);
+    ring->cqHead = (uint32_t*) ((char*)ring->cqRing + p.cq_off.head);
+    ring->cqTail = (uint32_t*) ((char*)ring->cqRing + p.cq_off.tail);
+    ring->cqMask = (uint32_t*) ((char*)ring->cqRing + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*) ((char*)ring->cqRing + p.cq_off.cqes);
+    return ring;
+
+error:
+    uringDestroyRing(ring);
+    return NULL;
+}
+
+static void uringDestroy(uringCtx_t *ctx) {
+    uringRing_t *ring;
+    while(ctx->idle) {
+        ring = ctx->idle;
+        ctx->idle = ring->next;
+        uringDestroyRing(ring);
+    }
+    if(ctx->fd >= 0) close(ctx->fd);
+    pthread_mutex_destroy(&(ctx->lock));
+    free(ctx);
+}
+
+//Single reads don't benefit from the ring
+static size_t uringRead(void *vctx, void *buf, size_t len, uint64_t offset) {
+    uringCtx_t *ctx = (uringCtx_t*) vctx;
+    size_t done = 0;
+    ssize_t rv;
+    while(done < len) {
+        rv = pread(ctx->fd, (char*)buf + done, len - done, offset + done);
+        if(rv < 0 && errno == EINTR) continue;
+        if(rv <= 0) break;
+        done += rv;
+    }
+    return done;
+}
+
+static uint64_t uringSize(void *vctx) {
+    struct stat st;
+    if(fstat(((uringCtx_t*) vctx)->fd, &st)) return 0;
+    return st.st_size;
+}
+
+static void uringClose(void *vctx) {
+    uringDestroy((uringCtx_t*) vctx);
+}
+
+//Reap completions, finishing short or failed reads synchronously
+//Returns 1 if any read couldn't be completed
+static int uringReap(uringCtx_t *ctx, uringRing_t *ring, size_t *inFlight, void **bufs, const size_t *lens, const uint64_t *offsets) {
+    struct io_uring_cqe *cqe;
+    uint32_t head = *(ring->cqHead);
+    size_t i, done;
+    int err = 0;
+
+    while(head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+        cqe = ring->cqes + (head & *(ring->cqMask));
+        i = cqe->user_data;
+        if(cqe->res < 0 || (size_t) cqe->res < lens[i]) {
+            //Short reads and failures (e.g., IORING_OP_READ isn't supported by older kernels) are finished synchronously
+            done = (cqe->res > 0) ? (size_t) cqe->res : 0;
+            if(uringRead(ctx, (char*)bufs[i] + done, lens[i] - done, offsets[i] + done) != lens[i] - done) err = 1;
+        }
+        head++;
+        (*inFlight)--;
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    return err;
+}
+
+//Keep up to depth reads in flight on a single ring, refilling the queue as they complete (in any order)
+//Returns 0 on success, 1 if any read failed and 2 if the ring itself failed and mustn't be reused
+//Nothing is left in flight on return, since the caller is free to release bufs
+static int uringRingReadBatch(uringCtx_t *ctx, uringRing_t *ring, size_t n, void **bufs, const size_t *lens, const uint64_t *offsets) {
+    size_t next = 0, inFlight = 0;
+    uint32_t tail, idx, pending = 0;
+    struct io_uring_sqe *sqe;
+    long rv;
+    int err = 0;
+
+    while(next < n || inFlight) {
+        tail = *(ring->sqTail);
+        while(next < n && inFlight < ring->depth) {
+            idx = tail & *(ring->sqMask);
+            sqe = ring->sqes + idx;
+            memset(sqe, 0, sizeof(struct io_uring_sqe));
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = ctx->fd;
+            sqe->off = offsets[next];
+            sqe->addr = (uint64_t) (uintptr_t) bufs[next];
+            sqe->len = lens[next];
+            sqe->user_data = next;
+            ring->sqArray[idx] = idx;
+            tail++;
+            next++;
+            inFlight++;
+            pending++;
+        }
+        __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+
+        rv = syscall(__NR_io_uring_enter, ring->ringFd, pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if(rv < 0) {
+            if(errno == EINTR || errno == EAGAIN) continue;
+            //Without SQPOLL the kernel only looks at the submission queue during io_uring_enter(), so entries it hasn't consumed can be withdrawn
+            __atomic_store_n(ring->sqTail, tail - pending, __ATOMIC_RELEASE);
+            inFlight -= pending;
+            pending = 0;
+            err = 2;
+            break;
+        }
+        pending -= rv;
+        if(uringReap(ctx, ring, &inFlight, bufs, lens, offsets)) err = 1;
+    }
+
+    //Wait for everything that was submitted before giving up, so nothing is written to bufs after they're released
+    while(inFlight) {
+        rv = syscall(__NR_io_uring_enter, ring->ringFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if(rv < 0 && errno != EINTR && errno != EAGAIN) break;
+        uringReap(ctx, ring, &inFlight, bufs, lens, offsets);
+    }
+    if(inFlight) {
+        //The ring is unusable and reads are still outstanding. Leak the ring, since unmapping it or closing it wouldn't stop them either
+        fprintf(stderr, "[uringReadBatch] Couldn't wait for %zu outstanding reads: %s\n", inFlight, strerror(errno));
+        return 3;
+    }
+    return err;
+}
+
+static int uringReadBatch(void *vctx, size_t n, void **bufs, const size_t *lens, const uint64_t *offsets) {
+    uringCtx_t *ctx = (uringCtx_t*) vctx;
+    uringRing_t *ring;
+    size_t i;
+    int rv;
+
+    pthread_mutex_lock(&(ctx->lock));
+    ring = ctx->idle;
+    if(ring) ctx->idle = ring->next;
+    pthread_mutex_unlock(&(ctx->lock));
+    if(!ring) ring = uringCreateRing(ctx->queueDepth);
+    if(!ring) {
+        //Out of rings (e.g., RLIMIT_MEMLOCK was reached), so read synchronously
+        for(i=0; i<n; i++) {
+            if(uringRead(ctx, bufs[i], lens[i], offsets[i]) != lens[i]) return 1;
+        }
+        return 0;
+    }
+
+    rv = uringRingReadBatch(ctx, ring, n, bufs, lens, offsets);
+    if(rv < 2) {
+        pthread_mutex_lock(&(ctx->lock));
+        ring->next = ctx->idle;
+        ctx->idle = ring;
+        pthread_mutex_unlock(&(ctx->lock));
+        return rv;
+    }
+    if(rv == 2) uringDestroyRing(ring);
+    return 1;
+}
+
+int bwIOUringInit(bwIO_t *io, const char *fname, uint32_t queueDepth) {
+    uringCtx_t *ctx = calloc(1, sizeof(uringCtx_t));
+    int rv = 2, err;
+    if(!ctx) return 1;
+    ctx->fd = -1;
+    if(pthread_mutex_init(&(ctx->lock), NULL)) {
+        free(ctx);
+        return 1;
+    }
+    if(!queueDepth) queueDepth = URING_DEFAULT_DEPTH;
+    ctx->queueDepth = queueDepth;
+
+    ctx->fd = open(fname, O_RDONLY);
+    if(ctx->fd < 0) goto error;
+
+    //Make the first ring now, so that callers find out if io_uring is unavailable
+    rv = 3;
+    ctx->idle = uringCreateRing(queueDepth);
+    if(!ctx->idle) goto error;
+
+    memset(io, 0, sizeof(bwIO_t));
+    io->ctx = ctx;
+    io->read = uringRead;
+    io->size = uringSize;
+    io->close = uringClose;
+    io->readBatch = uringReadBatch;
+    return 0;
+
+error:
+    //Callers need errno to tell why this failed, but cleaning up can overwrite it
+    err = errno;
+    uringDestroy(ctx);
+    errno = err;
+    return rv;
+}
+
+#else
+
+//libBigWig was compiled without io_uring support
+int bwIOUringInit(bwIO_t *io, const char *fname, uint32_t queueDepth) {
+    errno = ENOSYS;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,178 @@
+#include "bigWig.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#define NQUERIES 2000
+#define QUERYWIDTH 10000
+
+//The entries of one chromosome of the reference file
+typedef struct {
+    uint32_t n;
+    uint32_t *start, *end;
+    float *value;
+} chromEntries_t;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//Read every entry of the reference file into memory
+//Returns NULL on error
+static chromEntries_t *readEntries(bigWigFile_t *fp) {
+    chromEntries_t *e = calloc(fp->cl->nKeys, sizeof(chromEntries_t));
+    bwOverlappingIntervals_t *o;
+    int64_t tid;
+    if(!e) return NULL;
+
+    for(tid=0; tid<fp->cl->nKeys; tid++) {
+        o = bwGetOverlappingIntervals(fp, fp->cl->chrom[tid], 0, fp->cl->len[tid]);
+        if(!o) return NULL;
+        //Steal the arrays
+        e[tid].n = o->l;
+        e[tid].start = o->start;
+        e[tid].end = o->end;
+        e[tid].value = o->value;
+        o->start = o->end = NULL;
+        o->value = NULL;
+        bwDestroyOverlappingIntervals(o);
+    }
+    return e;
+}
+
+//Write the entries to fname with the given settings, returning the time taken or a negative value on error
+static double writeFile(const char *fname, chromList_t *cl, chromEntries_t *e, uint32_t bufSize, uint32_t blockSize, int level) {
+    const char **names = NULL;
+    double t0 = now();
+    uint32_t i, m = 0;
+    int64_t tid;
+    bigWigFile_t *fp = bwOpen(fname, NULL, "w");
+    if(!fp) return -1;
+
+    if(bwCreateHdr(fp, 10)) goto error;
+    if(bwSetBufSize(fp, bufSize) || bwSetBlockSize(fp, blockSize) || bwSetCompressionLevel(fp, level)) goto error;
+    fp->cl = bwCreateChromList((const char* const*) cl->chrom, cl->len, cl->nKeys);
+    if(!fp->cl) goto error;
+    if(bwWriteHdr(fp)) goto error;
+
+    for(tid=0; tid<cl->nKeys; tid++) if(e[tid].n > m) m = e[tid].n;
+    names = malloc((m ? m : 1) * sizeof(char*));
+    if(!names) goto error;
+    for(tid=0; tid<cl->nKeys; tid++) {
+        if(!e[tid].n) continue;
+        for(i=0; i<e[tid].n; i++) names[i] = fp->cl->chrom[tid];
+        if(bwAddIntervals(fp, names, e[tid].start, e[tid].end, e[tid].value, e[tid].n)) goto error;
+    }
+
+    free(names);
+    bwClose(fp);
+    return now() - t0;
+
+error:
+    free(names);
+    bwClose(fp);
+    return -1;
+}
+
+//Time NQUERIES random queries of QUERYWIDTH bases, returning the mean time per query in microseconds or a negative value on error
+static double queryFile(const char *fname, uint64_t *fileSize) {
+    bigWigFile_t *fp = bwOpen(fname, NULL, "r");
+    bwOverlappingIntervals_t *o;
+    uint32_t i, tid, start;
+    FILE *f;
+    double t0;
+    if(!fp) return -1;
+
+    f = fopen(fname, "rb");
+    if(!f || fseek(f, 0, SEEK_END)) {
+        if(f) fclose(f);
+        bwClose(fp);
+        return -1;
+    }
+    *fileSize = ftell(f);
+    fclose(f);
+
+    srand(7);
+    t0 = now();
+    for(i=0; i<NQUERIES; i++) {
+        tid = rand() % fp->cl->nKeys;
+        start = fp->cl->len[tid] > QUERYWIDTH ? rand() % (fp->cl->len[tid] - QUERYWIDTH) : 0;
+        o = bwGetOverlappingIntervals(fp, fp->cl->chrom[tid], start, start + QUERYWIDTH);
+        if(!o) {
+            bwClose(fp);
+            return -1;
+        }
+        bwDestroyOverlappingIntervals(o);
+    }
+    t0 = now() - t0;
+
+    bwClose(fp);
+    return 1e6 * t0 / NQUERIES;
+}
+
+//Rewrite a reference file with a range of block sizes, index node sizes and compression levels and report the size of each file, how long it took to write and how long random queries take
+int main(int argc, char *argv[]) {
+    uint32_t bufSizes[5] = {4096, 8192, 16384, 32768, 131072}, blockSizes[3] = {16, 64, 256};
+    int levels[4] = {Z_BEST_SPEED, 3, Z_DEFAULT_COMPRESSION, Z_BEST_COMPRESSION}, i, j, k, rv = 1;
+    bigWigFile_t *fp = NULL;
+    chromEntries_t *e = NULL;
+    uint64_t fileSize;
+    double tWrite, tQuery;
+    int64_t tid;
+    if(argc != 3) {
+        fprintf(stderr, "Usage: %s reference.bw output.bw\n", argv[0]);
+        return 1;
+    }
+
+    if(bwInit(1<<17) != 0) {
+        fprintf(stderr, "Received an error in bwInit\n");
+        return 1;
+    }
+
+    fp = bwOpen(argv[1], NULL, "r");
+    if(!fp) {
+        fprintf(stderr, "An error occured while opening %s\n", argv[1]);
+        goto done;
+    }
+    e = readEntries(fp);
+    if(!e) {
+        fprintf(stderr, "Couldn't read the entries in %s\n", argv[1]);
+        goto done;
+    }
+
+    printf("bufSize\tblockSize\tlevel\tbytes\twrite_s\tquery_us\n");
+    for(i=0; i<5; i++) {
+        for(j=0; j<3; j++) {
+            for(k=0; k<4; k++) {
+                //Only vary the index node size at the default block size and compression level
+                if(blockSizes[j] != 64 && (bufSizes[i] != 32768 || levels[k] != Z_DEFAULT_COMPRESSION)) continue;
+                tWrite = writeFile(argv[2], fp->cl, e, bufSizes[i], blockSizes[j], levels[k]);
+                tQuery = tWrite < 0 ? -1 : queryFile(argv[2], &fileSize);
+                if(tQuery < 0) {
+                    fprintf(stderr, "Couldn't write or query %s\n", argv[2]);
+                    goto done;
+                }
+                printf("%"PRIu32"\t%"PRIu32"\t%i\t%"PRIu64"\t%.3f\t%.1f\n", bufSizes[i], blockSizes[j], levels[k], fileSize, tWrite, tQuery);
+            }
+        }
+    }
+    rv = 0;
+
+done:
+    if(e) {
+        for(tid=0; tid<fp->cl->nKeys; tid++) {
+            free(e[tid].start);
+            free(e[tid].end);
+            free(e[tid].value);
+        }
+        free(e);
+    }
+    bwClose(fp);
+    bwCleanup();
+    return rv;
+}
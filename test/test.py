@@ -1,7 +1,7 @@
 #!/usr/bin/env python
 import os
 from tempfile import TemporaryDirectory
-from subprocess import check_output, check_call
+from subprocess import check_output, check_call, call
 
 from sys import argv, stderr, exit
 import hashlib
@@ -24,6 +24,146 @@ def remote_http_test():
     assert md5sum == "9ccecd6c32ff31042714c1da3c0d0eba"
 
 
+def test_lazy_chroms():
+    ## Lazily loaded chromosome lists must match those loaded up front
+    p1 = check_call([test_bin + "/testLazy", test_bw])
+    assert p1 == 0
+
+
+def test_clone():
+    ## Cloned handles must give the same results, regardless of which is closed first
+    p1 = check_call([test_bin + "/testClone", test_bw])
+    assert p1 == 0
+
+
+def test_threads():
+    ## Clones of a lazily opened file queried from several threads must match a single-threaded handle
+    p1 = check_call([test_bin + "/testThreads", test_bw])
+    assert p1 == 0
+    ## The same, with every thread reading batches of blocks through one io_uring backend. A file with many blocks is made first
+    with TemporaryDirectory(prefix="libbigwig-test") as tmpdir:
+        tmpout1 = os.path.join(tmpdir, "output1.bw")
+        tmpout2 = os.path.join(tmpdir, "output2.bw")
+        p1 = check_call([test_bin + "/testWriteThreads", tmpout1, tmpout2])
+        assert p1 == 0
+        p1 = call([test_bin + "/testThreads", tmpout1, "uring"])
+        if p1 == 77:
+            print("io_uring isn't available. Skipping testThreads with io_uring!", file=stderr)
+        else:
+            assert p1 == 0
+
+
+def test_prefix_sums():
+    ## bwStats() must give full resolution results with prefix sums, which must survive being saved and reloaded
+    with TemporaryDirectory(prefix="libbigwig-test") as tmpdir:
+        tmpout = os.path.join(tmpdir, "output.psum")
+        p1 = check_call([test_bin + "/testPrefixSums", test_bw, tmpout])
+        assert p1 == 0
+
+
+def test_exact_stats():
+    ## bwStatsExact() must match bwStatsFromFull() on a file with zoom levels
+    with TemporaryDirectory(prefix="libbigwig-test") as tmpdir:
+        tmpout = os.path.join(tmpdir, "output.bw")
+        p1 = check_call([test_bin + "/testExact", tmpout])
+        assert p1 == 0
+
+
+def test_quantiles():
+    ## Exact and approximate quantiles must match sorting every per-base value
+    with TemporaryDirectory(prefix="libbigwig-test") as tmpdir:
+        tmpout = os.path.join(tmpdir, "output.bw")
+        p1 = check_call([test_bin + "/testQuantiles", tmpout])
+        assert p1 == 0
+
+
+def test_histogram():
+    ## Per-bin histograms must match those of the full resolution intervals
+    with TemporaryDirectory(prefix="libbigwig-test") as tmpdir:
+        tmpout = os.path.join(tmpdir, "output.bw")
+        p1 = check_call([test_bin + "/testHistogram", tmpout])
+        assert p1 == 0
+
+
+def test_chrom_summaries():
+    ## Per-chromosome summaries must match the full resolution data, with and without zoom levels
+    with TemporaryDirectory(prefix="libbigwig-test") as tmpdir:
+        tmpout = os.path.join(tmpdir, "output.bw")
+        p1 = check_call([test_bin + "/testSummaries", test_bw, tmpout])
+        assert p1 == 0
+
+
+def test_parallel_stats():
+    ## bwStatsParallel() must give exactly the same results as bwStats()
+    with TemporaryDirectory(prefix="libbigwig-test") as tmpdir:
+        tmpout = os.path.join(tmpdir, "output.bw")
+        p1 = check_call([test_bin + "/testParallel", tmpout])
+        assert p1 == 0
+
+
+def test_zoom_levels():
+    ## Zoom levels built while writing must not depend on how their sizes were chosen
+    with TemporaryDirectory(prefix="libbigwig-test") as tmpdir:
+        tmpout1 = os.path.join(tmpdir, "output1.bw")
+        tmpout2 = os.path.join(tmpdir, "output2.bw")
+        p1 = check_call([test_bin + "/testZoomLevels", tmpout1, tmpout2])
+        assert p1 == 0
+
+
+def test_write_threads():
+    ## Compressing blocks on several threads must give the same file as doing so on one
+    with TemporaryDirectory(prefix="libbigwig-test") as tmpdir:
+        tmpout1 = os.path.join(tmpdir, "output1.bw")
+        tmpout2 = os.path.join(tmpdir, "output2.bw")
+        p1 = check_call([test_bin + "/testWriteThreads", tmpout1, tmpout2])
+        assert p1 == 0
+
+
+def test_write_options():
+    ## Files written with other block sizes, index node sizes and compression levels must hold the same data
+    with TemporaryDirectory(prefix="libbigwig-test") as tmpdir:
+        tmpout1 = os.path.join(tmpdir, "output1.bw")
+        tmpout2 = os.path.join(tmpdir, "output2.bw")
+        p1 = check_call([test_bin + "/testWriteOptions", tmpout1, tmpout2])
+        assert p1 == 0
+
+
+def test_adaptive_blocks():
+    ## Choosing the type of each block must give a smaller file with the same contents
+    with TemporaryDirectory(prefix="libbigwig-test") as tmpdir:
+        tmpout1 = os.path.join(tmpdir, "output1.bw")
+        tmpout2 = os.path.join(tmpdir, "output2.bw")
+        p1 = check_call([test_bin + "/testAdaptiveBlocks", tmpout1, tmpout2])
+        assert p1 == 0
+
+
+def test_merge_intervals():
+    ## Adjacent entries with equal, similar or equally rounded values must be merged
+    with TemporaryDirectory(prefix="libbigwig-test") as tmpdir:
+        tmpout1 = os.path.join(tmpdir, "output1.bw")
+        tmpout2 = os.path.join(tmpdir, "output2.bw")
+        p1 = check_call([test_bin + "/testMergeIntervals", tmpout1, tmpout2])
+        assert p1 == 0
+
+
+def test_text_input():
+    ## bedGraph and wiggle text must give the same file as adding the entries directly
+    with TemporaryDirectory(prefix="libbigwig-test") as tmpdir:
+        tmpout1 = os.path.join(tmpdir, "output1.bw")
+        tmpout2 = os.path.join(tmpdir, "output2.bw")
+        p1 = check_call([test_bin + "/testTextInput", tmpout1, tmpout2])
+        assert p1 == 0
+
+
+def test_stream_output():
+    ## A file streamed to a pipe must be the same as one written normally
+    with TemporaryDirectory(prefix="libbigwig-test") as tmpdir:
+        tmpout = os.path.join(tmpdir, "output.bw")
+        out = check_output([test_bin + "/testStreamOutput", tmpout])
+        with open(tmpout, mode="rb") as f:
+            assert out == f.read()
+
+
 def test_recreating_file():
     with TemporaryDirectory(prefix="libbigwig-test") as tmpdir:
         tmpout = os.path.join(tmpdir, "output.bw")
@@ -31,7 +171,33 @@ def test_recreating_file():
         assert p1 == 0
         with open(tmpout, mode="rb") as f:
             md5sum = hashlib.md5(f.read()).hexdigest()
-            assert md5sum == "8e116bd114ffd2eb625011d451329c03"
+            assert md5sum == "a8facae0883037527b8561b03b4e9d6d"
+
+
+def test_in_memory():
+    ## The same as test_recreating_file, but reading and writing via memory buffers
+    with TemporaryDirectory(prefix="libbigwig-test") as tmpdir:
+        tmpout = os.path.join(tmpdir, "output.bw")
+        p1 = check_call([test_bin + "/testBuffer", test_bw, tmpout])
+        assert p1 == 0
+        with open(tmpout, mode="rb") as f:
+            md5sum = hashlib.md5(f.read()).hexdigest()
+            assert md5sum == "a8facae0883037527b8561b03b4e9d6d"
+
+
+def test_custom_io():
+    ## The same as test_recreating_file, but reading through a user-supplied I/O backend
+    with TemporaryDirectory(prefix="libbigwig-test") as tmpdir:
+        tmpout = os.path.join(tmpdir, "output.bw")
+        for backend in ["pread", "uring"]:
+            p1 = call([test_bin + "/testIO", test_bw, tmpout, backend])
+            if p1 == 77:
+                print("io_uring isn't available. Skipping testIO with io_uring!", file=stderr)
+                continue
+            assert p1 == 0
+            with open(tmpout, mode="rb") as f:
+                md5sum = hashlib.md5(f.read()).hexdigest()
+                assert md5sum == "a8facae0883037527b8561b03b4e9d6d"
 
 
 def test_creation_from_scratch():
@@ -42,7 +208,7 @@ def test_creation_from_scratch():
         assert p1 == 0
         with open(tmpout, mode="rb") as f:
             md5sum = hashlib.md5(f.read()).hexdigest()
-            assert md5sum == "ef104f198c6ce8310acc149d0377fc16"
+            assert md5sum == "48baf3fdbdf54d2c984e3bd1d6317af7"
 
 
 def remote_test2():
@@ -81,8 +247,26 @@ if __name__ == "__main__":
     test_bw = os.path.abspath(argv[2])
 
     local_test()
+    test_lazy_chroms()
+    test_clone()
+    test_threads()
+    test_prefix_sums()
+    test_exact_stats()
+    test_quantiles()
+    test_histogram()
+    test_chrom_summaries()
+    test_parallel_stats()
+    test_zoom_levels()
+    test_write_threads()
+    test_stream_output()
+    test_write_options()
+    test_adaptive_blocks()
+    test_merge_intervals()
+    test_text_input()
     remote_http_test()
     test_recreating_file()
+    test_in_memory()
+    test_custom_io()
     test_creation_from_scratch()
     remote_test2()
     test_bigbed()
@@ -0,0 +1,135 @@
+#include "bigWig.h"
+#include "testHelpers.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NCHROMS 3
+#define NENTRIES 30000
+
+//Write bedGraph-style entries that are evenly spaced with a fixed width on chr1, of a fixed width but irregularly spaced on chr2 and of varying widths on chr3, switching between them part way through blocks
+//Returns 0 on success
+static int makeFile(const char *fname, int adaptive) {
+    const char *chroms[NCHROMS] = {"chr1", "chr2", "chr3"};
+    uint32_t lens[NCHROMS] = {3000000, 3000000, 3000000};
+    const char *names[NENTRIES];
+    uint32_t starts[NENTRIES], ends[NENTRIES], i, pos = 0;
+    float values[NENTRIES];
+    bigWigFile_t *fp = bwOpen(fname, NULL, "w");
+    if(!fp) return 1;
+
+    if(bwCreateHdr(fp, 10)) goto error;
+    if(bwSetAdaptiveBlockType(fp, adaptive)) goto error;
+    fp->cl = bwCreateChromList(chroms, lens, NCHROMS);
+    if(!fp->cl) goto error;
+    if(bwWriteHdr(fp)) goto error;
+
+    srand(11);
+    for(i=0; i<NENTRIES; i++) {
+        names[i] = chroms[0];
+        starts[i] = 50*i;
+        ends[i] = starts[i] + 25;
+        values[i] = (rand() % 300) / 4.0f;
+    }
+    //A run that's broken up once, by a wider entry
+    ends[7000] += 5;
+    if(bwAddIntervals(fp, names, starts, ends, values, 1001)) goto error;
+    if(bwAppendIntervals(fp, starts+1001, ends+1001, values+1001, NENTRIES-1001)) goto error;
+
+    for(i=0; i<NENTRIES; i++) {
+        names[i] = chroms[1];
+        starts[i] = pos;
+        ends[i] = pos + 10;
+        pos = ends[i] + rand() % 50;
+    }
+    if(bwAddIntervals(fp, names, starts, ends, values, NENTRIES)) goto error;
+
+    pos = 0;
+    for(i=0; i<NENTRIES; i++) {
+        names[i] = chroms[2];
+        starts[i] = pos;
+        ends[i] = pos + 1 + rand() % 30;
+        pos = ends[i] + rand() % 20;
+    }
+    if(bwAddIntervals(fp, names, starts, ends, values, NENTRIES)) goto error;
+
+    bwClose(fp);
+    return 0;
+
+error:
+    bwClose(fp);
+    return 1;
+}
+
+//Returns the size of a file, or 0 on error
+static long fileSize(const char *fname) {
+    FILE *f = fopen(fname, "rb");
+    long sz = 0;
+    if(!f) return 0;
+    if(fseek(f, 0, SEEK_END) == 0) sz = ftell(f);
+    fclose(f);
+    return sz;
+}
+
+//Returns 0 if two files hold the same entries and statistics
+static int compareFiles(const char *f1, const char *f2) {
+    bigWigFile_t *fp1 = NULL, *fp2 = NULL;
+    double *s1 = NULL, *s2 = NULL;
+    uint32_t tid;
+    int rv = 1;
+    if(compareFileEntries(f1, f2)) return 1;
+    fp1 = bwOpen(f1, NULL, "r");
+    fp2 = bwOpen(f2, NULL, "r");
+    if(!fp1 || !fp2) goto done;
+
+    for(tid=0; tid<fp1->cl->nKeys; tid++) {
+        s1 = bwStats(fp1, fp1->cl->chrom[tid], 0, fp1->cl->len[tid], 100, mean);
+        s2 = bwStats(fp2, fp2->cl->chrom[tid], 0, fp2->cl->len[tid], 100, mean);
+        if(!s1 || !s2 || memcmp(s1, s2, 100 * sizeof(double))) goto done;
+        free(s1);
+        free(s2);
+        s1 = s2 = NULL;
+    }
+    rv = 0;
+
+done:
+    free(s1);
+    free(s2);
+    bwClose(fp1);
+    bwClose(fp2);
+    return rv;
+}
+
+//Check that choosing the type of each block gives a smaller file with the same contents
+int main(int argc, char *argv[]) {
+    if(argc != 3) {
+        fprintf(stderr, "Usage: %s output1.bw output2.bw\n", argv[0]);
+        return 1;
+    }
+
+    if(bwInit(1<<17) != 0) {
+        fprintf(stderr, "Received an error in bwInit\n");
+        return 1;
+    }
+
+    if(makeFile(argv[1], 0) || makeFile(argv[2], 1)) {
+        fprintf(stderr, "Couldn't create %s and %s\n", argv[1], argv[2]);
+        goto error;
+    }
+    if(compareFiles(argv[1], argv[2])) {
+        fprintf(stderr, "Choosing the block types changed the contents\n");
+        goto error;
+    }
+    if(fileSize(argv[2]) >= fileSize(argv[1])) {
+        fprintf(stderr, "Choosing the block types didn't make the file smaller\n");
+        goto error;
+    }
+
+    bwCleanup();
+    return 0;
+
+error:
+    bwCleanup();
+    return 1;
+}
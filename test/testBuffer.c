@@ -0,0 +1,115 @@
+#include "bigWig.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+//Read a whole file into memory, returning NULL on error
+static void *slurp(const char *fname, size_t *len) {
+    FILE *f = fopen(fname, "rb");
+    void *buf = NULL;
+    long sz;
+    if(!f) return NULL;
+    if(fseek(f, 0, SEEK_END)) goto error;
+    sz = ftell(f);
+    if(sz <= 0) goto error;
+    if(fseek(f, 0, SEEK_SET)) goto error;
+    buf = malloc(sz);
+    if(!buf) goto error;
+    if(fread(buf, 1, sz, f) != (size_t) sz) goto error;
+    fclose(f);
+    *len = sz;
+    return buf;
+
+error:
+    free(buf);
+    fclose(f);
+    return NULL;
+}
+
+//This is testWrite, except that both the input and output are held in memory
+int main(int argc, char *argv[]) {
+    bigWigFile_t *ifp = NULL;
+    bigWigFile_t *ofp = NULL;
+    uint32_t tid, i;
+    char **chroms;
+    bwOverlappingIntervals_t *o;
+    void *ibuf = NULL, *obuf = NULL;
+    size_t ilen = 0, olen = 0;
+    FILE *out;
+    if(argc != 3) {
+        fprintf(stderr, "Usage: %s inputfile.bw outputfile.bw\n", argv[0]);
+        return 1;
+    }
+
+    if(bwInit(1<<17) != 0) {
+        fprintf(stderr, "Received an error in bwInit\n");
+        return 1;
+    }
+
+    ibuf = slurp(argv[1], &ilen);
+    if(!ibuf) {
+        fprintf(stderr, "An error occured while reading %s\n", argv[1]);
+        return 1;
+    }
+
+    ifp = bwOpenBuffer(ibuf, ilen);
+    if(!ifp) {
+        free(ibuf);
+        fprintf(stderr, "An error occured while opening %s from memory\n", argv[1]);
+        return 1;
+    }
+
+    ofp = bwOpenBufferWrite(&obuf, &olen);
+    if(!ofp) {
+        bwClose(ifp);
+        free(ibuf);
+        fprintf(stderr, "An error occured while opening an in-memory output file\n");
+        return 1;
+    }
+
+    if(bwCreateHdr(ofp, 10)) goto error; //ten zoom levels
+    ofp->cl = bwCreateChromList((const char* const*)ifp->cl->chrom, ifp->cl->len, ifp->cl->nKeys);
+    if(!ofp->cl) goto error;
+
+    if(bwWriteHdr(ofp)) goto error;
+
+    //Copy all of the intervals
+    for(tid = 0; tid < ofp->cl->nKeys; tid++) {
+        o = bwGetOverlappingIntervals(ifp, ofp->cl->chrom[tid], 0, ofp->cl->len[tid]);
+        if(!o) goto error;
+        if(o->l) {
+            chroms = malloc(o->l * sizeof(char*));
+            if(!chroms) goto error;
+            for(i=0; i<o->l; i++) chroms[i] = ofp->cl->chrom[tid];
+            bwAddIntervals(ofp, (const char* const*)chroms, o->start, o->end, o->value, o->l);
+            free(chroms);
+        }
+        bwDestroyOverlappingIntervals(o);
+    }
+
+    bwClose(ifp);
+    free(ibuf);
+    bwClose(ofp); //This sets obuf and olen
+    bwCleanup();
+
+    out = fopen(argv[2], "wb");
+    if(!out || fwrite(obuf, 1, olen, out) != olen) {
+        fprintf(stderr, "An error occured while writing %s\n", argv[2]);
+        if(out) fclose(out);
+        free(obuf);
+        return 1;
+    }
+    fclose(out);
+    free(obuf);
+
+    return 0;
+
+error:
+    fprintf(stderr, "Got an error somewhere!\n");
+    bwClose(ifp);
+    free(ibuf);
+    bwClose(ofp);
+    free(obuf);
+    bwCleanup();
+    return 1;
+}
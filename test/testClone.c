@@ -0,0 +1,106 @@
+#include "bigWig.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Returns 0 if fp gives the same intervals as ref over every chromosome
+static int compare(bigWigFile_t *ref, bigWigFile_t *fp) {
+    bwOverlappingIntervals_t *o1, *o2;
+    uint32_t tid;
+    int rv = 0;
+
+    for(tid=0; tid<ref->cl->nKeys && !rv; tid++) {
+        o1 = bwGetOverlappingIntervals(ref, ref->cl->chrom[tid], 0, ref->cl->len[tid]);
+        o2 = bwGetOverlappingIntervals(fp, ref->cl->chrom[tid], 0, ref->cl->len[tid]);
+        if(!o1 || !o2 || o1->l != o2->l) rv = 1;
+        else if(memcmp(o1->start, o2->start, o1->l * sizeof(uint32_t))) rv = 1;
+        else if(memcmp(o1->end, o2->end, o1->l * sizeof(uint32_t))) rv = 1;
+        else if(memcmp(o1->value, o2->value, o1->l * sizeof(float))) rv = 1;
+        if(o1) bwDestroyOverlappingIntervals(o1);
+        if(o2) bwDestroyOverlappingIntervals(o2);
+    }
+    return rv;
+}
+
+//Clone handles to a local and an in-memory file and close them in various orders
+int main(int argc, char *argv[]) {
+    bigWigFile_t *ref = NULL, *fp = NULL, *c1 = NULL, *c2 = NULL, *c3 = NULL;
+    FILE *f = NULL;
+    void *buf = NULL;
+    char *name;
+    long len;
+    int rv = 1;
+    if(argc != 2) {
+        fprintf(stderr, "Usage: %s file.bw\n", argv[0]);
+        return 1;
+    }
+
+    if(bwInit(1<<17) != 0) {
+        fprintf(stderr, "Received an error in bwInit\n");
+        return 1;
+    }
+
+    //The file name is copied, so it needn't outlive bwOpen()
+    name = strdup(argv[1]);
+    if(!name) goto done;
+    ref = bwOpen(argv[1], NULL, "r");
+    fp = bwOpen(name, NULL, "r");
+    memset(name, 'x', strlen(name));
+    free(name);
+    if(!ref || !fp) goto done;
+
+    //Clones of clones, closing the original first
+    c1 = bwClone(fp);
+    if(!c1) goto done;
+    c2 = bwClone(c1);
+    if(!c2) goto done;
+    if(c1->hdr != fp->hdr || c2->cl != fp->cl || c2->idx != fp->idx || c1->URL == fp->URL) {
+        fprintf(stderr, "Clones don't share metadata as expected\n");
+        goto done;
+    }
+    bwClose(fp);
+    fp = NULL;
+    if(compare(ref, c1) || compare(ref, c2)) {
+        fprintf(stderr, "A clone of a local file gave different results\n");
+        goto done;
+    }
+    bwClose(c1);
+    c1 = NULL;
+    if(compare(ref, c2)) {
+        fprintf(stderr, "A clone of a local file gave different results after closing another clone\n");
+        goto done;
+    }
+    bwClose(c2);
+    c2 = NULL;
+
+    //In-memory files
+    f = fopen(argv[1], "rb");
+    if(!f) goto done;
+    if(fseek(f, 0, SEEK_END)) goto done;
+    len = ftell(f);
+    if(len <= 0 || fseek(f, 0, SEEK_SET)) goto done;
+    buf = malloc(len);
+    if(!buf || fread(buf, 1, len, f) != (size_t) len) goto done;
+    fp = bwOpenBuffer(buf, len);
+    if(!fp) goto done;
+    c3 = bwClone(fp);
+    if(!c3) goto done;
+    if(compare(ref, c3) || compare(ref, fp)) {
+        fprintf(stderr, "A clone of an in-memory file gave different results\n");
+        goto done;
+    }
+
+    rv = 0;
+
+done:
+    if(f) fclose(f);
+    bwClose(c3);
+    bwClose(c2);
+    bwClose(c1);
+    bwClose(fp);
+    bwClose(ref);
+    free(buf);
+    bwCleanup();
+    return rv;
+}
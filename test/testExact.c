@@ -0,0 +1,105 @@
+#include "bigWig.h"
+#include "testHelpers.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define NCHROMS 2
+
+//Zoom levels store sums in single precision, so only min, max and coverage are expected to match exactly
+static double tolerance(enum bwStatsType type) {
+    if(type == min || type == max || type == coverage) return 0;
+    return 1e-4;
+}
+
+//Write a file with many zoom levels and intervals of varying widths, values and gaps
+//Returns 0 on success
+static int makeFile(const char *fname) {
+    const char *chroms[NCHROMS] = {"chr1", "chr2"};
+    uint32_t lens[NCHROMS] = {2000000, 500000}, tid;
+    bigWigFile_t *fp = createFile(fname, chroms, lens, NCHROMS, 10);
+    if(!fp) return 1;
+
+    srand(42);
+    for(tid=0; tid<NCHROMS; tid++) {
+        if(addRandomIntervals(fp, chroms[tid], rand() % 100, lens[tid] - 1000, 200, 150)) goto error;
+    }
+
+    bwClose(fp);
+    return 0;
+
+error:
+    bwClose(fp);
+    return 1;
+}
+
+//Compare bwStatsExact() with bwStatsFromFull() for every type of statistic over [start, end)
+//Returns 0 if everything matches
+static int compare(bigWigFile_t *fp, uint32_t tid, uint32_t start, uint32_t end) {
+    enum bwStatsType types[6] = {mean, stdev, max, min, coverage, sum};
+    uint32_t nBins[3] = {1, 13, 200};
+    double *s1, *s2;
+    uint32_t i, j, k;
+    int rv = 0;
+
+    for(i=0; i<6 && !rv; i++) {
+        for(j=0; j<3 && !rv; j++) {
+            s1 = bwStatsExact(fp, fp->cl->chrom[tid], start, end, nBins[j], types[i]);
+            s2 = bwStatsFromFull(fp, fp->cl->chrom[tid], start, end, nBins[j], types[i]);
+            if(!s1 || !s2) {
+                fprintf(stderr, "Couldn't compute statistics\n");
+                rv = 1;
+            }
+            for(k=0; k<nBins[j] && !rv; k++) {
+                if(differ(s1[k], s2[k], tolerance(types[i]))) {
+                    fprintf(stderr, "Mismatch on %s with %"PRIu32" bins of type %i: %f vs. %f\n", fp->cl->chrom[tid], nBins[j], types[i], s1[k], s2[k]);
+                    rv = 1;
+                }
+            }
+            free(s1);
+            free(s2);
+        }
+    }
+    return rv;
+}
+
+//Check bwStatsExact() on a synthetic file
+int main(int argc, char *argv[]) {
+    bigWigFile_t *fp = NULL;
+    uint32_t tid, len;
+    int rv = 1;
+    if(argc != 2) {
+        fprintf(stderr, "Usage: %s output.bw\n", argv[0]);
+        return 1;
+    }
+
+    if(bwInit(1<<17) != 0) {
+        fprintf(stderr, "Received an error in bwInit\n");
+        return 1;
+    }
+
+    if(makeFile(argv[1])) {
+        fprintf(stderr, "Couldn't create %s\n", argv[1]);
+        goto done;
+    }
+    fp = bwOpen(argv[1], NULL, "r");
+    if(!fp) {
+        fprintf(stderr, "An error occured while opening %s\n", argv[1]);
+        goto done;
+    }
+
+    //Whole chromosomes and intervals that start and end part way through zoom records
+    for(tid=0; tid<fp->cl->nKeys; tid++) {
+        len = fp->cl->len[tid];
+        if(compare(fp, tid, 0, len)) goto done;
+        if(compare(fp, tid, len/7 + 3, len - len/9)) goto done;
+    }
+    rv = 0;
+
+done:
+    bwClose(fp);
+    bwCleanup();
+    return rv;
+}
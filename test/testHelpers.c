@@ -0,0 +1,148 @@
+#include "testHelpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+//The number of entries of each type given to the bwAdd*() functions by addEntryTypes(), the rest are appended
+#define FIRST_ENTRIES 100
+
+bigWigFile_t *createFile(const char *fname, const char **chroms, const uint32_t *lens, uint32_t nChroms, int32_t nLevels) {
+    bigWigFile_t *fp = bwOpen(fname, NULL, "w");
+    if(!fp) return NULL;
+    if(bwCreateHdr(fp, nLevels)) goto error;
+    fp->cl = bwCreateChromList(chroms, lens, nChroms);
+    if(!fp->cl) goto error;
+    if(bwWriteHdr(fp)) goto error;
+    return fp;
+
+error:
+    bwClose(fp);
+    return NULL;
+}
+
+int addEntryTypes(bigWigFile_t *fp, const char *intervalChrom, const char *spanChrom, const char *stepChrom, uint32_t n) {
+    const char **names = malloc(n * sizeof(char*));
+    uint32_t *starts = malloc(n * sizeof(uint32_t)), *ends = malloc(n * sizeof(uint32_t)), i, pos = 0;
+    float *values = malloc(n * sizeof(float));
+    uint32_t first = (n < FIRST_ENTRIES) ? n : FIRST_ENTRIES;
+    int rv = 1;
+    if(!names || !starts || !ends || !values) goto done;
+
+    for(i=0; i<n; i++) {
+        names[i] = intervalChrom;
+        starts[i] = pos;
+        ends[i] = pos + 1 + rand() % 40;
+        values[i] = (rand() % 800) / 8.0f - 10;
+        pos = ends[i] + rand() % 30;
+    }
+    if(intervalChrom) {
+        if(bwAddIntervals(fp, names, starts, ends, values, first)) goto done;
+        if(bwAppendIntervals(fp, starts+first, ends+first, values+first, n-first)) goto done;
+    }
+
+    //After the intervals, in case they're on the same chromosome
+    if(spanChrom) {
+        for(i=0; i<n; i++) starts[i] = pos + 40*i + i%13;
+        if(bwAddIntervalSpans(fp, spanChrom, starts, 25, values, first)) goto done;
+        if(bwAppendIntervalSpans(fp, starts+first, values+first, n-first)) goto done;
+    }
+
+    if(stepChrom) {
+        if(bwAddIntervalSpanSteps(fp, stepChrom, 100, 20, 50, values, first)) goto done;
+        if(bwAppendIntervalSpanSteps(fp, values+first, n-first)) goto done;
+    }
+    rv = 0;
+
+done:
+    free(names);
+    free(starts);
+    free(ends);
+    free(values);
+    return rv;
+}
+
+int addRandomIntervals(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, uint32_t maxWidth, uint32_t maxGap) {
+    uint32_t e;
+    float value;
+    while(start < end) {
+        e = start + 1 + rand() % maxWidth;
+        value = (rand() % 2000) / 16.0f - 40;
+        if(bwAddIntervals(fp, &chrom, &start, &e, &value, 1)) return 1;
+        start = e + rand() % maxGap;
+    }
+    return 0;
+}
+
+int differ(double a, double b, double tol) {
+    if(isnan(a) || isnan(b)) return !(isnan(a) && isnan(b));
+    return fabs(a-b) > tol * fmax(fabs(a), fabs(b));
+}
+
+int compareFileBytes(const char *f1, const char *f2) {
+    FILE *a = fopen(f1, "rb"), *b = fopen(f2, "rb");
+    int c1 = 0, c2 = 0, rv = 1;
+    if(!a || !b) goto done;
+    while(c1 == c2 && c1 != EOF) {
+        c1 = fgetc(a);
+        c2 = fgetc(b);
+    }
+    rv = (c1 != c2);
+
+done:
+    if(a) fclose(a);
+    if(b) fclose(b);
+    return rv;
+}
+
+int compareFileEntries(const char *f1, const char *f2) {
+    bigWigFile_t *fp1 = bwOpen(f1, NULL, "r"), *fp2 = bwOpen(f2, NULL, "r");
+    bwOverlappingIntervals_t *o1 = NULL, *o2 = NULL;
+    uint32_t tid;
+    int rv = 1;
+    if(!fp1 || !fp2) goto done;
+    if(fp1->cl->nKeys != fp2->cl->nKeys) goto done;
+
+    for(tid=0; tid<fp1->cl->nKeys; tid++) {
+        if(strcmp(fp1->cl->chrom[tid], fp2->cl->chrom[tid]) || fp1->cl->len[tid] != fp2->cl->len[tid]) goto done;
+        o1 = bwGetOverlappingIntervals(fp1, fp1->cl->chrom[tid], 0, fp1->cl->len[tid]);
+        o2 = bwGetOverlappingIntervals(fp2, fp2->cl->chrom[tid], 0, fp2->cl->len[tid]);
+        if(!o1 || !o2 || o1->l != o2->l || !o1->l) goto done;
+        if(memcmp(o1->start, o2->start, o1->l * sizeof(uint32_t))) goto done;
+        if(memcmp(o1->end, o2->end, o1->l * sizeof(uint32_t))) goto done;
+        if(memcmp(o1->value, o2->value, o1->l * sizeof(float))) goto done;
+        bwDestroyOverlappingIntervals(o1);
+        bwDestroyOverlappingIntervals(o2);
+        o1 = o2 = NULL;
+    }
+    rv = 0;
+
+done:
+    if(o1) bwDestroyOverlappingIntervals(o1);
+    if(o2) bwDestroyOverlappingIntervals(o2);
+    bwClose(fp1);
+    bwClose(fp2);
+    return rv;
+}
+
+int checkZoomLevels(bigWigFile_t *fp) {
+    enum bwStatsType types[4] = {min, max, coverage, mean};
+    double *s1, *s2;
+    uint32_t tid, i;
+    int rv = 0;
+
+    if(!fp->hdr->nLevels) return 1;
+    for(tid=0; tid<fp->cl->nKeys && !rv; tid++) {
+        for(i=0; i<4 && !rv; i++) {
+            s1 = bwStats(fp, fp->cl->chrom[tid], 0, fp->cl->len[tid], 1, types[i]);
+            s2 = bwStatsFromFull(fp, fp->cl->chrom[tid], 0, fp->cl->len[tid], 1, types[i]);
+            if(!s1 || !s2 || differ(s1[0], s2[0], types[i] == mean ? 1e-5 : 0)) {
+                fprintf(stderr, "Zoom level mismatch on %s for type %i\n", fp->cl->chrom[tid], types[i]);
+                rv = 1;
+            }
+            free(s1);
+            free(s2);
+        }
+    }
+    return rv;
+}
@@ -0,0 +1,36 @@
+#ifndef LIBBIGWIG_TEST_HELPERS_H
+#define LIBBIGWIG_TEST_HELPERS_H
+
+#include "bigWig.h"
+
+//Fixtures and comparisons shared by the tests that write files
+
+//Open fname for writing with up to nLevels zoom levels (see bwCreateHdr()) and the given chromosomes, and write its header
+//For options that must be set before the header is written, do this by hand instead
+//Returns NULL on error
+bigWigFile_t *createFile(const char *fname, const char **chroms, const uint32_t *lens, uint32_t nChroms, int32_t nLevels);
+
+//Add n random entries of each type: bedGraph-like intervals on intervalChrom, followed by spans on spanChrom and fixed steps on stepChrom
+//The first 100 of each type are added and the rest appended. Entries of a type whose chromosome is NULL aren't added
+//There are on average 35 bases per interval, 40 per span and 50 per step, so chromosomes need to be long enough for that. Call srand() first
+//Returns 0 on success
+int addEntryTypes(bigWigFile_t *fp, const char *intervalChrom, const char *spanChrom, const char *stepChrom, uint32_t n);
+
+//Add intervals of 1 to maxWidth bases, separated by gaps of fewer than maxGap bases, one at a time on chrom starting at start and stopping at end
+//Intervals can extend up to maxWidth bases past end. Call srand() first
+//Returns 0 on success
+int addRandomIntervals(bigWigFile_t *fp, const char *chrom, uint32_t start, uint32_t end, uint32_t maxWidth, uint32_t maxGap);
+
+//Returns 0 if a and b are both NaN or differ by no more than tol relative to the larger of them, so a tol of 0 means they must be equal
+int differ(double a, double b, double tol);
+
+//Returns 0 if the two files are byte for byte identical
+int compareFileBytes(const char *f1, const char *f2);
+
+//Returns 0 if the two files have the same chromosomes and hold the same entries, with at least one on each chromosome
+int compareFileEntries(const char *f1, const char *f2);
+
+//Returns 0 if the zoom levels give the same minimum, maximum and coverage over every chromosome as the full resolution data, and the same mean up to single precision rounding
+int checkZoomLevels(bigWigFile_t *fp);
+
+#endif
@@ -0,0 +1,121 @@
+#include "bigWig.h"
+#include "testHelpers.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define NLINEAR 9
+#define NLOG 6
+
+//Write a file with intervals of varying widths, gaps and values
+//Returns 0 on success
+static int makeFile(const char *fname) {
+    const char *chrom = "chr1";
+    uint32_t len = 200000;
+    bigWigFile_t *fp = createFile(fname, &chrom, &len, 1, 10);
+    if(!fp) return 1;
+
+    srand(11);
+    if(addRandomIntervals(fp, chrom, 500, len - 1000, 300, 100)) goto error;
+
+    bwClose(fp);
+    return 0;
+
+error:
+    bwClose(fp);
+    return 1;
+}
+
+//Compare bwHistogram() with histograms of the output of bwGetOverlappingIntervals() for each bin
+//Returns 0 if everything matches
+static int compare(bigWigFile_t *fp, uint32_t start, uint32_t end, uint32_t nBins, const double *edges, uint32_t nEdges) {
+    double *counts = bwHistogram(fp, "chr1", start, end, nBins, edges, nEdges);
+    double *expected = calloc(nEdges - 1, sizeof(double));
+    bwOverlappingIntervals_t *o;
+    uint32_t i, j, k, s, e, pos = start, end2;
+    int rv = 0;
+
+    if(!counts || !expected) {
+        fprintf(stderr, "Couldn't compute histograms\n");
+        rv = 1;
+    }
+    for(i=0; i<nBins && !rv; i++) {
+        end2 = start + ((double)(end-start)*(i+1))/((int) nBins);
+        memset(expected, 0, sizeof(double) * (nEdges - 1));
+        o = (pos < end2) ? bwGetOverlappingIntervals(fp, "chr1", pos, end2) : NULL;
+        for(j=0; o && j<o->l; j++) {
+            s = (o->start[j] < pos) ? pos : o->start[j];
+            e = (o->end[j] > end2) ? end2 : o->end[j];
+            for(k=0; k<nEdges-1; k++) {
+                if(o->value[j] >= edges[k] && (o->value[j] < edges[k+1] || (k == nEdges-2 && o->value[j] == edges[k+1]))) {
+                    expected[k] += e - s;
+                    break;
+                }
+            }
+        }
+        if(o) bwDestroyOverlappingIntervals(o);
+        if(memcmp(counts + i*(nEdges-1), expected, sizeof(double) * (nEdges - 1))) {
+            fprintf(stderr, "Mismatch in bin %"PRIu32" of %"PRIu32"-%"PRIu32" with %"PRIu32" bins\n", i, start, end, nBins);
+            rv = 1;
+        }
+        pos = end2;
+    }
+    free(counts);
+    free(expected);
+    return rv;
+}
+
+//Check bwHistogram() on a synthetic file
+int main(int argc, char *argv[]) {
+    const double linear[NLINEAR] = {-20, -10, -0.5, 0, 0.5, 10, 40, 60, 79.9};
+    const double unsorted[3] = {0, 10, 10};
+    double *logEdges = NULL;
+    bigWigFile_t *fp = NULL;
+    int rv = 1;
+    if(argc != 2) {
+        fprintf(stderr, "Usage: %s output.bw\n", argv[0]);
+        return 1;
+    }
+
+    if(bwInit(1<<17) != 0) {
+        fprintf(stderr, "Received an error in bwInit\n");
+        return 1;
+    }
+
+    if(makeFile(argv[1])) {
+        fprintf(stderr, "Couldn't create %s\n", argv[1]);
+        goto done;
+    }
+    fp = bwOpen(argv[1], NULL, "r");
+    if(!fp) {
+        fprintf(stderr, "An error occured while opening %s\n", argv[1]);
+        goto done;
+    }
+
+    logEdges = bwLogSpacedEdges(0.1, 100, NLOG);
+    if(!logEdges || logEdges[0] != 0.1 || logEdges[NLOG-1] != 100 || fabs(logEdges[1] - 0.1 * pow(10, 0.6)) > 1e-9) {
+        fprintf(stderr, "bwLogSpacedEdges() gave unexpected edges\n");
+        goto done;
+    }
+
+    if(compare(fp, 0, 200000, 1, linear, NLINEAR)) goto done;
+    if(compare(fp, 0, 200000, 7, linear, NLINEAR)) goto done;
+    if(compare(fp, 1234, 150001, 1000, logEdges, NLOG)) goto done;
+    //More bins than bases, so some are empty
+    if(compare(fp, 5000, 5010, 23, linear, NLINEAR)) goto done;
+
+    //There must be at least two edges and they must increase
+    if(bwHistogram(fp, "chr1", 0, 1000, 1, linear, 1) || bwHistogram(fp, "chr1", 0, 1000, 1, unsorted, 3)) {
+        fprintf(stderr, "bwHistogram() accepted invalid edges\n");
+        goto done;
+    }
+    rv = 0;
+
+done:
+    free(logEdges);
+    bwClose(fp);
+    bwCleanup();
+    return rv;
+}
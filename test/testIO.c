@@ -0,0 +1,136 @@
+#include "bigWig.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+//A minimal pread()-based I/O backend
+static size_t ioRead(void *ctx, void *buf, size_t len, uint64_t offset) {
+    ssize_t rv = pread(*(int*)ctx, buf, len, offset);
+    if(rv < 0) return 0;
+    return rv;
+}
+
+//The number of times ioSize() is called, which should be once per handle
+static int nSizeCalls = 0;
+
+static uint64_t ioSize(void *ctx) {
+    struct stat st;
+    nSizeCalls++;
+    if(fstat(*(int*)ctx, &st)) return 0;
+    return st.st_size;
+}
+
+static void ioClose(void *ctx) {
+    close(*(int*)ctx);
+}
+
+static int ioReadBatch(void *ctx, size_t n, void **bufs, const size_t *lens, const uint64_t *offsets) {
+    size_t i;
+    //Read the regions back to front, to ensure that nothing depends on the order
+    for(i=n; i>0; i--) {
+        if(ioRead(ctx, bufs[i-1], lens[i-1], offsets[i-1]) != lens[i-1]) return 1;
+    }
+    return 0;
+}
+
+//This is testWrite, except that the input is read through a custom I/O backend
+//If a third argument of "uring" is given then the io_uring backend is used instead, exiting with 77 if it isn't available
+int main(int argc, char *argv[]) {
+    bigWigFile_t *ifp = NULL;
+    bigWigFile_t *ofp = NULL;
+    uint32_t tid, i;
+    char **chroms;
+    bwOverlappingIntervals_t *o;
+    bwIO_t io = {0};
+    int fd, rv;
+    if(argc != 3 && argc != 4) {
+        fprintf(stderr, "Usage: %s inputfile.bw outputfile.bw [uring]\n", argv[0]);
+        return 1;
+    }
+
+    if(bwInit(1<<17) != 0) {
+        fprintf(stderr, "Received an error in bwInit\n");
+        return 1;
+    }
+
+    if(argc == 4 && strcmp(argv[3], "uring") == 0) {
+        rv = bwIOUringInit(&io, argv[1], 0);
+        if(rv) {
+            //Only skip if io_uring isn't there at all, not if the file can't be opened
+            if(errno == ENOSYS) {
+                fprintf(stderr, rv == 1 ? "libBigWig was compiled without io_uring support\n" : "The kernel doesn't support io_uring\n");
+                bwCleanup();
+                return 77;
+            }
+            fprintf(stderr, "Couldn't set up io_uring for %s: %s\n", argv[1], strerror(errno));
+            bwCleanup();
+            return 1;
+        }
+    } else {
+        fd = open(argv[1], O_RDONLY);
+        if(fd < 0) {
+            fprintf(stderr, "An error occured while opening %s\n", argv[1]);
+            return 1;
+        }
+        io.ctx = &fd;
+        io.read = ioRead;
+        io.size = ioSize;
+        io.close = ioClose;
+        io.readBatch = ioReadBatch;
+    }
+
+    ifp = bwOpenIO(&io);
+    if(!ifp) {
+        fprintf(stderr, "An error occured while opening %s through bwOpenIO\n", argv[1]);
+        return 1;
+    }
+
+    ofp = bwOpen(argv[2], NULL, "w");
+    if(!ofp) {
+        bwClose(ifp);
+        fprintf(stderr, "An error occured while opening %s\n", argv[2]);
+        return 1;
+    }
+
+    if(bwCreateHdr(ofp, 10)) goto error; //ten zoom levels
+    ofp->cl = bwCreateChromList((const char* const*)ifp->cl->chrom, ifp->cl->len, ifp->cl->nKeys);
+    if(!ofp->cl) goto error;
+
+    if(bwWriteHdr(ofp)) goto error;
+
+    //Copy all of the intervals
+    for(tid = 0; tid < ofp->cl->nKeys; tid++) {
+        o = bwGetOverlappingIntervals(ifp, ofp->cl->chrom[tid], 0, ofp->cl->len[tid]);
+        if(!o) goto error;
+        if(o->l) {
+            chroms = malloc(o->l * sizeof(char*));
+            if(!chroms) goto error;
+            for(i=0; i<o->l; i++) chroms[i] = ofp->cl->chrom[tid];
+            bwAddIntervals(ofp, (const char* const*)chroms, o->start, o->end, o->value, o->l);
+            free(chroms);
+        }
+        bwDestroyOverlappingIntervals(o);
+    }
+
+    bwClose(ifp);
+    bwClose(ofp);
+    bwCleanup();
+
+    if(nSizeCalls > 1) {
+        fprintf(stderr, "The size of the input was asked for %i times\n", nSizeCalls);
+        return 1;
+    }
+    return 0;
+
+error:
+    fprintf(stderr, "Got an error somewhere!\n");
+    bwClose(ifp);
+    bwClose(ofp);
+    bwCleanup();
+    return 1;
+}
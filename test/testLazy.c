@@ -0,0 +1,81 @@
+#include "bigWig.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Compare the results of lazy and normal chromosome list loading
+//Returns 0 if everything matches
+int main(int argc, char *argv[]) {
+    bigWigFile_t *fp = NULL, *byName = NULL, *byTid = NULL;
+    bwOverlappingIntervals_t *o1 = NULL, *o2 = NULL;
+    const char *chrom;
+    uint32_t tid;
+    int rv = 1;
+    if(argc != 2) {
+        fprintf(stderr, "Usage: %s file.bw\n", argv[0]);
+        return 1;
+    }
+
+    if(bwInit(1<<17) != 0) {
+        fprintf(stderr, "Received an error in bwInit\n");
+        return 1;
+    }
+
+    fp = bwOpen(argv[1], NULL, "r");
+    byName = bwOpen(argv[1], NULL, "rl");
+    byTid = bwOpen(argv[1], NULL, "rl");
+    if(!fp || !byName || !byTid) {
+        fprintf(stderr, "An error occured while opening %s\n", argv[1]);
+        goto done;
+    }
+    if(!byName->cl->tree || byName->cl->tree->loaded || byName->cl->chrom[0]) {
+        fprintf(stderr, "The chromosome list wasn't loaded lazily\n");
+        goto done;
+    }
+
+    //Look up by name first in one and by ID first in the other
+    for(tid=0; tid<fp->cl->nKeys; tid++) {
+        if(bwGetTid(byName, fp->cl->chrom[tid]) != tid) {
+            fprintf(stderr, "bwGetTid(%s) mismatch\n", fp->cl->chrom[tid]);
+            goto done;
+        }
+        chrom = bwGetChrom(byTid, tid);
+        if(!chrom || strcmp(chrom, fp->cl->chrom[tid]) != 0) {
+            fprintf(stderr, "bwGetChrom(%"PRIu32") mismatch\n", tid);
+            goto done;
+        }
+        if(bwGetChromLen(byName, tid) != fp->cl->len[tid] || bwGetChromLen(byTid, tid) != fp->cl->len[tid]) {
+            fprintf(stderr, "bwGetChromLen(%"PRIu32") mismatch\n", tid);
+            goto done;
+        }
+    }
+    if(bwGetChrom(byTid, fp->cl->nKeys) != NULL) {
+        fprintf(stderr, "bwGetChrom() found a chromosome that doesn't exist\n");
+        goto done;
+    }
+
+    //Queries go through bwGetTid()
+    o1 = bwGetOverlappingIntervals(fp, fp->cl->chrom[0], 0, fp->cl->len[0]);
+    o2 = bwGetOverlappingIntervals(byTid, fp->cl->chrom[0], 0, fp->cl->len[0]);
+    if(!o1 || !o2 || o1->l != o2->l || memcmp(o1->start, o2->start, o1->l * sizeof(uint32_t)) || memcmp(o1->value, o2->value, o1->l * sizeof(float))) {
+        fprintf(stderr, "bwGetOverlappingIntervals() mismatch\n");
+        goto done;
+    }
+
+    //A missing chromosome falls back to loading everything
+    if(bwGetTid(byName, "no such chromosome") != (uint32_t) -1 || !byName->cl->tree->loaded) {
+        fprintf(stderr, "Looking up a missing chromosome didn't load the whole list\n");
+        goto done;
+    }
+    rv = 0;
+
+done:
+    if(o1) bwDestroyOverlappingIntervals(o1);
+    if(o2) bwDestroyOverlappingIntervals(o2);
+    bwClose(fp);
+    bwClose(byName);
+    bwClose(byTid);
+    bwCleanup();
+    return rv;
+}
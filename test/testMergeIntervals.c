@@ -0,0 +1,205 @@
+#include "bigWig.h"
+#include "testHelpers.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define NCHROMS 2
+#define LEN 200000
+#define CHUNK 777
+
+//Per-base values in runs of random lengths, with each run's value a multiple of 0.5 and, if noise is set, a little added to each base
+static void makeValues(float *values, uint32_t *nRuns, int noise) {
+    uint32_t i = 0, j, l;
+    float v;
+    *nRuns = 0;
+    srand(3);
+    while(i < LEN) {
+        l = 1 + rand() % 60;
+        v = (rand() % 40) / 2.0f;
+        //Adjacent runs always differ
+        if(i && v == roundf(values[i-1] * 2) / 2) v += 0.5f;
+        for(j=0; j<l && i<LEN; j++, i++) values[i] = v + (noise ? (rand() % 3) * 0.04f : 0);
+        (*nRuns)++;
+    }
+}
+
+//Write per-base entries on chr1 in chunks, so that runs span calls, and the same entries but with a gap after every one on chr2
+//If runs isn't 0, the entries on chr1 are instead written one per run, without merging
+//Returns 0 on success
+static int makeFile(const char *fname, const float *values, float tolerance, float quantum, int runs) {
+    const char *chroms[NCHROMS] = {"chr1", "chr2"};
+    uint32_t lens[NCHROMS] = {LEN, 2*LEN};
+    const char **names = malloc(LEN * sizeof(char*));
+    uint32_t *starts = malloc(LEN * sizeof(uint32_t)), *ends = malloc(LEN * sizeof(uint32_t)), i, n = 0;
+    float *vals = malloc(LEN * sizeof(float));
+    bigWigFile_t *fp = bwOpen(fname, NULL, "w");
+    if(!fp || !names || !starts || !ends || !vals) goto error;
+
+    if(bwCreateHdr(fp, 10)) goto error;
+    if(bwSetMergeIntervals(fp, runs ? -1 : tolerance, quantum)) goto error;
+    fp->cl = bwCreateChromList(chroms, lens, NCHROMS);
+    if(!fp->cl) goto error;
+    if(bwWriteHdr(fp)) goto error;
+
+    for(i=0; i<LEN; i++) {
+        names[i] = chroms[0];
+        if(runs && n && values[i] == vals[n-1]) {
+            ends[n-1]++;
+            continue;
+        }
+        starts[n] = i;
+        ends[n] = i+1;
+        vals[n++] = values[i];
+    }
+    if(bwAddIntervals(fp, names, starts, ends, vals, n < CHUNK ? n : CHUNK)) goto error;
+    for(i=CHUNK; i<n; i+=CHUNK) {
+        if(bwAppendIntervals(fp, starts+i, ends+i, vals+i, (n - i < CHUNK) ? n - i : CHUNK)) goto error;
+    }
+
+    for(i=0; i<LEN; i++) {
+        names[i] = chroms[1];
+        starts[i] = 2*i;
+        ends[i] = starts[i] + 1;
+    }
+    if(bwAddIntervals(fp, names, starts, ends, values, LEN)) goto error;
+
+    free(names);
+    free(starts);
+    free(ends);
+    free(vals);
+    bwClose(fp);
+    return 0;
+
+error:
+    free(names);
+    free(starts);
+    free(ends);
+    free(vals);
+    bwClose(fp);
+    return 1;
+}
+
+//Check the entries on chr1 against the per-base values: there must be nRuns of them, covering every base, with each base's value within tolerance of its entry's and, if quantum is set, every value a multiple of it
+//Entries on chr2 are never merged
+//Returns 0 on success
+static int checkFile(const char *fname, const float *values, uint32_t nRuns, float tolerance, float quantum) {
+    bigWigFile_t *fp = bwOpen(fname, NULL, "r");
+    bwOverlappingIntervals_t *o = NULL;
+    uint32_t i, j, pos = 0;
+    int rv = 1;
+    if(!fp) return 1;
+
+    o = bwGetOverlappingIntervals(fp, "chr1", 0, LEN);
+    if(!o || o->l != nRuns) goto done;
+    for(i=0; i<o->l; i++) {
+        if(o->start[i] != pos) goto done;
+        if(quantum > 0 && o->value[i] != roundf(o->value[i] / quantum) * quantum) goto done;
+        for(j=o->start[i]; j<o->end[i]; j++) {
+            if(fabs(values[j] - o->value[i]) > tolerance + 1e-5) goto done;
+        }
+        pos = o->end[i];
+    }
+    if(pos != LEN) goto done;
+    bwDestroyOverlappingIntervals(o);
+
+    o = bwGetOverlappingIntervals(fp, "chr2", 0, 2*LEN);
+    if(!o || o->l != LEN) goto done;
+    rv = 0;
+
+done:
+    if(o) bwDestroyOverlappingIntervals(o);
+    bwClose(fp);
+    return rv;
+}
+
+//Entries appended after a run has been written out are still merged with each other, while spans and steps can't be appended ahead of a run
+//Returns 0 on success
+static int checkAppend(const char *fname) {
+    const char *chroms[NCHROMS] = {"chr1", "chr2"};
+    uint32_t lens[NCHROMS] = {LEN, 2*LEN};
+    const char *names[2] = {"chr2", "chr2"};
+    uint32_t starts[4] = {0, 10, 20, 30}, ends[4] = {10, 20, 30, 40};
+    float vals[4] = {1, 1, 1, 1};
+    bwOverlappingIntervals_t *o = NULL;
+    bigWigFile_t *fp = bwOpen(fname, NULL, "w");
+    int rv = 1;
+    if(!fp) return 1;
+
+    if(bwCreateHdr(fp, 10)) goto done;
+    if(bwSetMergeIntervals(fp, 0, 0)) goto done;
+    fp->cl = bwCreateChromList(chroms, lens, NCHROMS);
+    if(!fp->cl) goto done;
+    if(bwWriteHdr(fp)) goto done;
+
+    if(bwAddIntervalSpans(fp, "chr1", starts, 5, vals, 4)) goto done;
+    if(bwAddIntervals(fp, names, starts, ends, vals, 2)) goto done;
+    if(!bwAppendIntervalSpans(fp, starts, vals, 1) || !bwAppendIntervalSpanSteps(fp, vals, 1)) goto done;
+    //Writes the run out
+    if(bwSetMergeIntervals(fp, 0, 0)) goto done;
+    if(bwAppendIntervals(fp, starts+2, ends+2, vals+2, 2)) goto done;
+    bwClose(fp);
+
+    fp = bwOpen(fname, NULL, "r");
+    if(!fp) return 1;
+    o = bwGetOverlappingIntervals(fp, "chr2", 0, 2*LEN);
+    if(!o || o->l != 2 || o->end[0] != 20 || o->start[1] != 20 || o->end[1] != 40 || o->value[1] != 1) goto done;
+    rv = 0;
+
+done:
+    if(o) bwDestroyOverlappingIntervals(o);
+    bwClose(fp);
+    return rv;
+}
+
+//Check merging of equal values, values within a tolerance and quantized values, and appending to merged entries
+int main(int argc, char *argv[]) {
+    float *values = malloc(LEN * sizeof(float));
+    uint32_t nRuns;
+    int rv = 1;
+    if(argc != 3) {
+        fprintf(stderr, "Usage: %s output1.bw output2.bw\n", argv[0]);
+        return 1;
+    }
+
+    if(bwInit(1<<17) != 0) {
+        fprintf(stderr, "Received an error in bwInit\n");
+        return 1;
+    }
+    if(!values) goto done;
+
+    //Equal values, compared with writing the runs directly
+    makeValues(values, &nRuns, 0);
+    if(makeFile(argv[1], values, 0, 0, 1) || makeFile(argv[2], values, 0, 0, 0)) {
+        fprintf(stderr, "Couldn't create %s and %s\n", argv[1], argv[2]);
+        goto done;
+    }
+    if(compareFileEntries(argv[1], argv[2]) || checkFile(argv[2], values, nRuns, 0, 0)) {
+        fprintf(stderr, "Merging equal values gave the wrong entries\n");
+        goto done;
+    }
+
+    //Noisy values, within a tolerance or after rounding
+    makeValues(values, &nRuns, 1);
+    if(makeFile(argv[2], values, 0.1, 0, 0) || checkFile(argv[2], values, nRuns, 0.1, 0)) {
+        fprintf(stderr, "Merging values within a tolerance gave the wrong entries\n");
+        goto done;
+    }
+    if(makeFile(argv[2], values, 0, 0.5, 0) || checkFile(argv[2], values, nRuns, 0.25, 0.5)) {
+        fprintf(stderr, "Merging rounded values gave the wrong entries\n");
+        goto done;
+    }
+
+    if(checkAppend(argv[2])) {
+        fprintf(stderr, "Appending to merged entries gave the wrong result\n");
+        goto done;
+    }
+    rv = 0;
+
+done:
+    free(values);
+    bwCleanup();
+    return rv;
+}
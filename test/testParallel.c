@@ -0,0 +1,95 @@
+#include "bigWig.h"
+#include "testHelpers.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+//Write a file with zoom levels and intervals of varying widths, values and gaps
+//Returns 0 on success
+static int makeFile(const char *fname) {
+    const char *chrom = "chr1";
+    uint32_t len = 3000000;
+    bigWigFile_t *fp = createFile(fname, &chrom, &len, 1, 10);
+    if(!fp) return 1;
+
+    srand(5);
+    if(addRandomIntervals(fp, chrom, rand() % 100, len - 1000, 200, 150)) goto error;
+
+    bwClose(fp);
+    return 0;
+
+error:
+    bwClose(fp);
+    return 1;
+}
+
+//Returns 0 if the arrays are identical, where NaNs are equal to each other
+static int differArrays(const double *a, const double *b, uint32_t n) {
+    uint32_t i;
+    for(i=0; i<n; i++) {
+        if(differ(a[i], b[i], 0)) return 1;
+    }
+    return 0;
+}
+
+//Compare bwStatsParallel() with bwStats() for every type of statistic and several numbers of threads
+//Returns 0 if everything matches
+static int compare(bigWigFile_t *fp, uint32_t start, uint32_t end, uint32_t nBins) {
+    enum bwStatsType types[7] = {mean, stdev, max, min, coverage, sum, median};
+    int nThreads[3] = {1, 3, 0};
+    double *s1, *s2;
+    int i, j, rv = 0;
+
+    for(i=0; i<7 && !rv; i++) {
+        s1 = bwStats(fp, "chr1", start, end, nBins, types[i]);
+        for(j=0; j<3 && !rv; j++) {
+            s2 = bwStatsParallel(fp, "chr1", start, end, nBins, types[i], nThreads[j]);
+            if(!s1 || !s2 || differArrays(s1, s2, nBins)) {
+                fprintf(stderr, "Mismatch in %"PRIu32"-%"PRIu32" with %"PRIu32" bins of type %i and %i threads\n", start, end, nBins, types[i], nThreads[j]);
+                rv = 1;
+            }
+            free(s2);
+        }
+        free(s1);
+    }
+    return rv;
+}
+
+//Check bwStatsParallel() on a synthetic file
+int main(int argc, char *argv[]) {
+    bigWigFile_t *fp = NULL;
+    int rv = 1;
+    if(argc != 2) {
+        fprintf(stderr, "Usage: %s output.bw\n", argv[0]);
+        return 1;
+    }
+
+    if(bwInit(1<<17) != 0) {
+        fprintf(stderr, "Received an error in bwInit\n");
+        return 1;
+    }
+
+    if(makeFile(argv[1])) {
+        fprintf(stderr, "Couldn't create %s\n", argv[1]);
+        goto done;
+    }
+    fp = bwOpen(argv[1], NULL, "r");
+    if(!fp) {
+        fprintf(stderr, "An error occured while opening %s\n", argv[1]);
+        goto done;
+    }
+
+    //Zoom levels, full resolution data and bin counts that don't divide evenly between threads
+    if(compare(fp, 0, 3000000, 1)) goto done;
+    if(compare(fp, 0, 3000000, 257)) goto done;
+    if(compare(fp, 12345, 2345678, 77)) goto done;
+    if(compare(fp, 1000, 16000, 500)) goto done;
+    rv = 0;
+
+done:
+    bwClose(fp);
+    bwCleanup();
+    return rv;
+}
@@ -0,0 +1,89 @@
+#include "bigWig.h"
+#include "testHelpers.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+//bwStatsFromFull() multiplies values by their widths in single precision when computing sums, so the tolerance can't be very tight
+#define TOLERANCE 1e-6
+
+//Compare bwStats() with bwStatsFromFull() over every chromosome, or with bwStats() on ref if it's not NULL (in which case the results must be identical)
+//Returns 0 if everything matches
+static int compare(bigWigFile_t *fp, bigWigFile_t *ref) {
+    enum bwStatsType types[3] = {mean, coverage, sum};
+    uint32_t nBins[3] = {1, 7, 1000};
+    double *s1, *s2;
+    uint32_t tid, i, j, k, len;
+    int rv = 0;
+
+    for(tid=0; tid<fp->cl->nKeys && !rv; tid++) {
+        len = fp->cl->len[tid];
+        for(i=0; i<3 && !rv; i++) {
+            for(j=0; j<3 && !rv; j++) {
+                //Both whole chromosomes and intervals that start and end part way through entries
+                s1 = bwStats(fp, fp->cl->chrom[tid], len/3 + 1, len - len/5, nBins[j], types[i]);
+                if(ref) s2 = bwStats(ref, fp->cl->chrom[tid], len/3 + 1, len - len/5, nBins[j], types[i]);
+                else s2 = bwStatsFromFull(fp, fp->cl->chrom[tid], len/3 + 1, len - len/5, nBins[j], types[i]);
+                if(!s1 || !s2) rv = 1;
+                else if(ref && memcmp(s1, s2, nBins[j] * sizeof(double))) rv = 1;
+                else {
+                    for(k=0; k<nBins[j]; k++) {
+                        if(differ(s1[k], s2[k], TOLERANCE)) rv = 1;
+                    }
+                }
+                if(rv) fprintf(stderr, "Mismatch on %s with %"PRIu32" bins of type %i\n", fp->cl->chrom[tid], nBins[j], types[i]);
+                free(s1);
+                free(s2);
+            }
+        }
+    }
+    return rv;
+}
+
+//Create prefix sums, check that bwStats() then gives full resolution results, and save and reload them
+int main(int argc, char *argv[]) {
+    bigWigFile_t *fp = NULL, *fp2 = NULL;
+    int rv = 1;
+    if(argc != 3) {
+        fprintf(stderr, "Usage: %s file.bw output.psum\n", argv[0]);
+        return 1;
+    }
+
+    if(bwInit(1<<17) != 0) {
+        fprintf(stderr, "Received an error in bwInit\n");
+        return 1;
+    }
+
+    fp = bwOpen(argv[1], NULL, "r");
+    fp2 = bwOpen(argv[1], NULL, "r");
+    if(!fp || !fp2) {
+        fprintf(stderr, "An error occured while opening %s\n", argv[1]);
+        goto done;
+    }
+
+    if(bwCreatePrefixSums(fp)) {
+        fprintf(stderr, "bwCreatePrefixSums failed\n");
+        goto done;
+    }
+    if(compare(fp, NULL)) goto done;
+
+    if(bwWritePrefixSums(fp, argv[2])) {
+        fprintf(stderr, "bwWritePrefixSums failed\n");
+        goto done;
+    }
+    if(bwReadPrefixSums(fp2, argv[2])) {
+        fprintf(stderr, "bwReadPrefixSums failed\n");
+        goto done;
+    }
+    if(compare(fp2, fp)) goto done;
+
+    rv = 0;
+
+done:
+    bwClose(fp);
+    bwClose(fp2);
+    bwCleanup();
+    return rv;
+}
@@ -0,0 +1,153 @@
+#include "bigWig.h"
+#include "testHelpers.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define NQUANTILES 6
+
+//Write a file with intervals of varying widths and gaps and values with many ties
+//Returns 0 on success
+static int makeFile(const char *fname) {
+    const char *chrom = "chr1";
+    uint32_t len = 300000;
+    bigWigFile_t *fp = createFile(fname, &chrom, &len, 1, 10);
+    if(!fp) return 1;
+
+    srand(7);
+    //Leave a large gap in the middle, so some bins are empty
+    if(addRandomIntervals(fp, chrom, 1000, 100000, 100, 50)) goto error;
+    if(addRandomIntervals(fp, chrom, 150000, len - 1000, 100, 50)) goto error;
+
+    bwClose(fp);
+    return 0;
+
+error:
+    bwClose(fp);
+    return 1;
+}
+
+static int cmpFloat(const void *a, const void *b) {
+    float x = *(const float*) a, y = *(const float*) b;
+    return (x > y) - (x < y);
+}
+
+//Compute quantiles over [start, end) by sorting every per-base value
+static void bruteForce(bigWigFile_t *fp, uint32_t start, uint32_t end, const double *quantiles, double *output) {
+    bwOverlappingIntervals_t *o = bwGetOverlappingIntervals(fp, "chr1", start, end);
+    float *vals = malloc(sizeof(float) * (end - start));
+    uint32_t i, j, s, e, n = 0;
+    double h;
+
+    for(i=0; o && i<o->l; i++) {
+        s = (o->start[i] < start) ? start : o->start[i];
+        e = (o->end[i] > end) ? end : o->end[i];
+        for(j=s; j<e; j++) vals[n++] = o->value[i];
+    }
+    qsort(vals, n, sizeof(float), cmpFloat);
+    for(i=0; i<NQUANTILES; i++) {
+        if(!n) {
+            output[i] = strtod("NaN", NULL);
+            continue;
+        }
+        h = quantiles[i] * (n - 1);
+        j = (uint32_t) h;
+        output[i] = vals[j];
+        if(h > j) output[i] += (h - j) * (vals[j+1] - vals[j]);
+    }
+    if(o) bwDestroyOverlappingIntervals(o);
+    free(vals);
+}
+
+//Compare exact and approximate quantiles with a brute force computation
+//Returns 0 if everything matches
+static int compare(bigWigFile_t *fp, uint32_t start, uint32_t end, uint32_t nBins) {
+    const double quantiles[NQUANTILES] = {0, 0.1, 0.25, 0.5, 0.9, 1};
+    double *exact = bwQuantiles(fp, "chr1", start, end, nBins, quantiles, NQUANTILES, 0);
+    double *approx = bwQuantiles(fp, "chr1", start, end, nBins, quantiles, NQUANTILES, 1);
+    double *medians = bwStatsFromFull(fp, "chr1", start, end, nBins, median);
+    double expected[NQUANTILES];
+    uint32_t i, j, pos = start, end2;
+    int rv = 0;
+
+    if(!exact || !approx || !medians) {
+        fprintf(stderr, "Couldn't compute quantiles\n");
+        rv = 1;
+    }
+    for(i=0; i<nBins && !rv; i++) {
+        end2 = start + ((double)(end-start)*(i+1))/((int) nBins);
+        bruteForce(fp, pos, end2, quantiles, expected);
+        for(j=0; j<NQUANTILES; j++) {
+            //Adding the fractional part in single or double precision can differ slightly
+            if(differ(exact[i*NQUANTILES+j], expected[j], 1e-6)) rv = 1;
+            //The sketch is accurate to 1%, the interpolation between two estimates can add a little to that
+            if(differ(approx[i*NQUANTILES+j], expected[j], 0.021)) rv = 1;
+            if(rv) {
+                fprintf(stderr, "Mismatch in bin %"PRIu32" of %"PRIu32"-%"PRIu32" for quantile %f: %f (exact) %f (approximate) vs. %f\n", i, start, end, quantiles[j], exact[i*NQUANTILES+j], approx[i*NQUANTILES+j], expected[j]);
+                break;
+            }
+        }
+        if(!rv && memcmp(medians + i, exact + i*NQUANTILES + 3, sizeof(double)) && !(isnan(medians[i]) && isnan(exact[i*NQUANTILES+3]))) {
+            fprintf(stderr, "bwStatsFromFull() gave a different median in bin %"PRIu32"\n", i);
+            rv = 1;
+        }
+        pos = end2;
+    }
+    free(exact);
+    free(approx);
+    free(medians);
+    return rv;
+}
+
+//Check bwQuantiles() on a synthetic file
+int main(int argc, char *argv[]) {
+    bigWigFile_t *fp = NULL;
+    double *stats = NULL;
+    const double bad = 1.5;
+    int rv = 1;
+    if(argc != 2) {
+        fprintf(stderr, "Usage: %s output.bw\n", argv[0]);
+        return 1;
+    }
+
+    if(bwInit(1<<17) != 0) {
+        fprintf(stderr, "Received an error in bwInit\n");
+        return 1;
+    }
+
+    if(makeFile(argv[1])) {
+        fprintf(stderr, "Couldn't create %s\n", argv[1]);
+        goto done;
+    }
+    fp = bwOpen(argv[1], NULL, "r");
+    if(!fp) {
+        fprintf(stderr, "An error occured while opening %s\n", argv[1]);
+        goto done;
+    }
+
+    if(compare(fp, 0, 300000, 1)) goto done;
+    if(compare(fp, 0, 300000, 13)) goto done;
+    if(compare(fp, 1234, 5678, 100)) goto done;
+
+    //Large bins use the sketch, small ones are exact
+    stats = bwStats(fp, "chr1", 0, 300000, 30, median);
+    if(!stats || isnan(stats[0]) || !isnan(stats[11])) {
+        fprintf(stderr, "bwStats() gave unexpected medians\n");
+        goto done;
+    }
+    free(stats);
+    stats = bwQuantiles(fp, "chr1", 0, 300000, 1, &bad, 1, 0);
+    if(stats) {
+        fprintf(stderr, "bwQuantiles() accepted a quantile above 1\n");
+        goto done;
+    }
+    rv = 0;
+
+done:
+    free(stats);
+    bwClose(fp);
+    bwCleanup();
+    return rv;
+}
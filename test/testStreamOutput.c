@@ -0,0 +1,65 @@
+#include "bigWig.h"
+#include "testHelpers.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NCHROMS 2
+#define NENTRIES 20000
+
+//Write a file with each type of entry, optionally streaming it
+//Returns 0 on success
+static int makeFile(const char *fname, int stream) {
+    const char *chroms[NCHROMS] = {"chr1", "chr2"};
+    uint32_t lens[NCHROMS] = {3000000, 2000000};
+    bigWigFile_t *fp = bwOpen(fname, NULL, "w");
+    if(!fp) return 1;
+
+    if(bwCreateHdr(fp, 10)) goto error;
+    if(stream && bwSetStreamOutput(fp, NULL)) goto error;
+    fp->cl = bwCreateChromList(chroms, lens, NCHROMS);
+    if(!fp->cl) goto error;
+    if(bwWriteHdr(fp)) goto error;
+    //It's too late to start streaming
+    if(bwSetStreamOutput(fp, NULL) == 0) goto error;
+
+    srand(31);
+    if(addEntryTypes(fp, chroms[0], chroms[0], chroms[1], NENTRIES)) goto error;
+
+    bwClose(fp);
+    return 0;
+
+error:
+    bwClose(fp);
+    return 1;
+}
+
+//Write a file normally and then again, streamed, to stdout, which is expected to be a pipe
+int main(int argc, char *argv[]) {
+    if(argc != 2) {
+        fprintf(stderr, "Usage: %s output.bw > streamed.bw\n", argv[0]);
+        return 1;
+    }
+
+    if(bwInit(1<<17) != 0) {
+        fprintf(stderr, "Received an error in bwInit\n");
+        return 1;
+    }
+
+    if(makeFile(argv[1], 0)) {
+        fprintf(stderr, "Couldn't create %s\n", argv[1]);
+        goto error;
+    }
+    if(makeFile("/dev/stdout", 1)) {
+        fprintf(stderr, "Couldn't stream to stdout\n");
+        goto error;
+    }
+
+    bwCleanup();
+    return 0;
+
+error:
+    bwCleanup();
+    return 1;
+}
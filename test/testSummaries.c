@@ -0,0 +1,159 @@
+#include "bigWig.h"
+#include "testHelpers.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define NCHROMS 3
+
+//Write a file with nLevels zoom levels, where the last chromosome has no entries
+//Returns 0 on success
+static int makeFile(const char *fname, int32_t nLevels) {
+    const char *chroms[NCHROMS] = {"chr1", "chr2", "chrEmpty"};
+    uint32_t lens[NCHROMS] = {1000000, 300000, 50000}, tid;
+    bigWigFile_t *fp = createFile(fname, chroms, lens, NCHROMS, nLevels);
+    if(!fp) return 1;
+
+    srand(3);
+    for(tid=0; tid<NCHROMS-1; tid++) {
+        if(addRandomIntervals(fp, chroms[tid], rand() % 100, lens[tid] - 1000, 200, 150)) goto error;
+    }
+
+    bwClose(fp);
+    return 0;
+
+error:
+    bwClose(fp);
+    return 1;
+}
+
+//Compare bwChromSummaries() with totals over the full resolution intervals of each chromosome
+//Sums are stored in single precision in zoom levels, so tol is the relative tolerance for them
+//Returns 0 if everything matches
+static int compare(const char *fname, double tol) {
+    bigWigFile_t *fp = bwOpen(fname, NULL, "r");
+    bwChromSummary_t *s = NULL, e;
+    bwOverlappingIntervals_t *o;
+    uint32_t tid, i, n;
+    int rv = 0;
+
+    if(!fp) {
+        fprintf(stderr, "An error occured while opening %s\n", fname);
+        return 1;
+    }
+    s = bwChromSummaries(fp);
+    if(!s) {
+        fprintf(stderr, "bwChromSummaries() failed on %s\n", fname);
+        rv = 1;
+    }
+
+    for(tid=0; tid<fp->cl->nKeys && !rv; tid++) {
+        memset(&e, 0, sizeof(bwChromSummary_t));
+        e.minVal = strtod("NaN", NULL);
+        e.maxVal = strtod("NaN", NULL);
+        o = bwGetOverlappingIntervals(fp, fp->cl->chrom[tid], 0, fp->cl->len[tid]);
+        for(i=0; o && i<o->l; i++) {
+            n = o->end[i] - o->start[i];
+            if(!e.nBasesCovered || o->value[i] < e.minVal) e.minVal = o->value[i];
+            if(!e.nBasesCovered || o->value[i] > e.maxVal) e.maxVal = o->value[i];
+            e.nBasesCovered += n;
+            e.sumData += n * (double) o->value[i];
+            e.sumSquared += n * (double) o->value[i] * o->value[i];
+        }
+        if(o) bwDestroyOverlappingIntervals(o);
+
+        if(s[tid].nBasesCovered != e.nBasesCovered || differ(s[tid].minVal, e.minVal, 0) || differ(s[tid].maxVal, e.maxVal, 0) ||
+           differ(s[tid].sumData, e.sumData, tol) || differ(s[tid].sumSquared, e.sumSquared, tol)) {
+            fprintf(stderr, "Mismatch on %s in %s: %"PRIu64" %f %f %f %f vs. %"PRIu64" %f %f %f %f\n", fp->cl->chrom[tid], fname,
+                s[tid].nBasesCovered, s[tid].minVal, s[tid].maxVal, s[tid].sumData, s[tid].sumSquared,
+                e.nBasesCovered, e.minVal, e.maxVal, e.sumData, e.sumSquared);
+            rv = 1;
+        }
+    }
+
+    free(s);
+    bwClose(fp);
+    return rv;
+}
+
+//A pread()-based I/O backend that counts the reads starting within [start, end)
+typedef struct {
+    int fd;
+    uint64_t start, end;
+    uint32_t n;
+} countingIO_t;
+
+static size_t countingRead(void *ctx, void *buf, size_t len, uint64_t offset) {
+    countingIO_t *c = ctx;
+    ssize_t rv = pread(c->fd, buf, len, offset);
+    if(offset >= c->start && offset < c->end) c->n++;
+    if(rv < 0) return 0;
+    return rv;
+}
+
+static void countingClose(void *ctx) {
+    close(((countingIO_t*) ctx)->fd);
+}
+
+//Returns 0 if bwChromSummaries() reads nothing from the full resolution data blocks, as every zoom record holds its sums
+static int checkNoFullReads(const char *fname) {
+    countingIO_t c = {0};
+    bwIO_t io = {0};
+    bigWigFile_t *fp;
+    bwChromSummary_t *s;
+
+    c.fd = open(fname, O_RDONLY);
+    if(c.fd < 0) return 1;
+    io.ctx = &c;
+    io.read = countingRead;
+    io.close = countingClose;
+    fp = bwOpenIO(&io);
+    if(!fp) return 1;
+
+    c.start = fp->hdr->dataOffset;
+    c.end = fp->hdr->indexOffset;
+    s = bwChromSummaries(fp);
+    if(s && c.n) fprintf(stderr, "bwChromSummaries() made %"PRIu32" reads of full resolution data in %s\n", c.n, fname);
+    free(s);
+    bwClose(fp);
+    return !s || c.n;
+}
+
+//Check bwChromSummaries() on an existing file and on synthetic files with and without zoom levels
+int main(int argc, char *argv[]) {
+    int rv = 1;
+    if(argc != 3) {
+        fprintf(stderr, "Usage: %s file.bw output.bw\n", argv[0]);
+        return 1;
+    }
+
+    if(bwInit(1<<17) != 0) {
+        fprintf(stderr, "Received an error in bwInit\n");
+        return 1;
+    }
+
+    if(compare(argv[1], 1e-6)) goto done;
+
+    if(makeFile(argv[2], 10)) {
+        fprintf(stderr, "Couldn't create %s\n", argv[2]);
+        goto done;
+    }
+    if(compare(argv[2], 1e-4)) goto done;
+    if(checkNoFullReads(argv[2])) goto done;
+
+    //Falls back to the full resolution data
+    if(makeFile(argv[2], 0)) {
+        fprintf(stderr, "Couldn't create %s\n", argv[2]);
+        goto done;
+    }
+    if(compare(argv[2], 1e-12)) goto done;
+    rv = 0;
+
+done:
+    bwCleanup();
+    return rv;
+}
@@ -0,0 +1,231 @@
+#include "bigWig.h"
+#include "testHelpers.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NCHROMS 3
+#define NENTRIES 400000
+#define NWIG 100000
+
+static const char *chroms[NCHROMS] = {"chr1", "chr2", "chr3"};
+static uint32_t lens[NCHROMS] = {40000000, 30000000, 20000000};
+
+//Entries in the order that they're written as text
+typedef struct {
+    const char *names[NENTRIES];
+    uint32_t starts[NENTRIES], ends[NENTRIES];
+    float values[NENTRIES];
+} entries_t;
+
+//Print a value in one of several formats and return what strtof() makes of it
+static float printValue(FILE *f, uint32_t i) {
+    char buf[64];
+    float v = (rand() % 2000) / 16.0f - 40;
+    switch(i % 6) {
+    case 0: snprintf(buf, sizeof(buf), "%g", v); break;
+    case 1: snprintf(buf, sizeof(buf), "%.3f", v / 7); break;
+    case 2: snprintf(buf, sizeof(buf), "%.8e", v / 3); break;
+    case 3: snprintf(buf, sizeof(buf), "%d", (int) v); break;
+    case 4: snprintf(buf, sizeof(buf), "%.12f", v / 11); break;
+    default: snprintf(buf, sizeof(buf), "%+.1f", v * 1000); break;
+    }
+    fputs(buf, f);
+    return strtof(buf, NULL);
+}
+
+//Write sorted bedGraph text, with comments, blank lines and the odd CRLF line ending mixed in
+//Returns the input, rewound, or NULL on error
+static FILE *makeBedGraph(entries_t *e) {
+    FILE *f = tmpfile();
+    uint32_t i, tid = 0, pos = 0;
+    if(!f) return NULL;
+
+    fprintf(f, "track type=bedGraph name=test\n# A comment\n\n");
+    srand(31);
+    for(i=0; i<NENTRIES; i++) {
+        if(i && i % (NENTRIES/NCHROMS + 1) == 0) {
+            tid++;
+            pos = 0;
+        }
+        e->names[i] = chroms[tid];
+        e->starts[i] = pos;
+        e->ends[i] = pos + 1 + rand() % 40;
+        pos = e->ends[i] + rand() % 30;
+        fprintf(f, "%s\t%"PRIu32"%s%"PRIu32"\t", chroms[tid], e->starts[i], (i % 5) ? "\t" : " ", e->ends[i]);
+        e->values[i] = printValue(f, i);
+        fputs((i % 97) ? "\n" : "\r\n", f);
+        if(i % 10007 == 0) fputs("\n", f);
+    }
+    rewind(f);
+    return f;
+}
+
+//Write a wiggle file with a variableStep and two fixedStep sections, each longer than a batch
+//Returns the input, rewound, or NULL on error
+static FILE *makeWiggle(uint32_t *starts, float *values) {
+    FILE *f = tmpfile();
+    uint32_t i;
+    if(!f) return NULL;
+
+    srand(37);
+    fprintf(f, "track type=wiggle_0\nvariableStep chrom=chr1 span=25\n");
+    for(i=0; i<NWIG; i++) {
+        starts[i] = 40*i + i%13;
+        fprintf(f, "%"PRIu32" ", starts[i] + 1);
+        values[i] = printValue(f, i);
+        fputs("\n", f);
+    }
+    fprintf(f, "fixedStep chrom=chr2 start=101 step=50 span=20\n");
+    for(i=NWIG; i<2*NWIG; i++) {
+        values[i] = printValue(f, i);
+        fputs("\n", f);
+    }
+    fprintf(f, "# A comment\nfixedStep  chrom=chr3 start=1 step=10\n");
+    for(i=2*NWIG; i<3*NWIG; i++) {
+        values[i] = printValue(f, i);
+        fputs("\n", f);
+    }
+    rewind(f);
+    return f;
+}
+
+//Returns 0 if bwAddBedGraph() rejects text
+static int rejects(const char *fname, const char *text, int nThreads) {
+    bigWigFile_t *fp = NULL;
+    FILE *f = tmpfile();
+    int rv = 1;
+    if(!f) return 1;
+    fputs(text, f);
+    rewind(f);
+
+    fp = createFile(fname, chroms, lens, NCHROMS, 10);
+    if(fp && bwAddBedGraph(fp, f, nThreads)) rv = 0;
+    bwClose(fp);
+    fclose(f);
+    return rv;
+}
+
+//Returns 0 if values at the limits of exactly representable digits read back as strtof() parses them
+static int checkValues(const char *fname) {
+    const char *values[] = {"1677721.7", "0.16777217", "16777217", "16777219", "167772.18", "16.777219", "16777216", "1.6777216", "-1677721.6", "0.0000016777215"};
+    uint32_t i, n = sizeof(values) / sizeof(values[0]);
+    bwOverlappingIntervals_t *o = NULL;
+    bigWigFile_t *fp = NULL;
+    FILE *f = tmpfile();
+    int rv = 1;
+    if(!f) return 1;
+    for(i=0; i<n; i++) fprintf(f, "chr1\t%"PRIu32"\t%"PRIu32"\t%s\n", 10*i, 10*i+5, values[i]);
+    rewind(f);
+
+    fp = createFile(fname, chroms, lens, NCHROMS, 10);
+    if(!fp || bwAddBedGraph(fp, f, 1)) goto done;
+    bwClose(fp);
+    fp = bwOpen(fname, NULL, "r");
+    if(!fp) goto done;
+    o = bwGetOverlappingIntervals(fp, "chr1", 0, 10*n);
+    if(!o || o->l != n) goto done;
+    for(i=0; i<n; i++) {
+        if(o->value[i] != strtof(values[i], NULL)) {
+            fprintf(stderr, "%s was read as %.9g\n", values[i], o->value[i]);
+            goto done;
+        }
+    }
+    rv = 0;
+
+done:
+    if(o) bwDestroyOverlappingIntervals(o);
+    bwClose(fp);
+    fclose(f);
+    return rv;
+}
+
+//Check that bedGraph and wiggle text gives the same file as adding the entries directly
+int main(int argc, char *argv[]) {
+    int nThreads[4] = {1, 2, 5, 0}, i, rv = 1;
+    const char *bad[3] = {"chr1\t0\t10\t1\nchr4\t0\t10\t1\n", "chr1\t0\t10\t1\nchr1\t10\t20\tx\n", "chr1\t10\t5\t1\n"};
+    entries_t *e = calloc(1, sizeof(entries_t));
+    uint32_t *starts = malloc(NWIG * sizeof(uint32_t));
+    float *values = malloc(3 * NWIG * sizeof(float));
+    bigWigFile_t *fp = NULL;
+    FILE *f = NULL;
+    if(argc != 3) {
+        fprintf(stderr, "Usage: %s output1.bw output2.bw\n", argv[0]);
+        return 1;
+    }
+    if(!e || !starts || !values) goto done;
+
+    if(bwInit(1<<17) != 0) {
+        fprintf(stderr, "Received an error in bwInit\n");
+        goto done;
+    }
+
+    //bedGraph, parsed on the calling thread and on several
+    f = makeBedGraph(e);
+    fp = createFile(argv[1], chroms, lens, NCHROMS, 10);
+    if(!f || !fp || bwAddIntervals(fp, e->names, e->starts, e->ends, e->values, NENTRIES)) {
+        fprintf(stderr, "Couldn't create %s\n", argv[1]);
+        goto done;
+    }
+    bwClose(fp);
+    for(i=0; i<4; i++) {
+        rewind(f);
+        fp = createFile(argv[2], chroms, lens, NCHROMS, 10);
+        if(!fp || bwAddBedGraph(fp, f, nThreads[i])) {
+            fprintf(stderr, "Couldn't add bedGraph text with %i threads\n", nThreads[i]);
+            goto done;
+        }
+        bwClose(fp);
+        fp = NULL;
+        if(compareFileBytes(argv[1], argv[2])) {
+            fprintf(stderr, "Adding bedGraph text with %i threads changed the output\n", nThreads[i]);
+            goto done;
+        }
+    }
+    fclose(f);
+    f = NULL;
+
+    if(checkValues(argv[2])) {
+        fprintf(stderr, "bwAddBedGraph() didn't parse values as strtof() does\n");
+        goto done;
+    }
+
+    //Unknown chromosomes, values that aren't numbers and empty intervals
+    for(i=0; i<3; i++) {
+        if(rejects(argv[2], bad[i], 1) || rejects(argv[2], bad[i], 3)) {
+            fprintf(stderr, "Invalid bedGraph line %i was accepted\n", i);
+            goto done;
+        }
+    }
+
+    //Wiggle
+    f = makeWiggle(starts, values);
+    fp = createFile(argv[1], chroms, lens, NCHROMS, 10);
+    if(!f || !fp) goto done;
+    if(bwAddIntervalSpans(fp, chroms[0], starts, 25, values, NWIG)) goto done;
+    if(bwAddIntervalSpanSteps(fp, chroms[1], 100, 20, 50, values + NWIG, NWIG)) goto done;
+    if(bwAddIntervalSpanSteps(fp, chroms[2], 0, 1, 10, values + 2*NWIG, NWIG)) goto done;
+    bwClose(fp);
+    fp = createFile(argv[2], chroms, lens, NCHROMS, 10);
+    if(!fp || bwAddWiggle(fp, f)) {
+        fprintf(stderr, "Couldn't add wiggle text\n");
+        goto done;
+    }
+    bwClose(fp);
+    fp = NULL;
+    if(compareFileBytes(argv[1], argv[2])) {
+        fprintf(stderr, "Adding wiggle text changed the output\n");
+        goto done;
+    }
+    rv = 0;
+
+done:
+    bwClose(fp);
+    if(f) fclose(f);
+    free(e);
+    free(starts);
+    free(values);
+    bwCleanup();
+    return rv;
+}
@@ -0,0 +1,176 @@
+#include "bigWig.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+
+#define NTHREADS 8
+#define NBINS 10
+#define NREPEATS 4
+
+typedef struct {
+    bigWigFile_t *fp;
+    bigWigFile_t *ref;
+    double **means; //The expected bwStats() output for each chromosome
+    uint32_t offset;
+    int flatten;
+    int rv;
+} job_t;
+
+//Query every chromosome, starting at a different one in each thread so that they're all loaded concurrently
+static void *worker(void *arg) {
+    job_t *job = (job_t*) arg;
+    bwOverlappingIntervals_t *o1, *o2;
+    const char *chrom;
+    double *stats;
+    uint32_t i, tid, nKeys = job->ref->cl->nKeys;
+
+    if(job->flatten && bwFlattenIndex(job->fp)) {
+        job->rv = 1;
+        return NULL;
+    }
+    for(i=0; i<nKeys*NREPEATS && !job->rv; i++) {
+        tid = (i + job->offset) % nKeys;
+        chrom = bwGetChrom(job->fp, tid);
+        if(!chrom || strcmp(chrom, job->ref->cl->chrom[tid]) != 0 || bwGetTid(job->fp, chrom) != tid) {
+            job->rv = 1;
+            break;
+        }
+
+        o1 = bwGetOverlappingIntervals(job->ref, chrom, 0, job->ref->cl->len[tid]);
+        o2 = bwGetOverlappingIntervals(job->fp, chrom, 0, job->ref->cl->len[tid]);
+        if(!o1 || !o2 || o1->l != o2->l) job->rv = 1;
+        else if(memcmp(o1->start, o2->start, o1->l * sizeof(uint32_t))) job->rv = 1;
+        else if(memcmp(o1->value, o2->value, o1->l * sizeof(float))) job->rv = 1;
+        if(o1) bwDestroyOverlappingIntervals(o1);
+        if(o2) bwDestroyOverlappingIntervals(o2);
+
+        //Uses the zoom levels
+        stats = bwStats(job->fp, chrom, 0, job->ref->cl->len[tid], NBINS, mean);
+        if(!stats || memcmp(stats, job->means[tid], NBINS * sizeof(double))) job->rv = 1;
+        free(stats);
+    }
+
+    //Forces everything to be read in, possibly by several threads at once
+    if(bwGetTid(job->fp, "no such chromosome") != (uint32_t) -1) job->rv = 1;
+    return NULL;
+}
+
+//Returns 0 if bwStatsParallel() gives the same results as bwStats() on every chromosome
+static int checkParallel(bigWigFile_t *fp, bigWigFile_t *ref) {
+    double *s1, *s2;
+    uint32_t tid;
+    int rv = 0;
+
+    for(tid=0; tid<ref->cl->nKeys && !rv; tid++) {
+        s1 = bwStats(ref, ref->cl->chrom[tid], 0, ref->cl->len[tid], NBINS*100, mean);
+        s2 = bwStatsParallel(fp, ref->cl->chrom[tid], 0, ref->cl->len[tid], NBINS*100, mean, 2*NTHREADS);
+        if(!s1 || !s2 || memcmp(s1, s2, NBINS * 100 * sizeof(double))) rv = 1;
+        free(s1);
+        free(s2);
+    }
+    return rv;
+}
+
+//Query clones of a lazily opened file from several threads at once, so the index, zoom levels and chromosome list are all read in concurrently
+//If a second argument of "uring" is given then the file is instead read through a single io_uring backend shared by every thread, which exits with 77 if io_uring isn't available
+int main(int argc, char *argv[]) {
+    bigWigFile_t *fp = NULL, *ref = NULL, *clones[NTHREADS] = {NULL};
+    pthread_t threads[NTHREADS];
+    job_t jobs[NTHREADS];
+    double **means = NULL;
+    bwIO_t io;
+    uint32_t tid;
+    int i, nStarted = 0, rv = 1, ioRv;
+    memset(jobs, 0, sizeof(jobs));
+    if((argc != 2 && argc != 3) || (argc == 3 && strcmp(argv[2], "uring") != 0)) {
+        fprintf(stderr, "Usage: %s file.bw [uring]\n", argv[0]);
+        return 1;
+    }
+
+    if(bwInit(1<<17) != 0) {
+        fprintf(stderr, "Received an error in bwInit\n");
+        return 1;
+    }
+
+    ref = bwOpen(argv[1], NULL, "r");
+    if(argc == 3) {
+        ioRv = bwIOUringInit(&io, argv[1], 0);
+        if(ioRv) {
+            //Only skip if io_uring isn't there at all, not if the file can't be opened
+            if(errno == ENOSYS) {
+                fprintf(stderr, ioRv == 1 ? "libBigWig was compiled without io_uring support\n" : "The kernel doesn't support io_uring\n");
+                rv = 77;
+            } else {
+                fprintf(stderr, "Couldn't set up io_uring for %s: %s\n", argv[1], strerror(errno));
+            }
+            bwClose(ref);
+            bwCleanup();
+            return rv;
+        }
+        fp = bwOpenIO(&io);
+    } else {
+        fp = bwOpen(argv[1], NULL, "rl");
+    }
+    if(!ref || !fp) {
+        fprintf(stderr, "An error occured while opening %s\n", argv[1]);
+        goto done;
+    }
+
+    means = calloc(ref->cl->nKeys, sizeof(double*));
+    if(!means) goto done;
+    for(tid=0; tid<ref->cl->nKeys; tid++) {
+        means[tid] = bwStats(ref, ref->cl->chrom[tid], 0, ref->cl->len[tid], NBINS, mean);
+        if(!means[tid]) goto done;
+    }
+
+    //The original handle is used by the first thread and clones by the rest
+    for(i=0; i<NTHREADS; i++) {
+        clones[i] = i ? bwClone(fp) : fp;
+        if(!clones[i]) goto done;
+        jobs[i].fp = clones[i];
+        jobs[i].means = means;
+        jobs[i].offset = i;
+        jobs[i].flatten = i % 2;
+    }
+    //The reference handle isn't thread-safe, so each thread needs its own
+    for(i=0; i<NTHREADS; i++) {
+        jobs[i].ref = bwClone(ref);
+        if(!jobs[i].ref) goto done;
+    }
+
+    for(i=0; i<NTHREADS; i++) {
+        if(pthread_create(&threads[i], NULL, worker, &jobs[i])) break;
+        nStarted++;
+    }
+    for(i=0; i<nStarted; i++) pthread_join(threads[i], NULL);
+    if(nStarted != NTHREADS) goto done;
+
+    rv = 0;
+    for(i=0; i<NTHREADS; i++) {
+        if(jobs[i].rv) {
+            fprintf(stderr, "Thread %i got unexpected results\n", i);
+            rv = 1;
+        }
+    }
+    if(checkParallel(fp, ref)) {
+        fprintf(stderr, "bwStatsParallel() got unexpected results\n");
+        rv = 1;
+    }
+
+done:
+    for(i=0; i<NTHREADS; i++) {
+        bwClose(jobs[i].ref);
+        if(i) bwClose(clones[i]);
+    }
+    if(means) {
+        for(tid=0; tid<ref->cl->nKeys; tid++) free(means[tid]);
+        free(means);
+    }
+    bwClose(fp);
+    bwClose(ref);
+    bwCleanup();
+    return rv;
+}
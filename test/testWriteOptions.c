@@ -0,0 +1,136 @@
+#include "bigWig.h"
+#include "testHelpers.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define NCHROMS 2
+#define NENTRIES 30000
+
+//Write a file with each type of entry, using the given block size and index node size (or the defaults, for values of 0) and compression level
+//Returns 0 on success
+static int makeFile(const char *fname, uint32_t bufSize, uint32_t blockSize, int level) {
+    const char *chroms[NCHROMS] = {"chr1", "chr2"};
+    uint32_t lens[NCHROMS] = {3000000, 2000000};
+    bigWigFile_t *fp = bwOpen(fname, NULL, "w");
+    if(!fp) return 1;
+
+    if(bwCreateHdr(fp, 10)) goto error;
+    if(bufSize && bwSetBufSize(fp, bufSize)) goto error;
+    if(blockSize && bwSetBlockSize(fp, blockSize)) goto error;
+    if(bwSetCompressionLevel(fp, level)) goto error;
+    fp->cl = bwCreateChromList(chroms, lens, NCHROMS);
+    if(!fp->cl) goto error;
+    if(bwWriteHdr(fp)) goto error;
+    //None of these can be changed once the header is written
+    if(bwSetBufSize(fp, 4096) == 0 || bwSetBlockSize(fp, 16) == 0 || bwSetCompressionLevel(fp, 1) == 0) goto error;
+
+    srand(5);
+    if(addEntryTypes(fp, chroms[0], chroms[0], chroms[1], NENTRIES)) goto error;
+
+    bwClose(fp);
+    return 0;
+
+error:
+    bwClose(fp);
+    return 1;
+}
+
+//Returns 0 if two files hold the same entries and the zoom levels of the second match its full resolution data
+//The number of zoom levels depends on the block size, so the zoom levels themselves aren't compared
+static int compareFiles(const char *f1, const char *f2) {
+    bigWigFile_t *fp;
+    int rv;
+    if(compareFileEntries(f1, f2)) return 1;
+    fp = bwOpen(f2, NULL, "r");
+    if(!fp) return 1;
+    rv = checkZoomLevels(fp);
+    bwClose(fp);
+    return rv;
+}
+
+//The block size can't change once bwSetZoomLevels() has made the zoom level buffers, so trying to do so must fail and leave a usable file, with or without spilling
+//Returns 0 on success
+static int checkZoomOrder(const char *fname, int spill) {
+    const char *chroms[NCHROMS] = {"chr1", "chr2"};
+    uint32_t lens[NCHROMS] = {3000000, 2000000}, sizes[3] = {100, 1000, 10000};
+    bigWigFile_t *fp = bwOpen(fname, NULL, "w");
+    int rv;
+    if(!fp) return 1;
+
+    if(bwCreateHdr(fp, 10)) goto error;
+    fp->cl = bwCreateChromList(chroms, lens, NCHROMS);
+    if(!fp->cl) goto error;
+    if(bwSetZoomLevels(fp, sizes, 3)) goto error;
+    if(bwSetBufSize(fp, 1024) == 0) goto error;
+    if(spill && bwSetZoomSpill(fp, NULL)) goto error;
+    if(bwWriteHdr(fp)) goto error;
+    srand(7);
+    if(addEntryTypes(fp, chroms[0], chroms[0], chroms[1], NENTRIES)) goto error;
+    bwClose(fp);
+
+    fp = bwOpen(fname, NULL, "r");
+    if(!fp) return 1;
+    rv = checkZoomLevels(fp);
+    bwClose(fp);
+    return rv;
+
+error:
+    bwClose(fp);
+    return 1;
+}
+
+//Check that files written with different block sizes, index node sizes and compression levels hold the same data
+int main(int argc, char *argv[]) {
+    uint32_t bufSizes[4] = {64, 1000, 4096, 262164}, blockSizes[4] = {2, 3, 256, 65535};
+    int levels[4] = {Z_NO_COMPRESSION, Z_BEST_SPEED, 6, Z_BEST_COMPRESSION}, i;
+    bigWigFile_t *fp;
+    if(argc != 3) {
+        fprintf(stderr, "Usage: %s output1.bw output2.bw\n", argv[0]);
+        return 1;
+    }
+
+    if(bwInit(1<<17) != 0) {
+        fprintf(stderr, "Received an error in bwInit\n");
+        return 1;
+    }
+
+    //Out of range values
+    fp = bwOpen(argv[2], NULL, "w");
+    if(!fp || bwCreateHdr(fp, 10)) goto error;
+    if(bwSetBufSize(fp, 63) == 0 || bwSetBufSize(fp, 262165) == 0 || bwSetBlockSize(fp, 1) == 0 || bwSetCompressionLevel(fp, 10) == 0) {
+        fprintf(stderr, "Accepted an out of range value\n");
+        bwClose(fp);
+        goto error;
+    }
+    bwClose(fp);
+
+    if(checkZoomOrder(argv[2], 0) || checkZoomOrder(argv[2], 1)) {
+        fprintf(stderr, "Changing the block size after bwSetZoomLevels() wasn't refused\n");
+        goto error;
+    }
+
+    if(makeFile(argv[1], 0, 0, Z_DEFAULT_COMPRESSION)) {
+        fprintf(stderr, "Couldn't create %s\n", argv[1]);
+        goto error;
+    }
+    for(i=0; i<4; i++) {
+        if(makeFile(argv[2], bufSizes[i], blockSizes[i], levels[i])) {
+            fprintf(stderr, "Couldn't create %s with bufSize %"PRIu32", blockSize %"PRIu32" and level %i\n", argv[2], bufSizes[i], blockSizes[i], levels[i]);
+            goto error;
+        }
+        if(compareFiles(argv[1], argv[2])) {
+            fprintf(stderr, "Using bufSize %"PRIu32", blockSize %"PRIu32" and level %i changed the contents\n", bufSizes[i], blockSizes[i], levels[i]);
+            goto error;
+        }
+    }
+
+    bwCleanup();
+    return 0;
+
+error:
+    bwCleanup();
+    return 1;
+}
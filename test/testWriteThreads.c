@@ -0,0 +1,72 @@
+#include "bigWig.h"
+#include "testHelpers.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NCHROMS 3
+#define NENTRIES 50000
+
+//Write a file with each type of entry, compressing blocks on nThreads threads
+//Returns 0 on success
+static int makeFile(const char *fname, int nThreads) {
+    const char *chroms[NCHROMS] = {"chr1", "chr2", "chr3"};
+    uint32_t lens[NCHROMS] = {5000000, 4000000, 3000000};
+    bigWigFile_t *fp = bwOpen(fname, NULL, "w");
+    if(!fp) return 1;
+
+    if(bwCreateHdr(fp, 10)) goto error;
+    if(bwSetCompressionThreads(fp, nThreads)) goto error;
+    //A second call can't change the number of threads
+    if(nThreads > 1 && bwSetCompressionThreads(fp, nThreads) == 0) goto error;
+    fp->cl = bwCreateChromList(chroms, lens, NCHROMS);
+    if(!fp->cl) goto error;
+    if(bwWriteHdr(fp)) goto error;
+
+    srand(23);
+    if(addEntryTypes(fp, chroms[0], chroms[1], chroms[2], NENTRIES)) goto error;
+
+    bwClose(fp);
+    return 0;
+
+error:
+    bwClose(fp);
+    return 1;
+}
+
+//Check that compressing blocks on several threads doesn't change the output
+int main(int argc, char *argv[]) {
+    int nThreads[3] = {2, 5, 0}, i;
+    if(argc != 3) {
+        fprintf(stderr, "Usage: %s output1.bw output2.bw\n", argv[0]);
+        return 1;
+    }
+
+    if(bwInit(1<<17) != 0) {
+        fprintf(stderr, "Received an error in bwInit\n");
+        return 1;
+    }
+
+    if(makeFile(argv[1], 1)) {
+        fprintf(stderr, "Couldn't create %s\n", argv[1]);
+        goto error;
+    }
+    for(i=0; i<3; i++) {
+        if(makeFile(argv[2], nThreads[i])) {
+            fprintf(stderr, "Couldn't create %s with %i threads\n", argv[2], nThreads[i]);
+            goto error;
+        }
+        if(compareFileBytes(argv[1], argv[2])) {
+            fprintf(stderr, "Using %i threads changed the output\n", nThreads[i]);
+            goto error;
+        }
+    }
+
+    bwCleanup();
+    return 0;
+
+error:
+    bwCleanup();
+    return 1;
+}
@@ -0,0 +1,109 @@
+#include "bigWig.h"
+#include "testHelpers.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NCHROMS 2
+#define NENTRIES 20000
+
+//Write a file with each type of entry, optionally with user-specified zoom level sizes, with the chromosomes in reverse order and with zoom level data spilled to a temporary file in spillDir (or wherever tmpfile() puts it, if that's NULL)
+//Returns 0 on success
+static int makeFile(const char *fname, const uint32_t *sizes, uint16_t nSizes, int reversed, int spill, const char *spillDir) {
+    const char *chroms[NCHROMS] = {"chr1", "chr2"};
+    uint32_t lens[NCHROMS] = {3000000, 2500000};
+    bigWigFile_t *fp = createFile(fname, chroms, lens, NCHROMS, 10);
+    if(!fp) return 1;
+
+    if(sizes && bwSetZoomLevels(fp, sizes, nSizes)) goto error;
+    if(spill && bwSetZoomSpill(fp, spillDir)) goto error;
+
+    srand(17);
+    if(addEntryTypes(fp, chroms[reversed ? 1 : 0], chroms[reversed ? 1 : 0], chroms[reversed ? 0 : 1], NENTRIES)) goto error;
+
+    //Sizes can't be changed once entries have been added
+    if(bwSetZoomLevels(fp, sizes, 0) == 0) goto error;
+
+    bwClose(fp);
+    return 0;
+
+error:
+    bwClose(fp);
+    return 1;
+}
+
+//Check that zoom levels built while writing are the same whether their sizes are chosen or given, and when the file has to be re-read
+int main(int argc, char *argv[]) {
+    bigWigFile_t *fp = NULL;
+    uint32_t sizes[10], bad[2] = {1000, 1000};
+    uint16_t nSizes;
+    char *dir = NULL;
+    int rv = 1;
+    if(argc != 3) {
+        fprintf(stderr, "Usage: %s output1.bw output2.bw\n", argv[0]);
+        return 1;
+    }
+
+    if(bwInit(1<<17) != 0) {
+        fprintf(stderr, "Received an error in bwInit\n");
+        return 1;
+    }
+
+    if(makeFile(argv[1], NULL, 0, 0, 0, NULL)) {
+        fprintf(stderr, "Couldn't create %s\n", argv[1]);
+        goto done;
+    }
+    fp = bwOpen(argv[1], NULL, "r");
+    if(!fp || checkZoomLevels(fp)) goto done;
+    nSizes = fp->hdr->nLevels;
+    memcpy(sizes, fp->hdr->zoomHdrs->level, nSizes * sizeof(uint32_t));
+    bwClose(fp);
+    fp = NULL;
+
+    //The same sizes given up front must produce the same file
+    if(makeFile(argv[2], bad, 2, 0, 0, NULL) == 0) {
+        fprintf(stderr, "bwSetZoomLevels() accepted sizes that don't increase\n");
+        goto done;
+    }
+    if(makeFile(argv[2], sizes, nSizes, 0, 0, NULL)) {
+        fprintf(stderr, "Couldn't create %s\n", argv[2]);
+        goto done;
+    }
+    if(compareFileBytes(argv[1], argv[2])) {
+        fprintf(stderr, "Giving the zoom level sizes changed the output\n");
+        goto done;
+    }
+
+    //Spilling zoom level data to a temporary file, either from tmpfile() or next to the output
+    dir = strdup(argv[2]);
+    if(!dir) goto done;
+    if(strrchr(dir, '/')) *strrchr(dir, '/') = '\0';
+    else strcpy(dir, ".");
+    if(makeFile(argv[2], NULL, 0, 0, 1, NULL) || compareFileBytes(argv[1], argv[2])) {
+        fprintf(stderr, "Spilling zoom levels to tmpfile() changed the output\n");
+        goto done;
+    }
+    if(makeFile(argv[2], NULL, 0, 0, 1, dir) || compareFileBytes(argv[1], argv[2])) {
+        fprintf(stderr, "Spilling zoom levels to %s changed the output\n", dir);
+        goto done;
+    }
+
+    //Chromosomes out of order, with and without given sizes
+    if(makeFile(argv[1], NULL, 0, 1, 0, NULL) || makeFile(argv[2], sizes, nSizes, 1, 1, dir)) {
+        fprintf(stderr, "Couldn't create files with chromosomes out of order\n");
+        goto done;
+    }
+    fp = bwOpen(argv[1], NULL, "r");
+    if(!fp || checkZoomLevels(fp)) goto done;
+    bwClose(fp);
+    fp = bwOpen(argv[2], NULL, "r");
+    if(!fp || checkZoomLevels(fp)) goto done;
+    rv = 0;
+
+done:
+    bwClose(fp);
+    free(dir);
+    bwCleanup();
+    return rv;
+}